@@ -0,0 +1,917 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <ctype.h>
+#include <err.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+#define	CHUNKMIN	 (1024 * 1024) /* least bytes per thread */
+
+enum	wordt {
+	WORD_NAME, /* identifier or keyword */
+	WORD_QUOTED, /* quoted identifier */
+	WORD_LPAREN,
+	WORD_RPAREN,
+	WORD_COMMA,
+	WORD_EQ, /* = */
+	WORD_STAR, /* * */
+	WORD_OTHER /* literal, number, parameter, or operator */
+};
+
+/*
+ * A word of a statement: tokens split into names and what's between.
+ * Names may be qualified by the name before a dot.
+ */
+struct	word {
+	enum wordt	 type;
+	enum kw		 kw; /* if WORD_NAME */
+	const char	*name; /* WORD_NAME, WORD_QUOTED, or WORD_STAR */
+	size_t		 namesz;
+	const char	*qual; /* qualifier or NULL */
+	size_t		 qualsz;
+	const char	*end; /* just past the word */
+	int		 used; /* names a table or alias */
+	int		 write; /* assigned to */
+	size_t		 ref; /* if "write", the reference */
+};
+
+/*
+ * A table referenced by a statement, with its alias if any.
+ * The target of an insert, update, or delete is written.
+ */
+struct	ref {
+	const struct tab *tab;
+	const struct word *alias;
+	int		 write;
+	int		 allcols; /* insert without a column list */
+};
+
+/*
+ * State of a thread scanning part of the log.
+ */
+struct	scan {
+	const struct parse *p;
+	const struct access *a;
+	struct parse	 lp; /* the part of the log */
+	uint64_t	*reads;
+	uint64_t	*writes;
+	size_t		*rseen; /* statement last counting a read */
+	size_t		*wseen; /* ...and a write */
+	size_t		 nstmts;
+	struct word	*words; /* of the current statement */
+	size_t		 nwords;
+	size_t		 wordsz;
+	struct ref	*refs; /* of the current statement */
+	size_t		 nrefs;
+	size_t		 refsz;
+	char		*buf; /* for looking up table names */
+	size_t		 bufsz;
+	size_t		 depth; /* of parentheses */
+	enum kw		 main; /* kind of statement */
+	int		 body; /* insert has its select or values */
+	int		 dot; /* last word was followed by a dot */
+};
+
+/*
+ * Keywords that drive the scan: those beginning statements, those
+ * introducing tables and columns, and those that may follow a table
+ * (so aren't its alias).
+ * Other keywords may name tables and columns, so are taken as names.
+ */
+static enum kw
+scan_kw(enum kw kw)
+{
+
+	switch (kw) {
+	case (KW_ALL):
+	case (KW_AS):
+	case (KW_CROSS):
+	case (KW_DEFAULT):
+	case (KW_DELETE):
+	case (KW_DISTINCT):
+	case (KW_DO):
+	case (KW_EXCEPT):
+	case (KW_FROM):
+	case (KW_FULL):
+	case (KW_GROUP):
+	case (KW_HAVING):
+	case (KW_INDEXED):
+	case (KW_INNER):
+	case (KW_INSERT):
+	case (KW_INTERSECT):
+	case (KW_INTO):
+	case (KW_JOIN):
+	case (KW_LEFT):
+	case (KW_LIMIT):
+	case (KW_NATURAL):
+	case (KW_NOT):
+	case (KW_ON):
+	case (KW_OR):
+	case (KW_ORDER):
+	case (KW_OUTER):
+	case (KW_REPLACE):
+	case (KW_RETURNING):
+	case (KW_RIGHT):
+	case (KW_SELECT):
+	case (KW_SET):
+	case (KW_UNION):
+	case (KW_UPDATE):
+	case (KW_USING):
+	case (KW_VALUES):
+	case (KW_WHERE):
+	case (KW_WINDOW):
+	case (KW_WITH):
+		return(kw);
+	default:
+		return(KW_NONE);
+	}
+}
+
+static int
+isname(int c)
+{
+
+	return(isalnum((unsigned char)c) || '_' == c || '$' == c ||
+	    (unsigned char)c >= 0x80);
+}
+
+static struct word *
+word_push(struct scan *s, enum wordt type, const char *cp, size_t sz)
+{
+	struct word	*w;
+
+	if (s->nwords == s->wordsz) {
+		s->wordsz = 0 == s->wordsz ? 64 : s->wordsz * 2;
+		s->words = reallocarray(s->words,
+			s->wordsz, sizeof(struct word));
+		if (NULL == s->words)
+			err(EXIT_FAILURE, "reallocarray");
+	}
+	w = &s->words[s->nwords++];
+	memset(w, 0, sizeof(struct word));
+	w->type = type;
+	w->end = cp + sz;
+	if (WORD_NAME == type || WORD_QUOTED == type) {
+		w->name = cp;
+		w->namesz = sz;
+	}
+	return(w);
+}
+
+/*
+ * Push a name (quoted or not) at "cp", which starts "start" (before
+ * any quote), and is the keyword "kw" if unquoted.
+ * If it follows a name and a dot, that name becomes its qualifier.
+ */
+static struct word *
+word_name(struct scan *s, enum wordt type,
+	const char *start, const char *cp, size_t sz, enum kw kw)
+{
+	struct word	*w, *prev;
+
+	if (s->dot && start == s->words[s->nwords - 1].end + 1) {
+		prev = &s->words[s->nwords - 1];
+		prev->qual = prev->name;
+		prev->qualsz = prev->namesz;
+		prev->type = type;
+		prev->kw = KW_NONE;
+		prev->name = cp;
+		prev->namesz = sz;
+		prev->end = cp + sz;
+		w = prev;
+	} else
+		w = word_push(s, type, cp, sz);
+	if (WORD_NAME == type)
+		w->kw = scan_kw(kw);
+	s->dot = 0;
+	return(w);
+}
+
+static void	stmt_end(struct scan *);
+static void	stmt_word(struct scan *, const struct word *);
+
+/*
+ * Split a token into words.
+ */
+static void
+scan_token(struct scan *s, const struct sqltok *tok)
+{
+	const char	*cp = tok->start, *end = tok->start + tok->sz, *st;
+	struct word	*w;
+	char		 q;
+
+	if ('"' == tok->quot) {
+		w = word_name(s, WORD_QUOTED, cp - 1, cp, tok->sz, KW_NONE);
+		w->end = end + 1;
+		stmt_word(s, w);
+		return;
+	} else if ('\0' != tok->quot) {
+		s->dot = 0;
+		w = word_push(s, WORD_OTHER, cp, tok->sz + 1);
+		stmt_word(s, w);
+		return;
+	}
+
+	while (cp < end) {
+		st = cp;
+		if ('[' == *cp || '`' == *cp) {
+			q = '[' == *cp ? ']' : '`';
+			for (cp++; cp < end && q != *cp; cp++)
+				continue;
+			w = word_name(s, WORD_QUOTED,
+				st, st + 1, cp - st - 1, KW_NONE);
+			if (cp < end)
+				cp++;
+			w->end = cp;
+		} else if (isdigit((unsigned char)*cp) || '?' == *cp ||
+		    ':' == *cp || '@' == *cp ||
+		    ('$' == *cp && cp + 1 < end && isname(cp[1]))) {
+			for (cp++; cp < end; cp++)
+				if ( ! isname(*cp) && '.' != *cp)
+					break;
+			s->dot = 0;
+			w = word_push(s, WORD_OTHER, st, cp - st);
+		} else if (isname(*cp)) {
+			while (cp < end && isname(*cp))
+				cp++;
+			w = word_name(s, WORD_NAME, st, st, cp - st,
+				st == tok->start && cp == end ? tok->kw :
+				sqlite_schema_keyword(st, cp - st));
+		} else if ('.' == *cp && s->nwords > 0 &&
+		    cp == s->words[s->nwords - 1].end &&
+		    (WORD_NAME == s->words[s->nwords - 1].type ||
+		     WORD_QUOTED == s->words[s->nwords - 1].type)) {
+			s->dot = 1;
+			cp++;
+			if (cp < end && '*' == *cp) {
+				w = &s->words[s->nwords - 1];
+				w->qual = w->name;
+				w->qualsz = w->namesz;
+				w->type = WORD_STAR;
+				w->name = NULL;
+				w->namesz = 0;
+				w->end = ++cp;
+				s->dot = 0;
+			}
+			continue;
+		} else if ('(' == *cp || ')' == *cp || ',' == *cp ||
+		    ';' == *cp) {
+			s->dot = 0;
+			cp++;
+			if (';' == *st) {
+				stmt_end(s);
+				continue;
+			}
+			w = word_push(s, '(' == *st ? WORD_LPAREN :
+				')' == *st ? WORD_RPAREN : WORD_COMMA, st, 1);
+		} else if ('=' == *cp || '*' == *cp) {
+			s->dot = 0;
+			cp++;
+			if ('=' == *st && cp < end && '=' == *cp) {
+				cp++;
+				w = word_push(s, WORD_OTHER, st, 2);
+			} else
+				w = word_push(s, '=' == *st ?
+					WORD_EQ : WORD_STAR, st, 1);
+		} else {
+			s->dot = 0;
+			while (cp < end && ! isname(*cp) &&
+			    NULL == strchr("()[]`,;=*.?:@$", *cp))
+				cp++;
+			if (cp == st)
+				cp++;
+			w = word_push(s, WORD_OTHER, st, cp - st);
+		}
+		stmt_word(s, w);
+	}
+}
+
+/*
+ * Whether the statement keyword "kw" continues the current statement
+ * rather than beginning another, for logs without semicolons.
+ */
+static int
+stmt_continues(const struct scan *s, enum kw kw)
+{
+	enum kw	 prev;
+
+	if (1 == s->nwords || s->depth > 0)
+		return(1);
+	prev = s->words[s->nwords - 2].kw;
+
+	switch (kw) {
+	case (KW_SELECT):
+		if (KW_UNION == prev || KW_ALL == prev ||
+		    KW_EXCEPT == prev || KW_INTERSECT == prev)
+			return(1);
+		return(KW_NONE == s->main ||
+		    (KW_INSERT == s->main && ! s->body));
+	case (KW_UPDATE):
+	case (KW_DELETE):
+		if (KW_ON == prev || KW_DO == prev)
+			return(1);
+		return(KW_NONE == s->main);
+	case (KW_INSERT):
+		return(KW_NONE == s->main);
+	case (KW_WITH):
+		return(0);
+	default:
+		return(1);
+	}
+}
+
+/*
+ * Note a word as it's pushed, ending the statement before it if it
+ * begins another.
+ */
+static void
+stmt_word(struct scan *s, const struct word *w)
+{
+	struct word	 save;
+	enum kw		 kw = w->kw;
+
+	if (WORD_LPAREN == w->type)
+		s->depth++;
+	else if (WORD_RPAREN == w->type && s->depth > 0)
+		s->depth--;
+	if (WORD_NAME != w->type || NULL != w->qual)
+		return;
+
+	switch (kw) {
+	case (KW_SELECT):
+	case (KW_UPDATE):
+	case (KW_DELETE):
+	case (KW_INSERT):
+	case (KW_WITH):
+		if ( ! stmt_continues(s, kw)) {
+			save = *w;
+			s->nwords--;
+			stmt_end(s);
+			s->words[s->nwords++] = save;
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (s->depth > 0)
+		return;
+	if (KW_REPLACE == kw)
+		kw = KW_INSERT;
+	switch (kw) {
+	case (KW_SELECT):
+	case (KW_VALUES):
+	case (KW_DEFAULT):
+		if (KW_INSERT == s->main)
+			s->body = 1;
+		/* FALLTHROUGH */
+	case (KW_UPDATE):
+	case (KW_DELETE):
+	case (KW_INSERT):
+		if (KW_NONE == s->main && KW_VALUES != kw &&
+		    KW_DEFAULT != kw)
+			s->main = kw;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Whether word "w" names "name" of size "sz".
+ */
+static int
+word_is(const struct word *w, const char *name, size_t sz)
+{
+
+	return(w->namesz == sz && 0 == strncasecmp(w->name, name, sz));
+}
+
+/*
+ * Look up a table by name, trying it in lower case if not found as is.
+ */
+static const struct tab *
+scan_tab(struct scan *s, const struct word *w)
+{
+	const struct tab *tab;
+	size_t		  i;
+
+	if (w->namesz + 1 > s->bufsz) {
+		s->bufsz = w->namesz + 1;
+		if (NULL == (s->buf = realloc(s->buf, s->bufsz)))
+			err(EXIT_FAILURE, "realloc");
+	}
+	memcpy(s->buf, w->name, w->namesz);
+	s->buf[w->namesz] = '\0';
+	if (NULL != (tab = sqlite_schema_tab(s->p, s->buf)))
+		return(tab);
+	for (i = 0; i < w->namesz; i++)
+		s->buf[i] = tolower((unsigned char)s->buf[i]);
+	if (0 == strncmp(s->buf, w->name, w->namesz))
+		return(NULL);
+	return(sqlite_schema_tab(s->p, s->buf));
+}
+
+static const struct col *
+scan_col(const struct scan *s, const struct tab *tab, const struct word *w)
+{
+	const struct col *col;
+	const char	 *name;
+
+	COL_FOREACH(col, s->p, tab) {
+		name = SCHEMA_STR(s->p, col->name);
+		if (word_is(w, name, strlen(name)))
+			return(col);
+	}
+	return(NULL);
+}
+
+/*
+ * Reference the table named by word "i", if any, and its alias.
+ * Returns the word after them.
+ */
+static size_t
+ref_add(struct scan *s, size_t i, int write)
+{
+	const struct tab *tab;
+	struct word	*w;
+	struct ref	*r;
+
+	if (i >= s->nwords)
+		return(i);
+	w = &s->words[i];
+	if ((WORD_NAME != w->type || KW_NONE != w->kw) &&
+	    WORD_QUOTED != w->type)
+		return(i);
+	w->used = 1;
+	if (NULL == (tab = scan_tab(s, w)))
+		return(i + 1);
+
+	if (s->nrefs == s->refsz) {
+		s->refsz = 0 == s->refsz ? 8 : s->refsz * 2;
+		s->refs = reallocarray(s->refs,
+			s->refsz, sizeof(struct ref));
+		if (NULL == s->refs)
+			err(EXIT_FAILURE, "reallocarray");
+	}
+	r = &s->refs[s->nrefs++];
+	memset(r, 0, sizeof(struct ref));
+	r->tab = tab;
+	r->write = write;
+
+	if (++i < s->nwords && KW_AS == s->words[i].kw)
+		i++;
+	if (i < s->nwords && NULL == s->words[i].qual &&
+	    ((WORD_NAME == s->words[i].type &&
+	      KW_NONE == s->words[i].kw) ||
+	     WORD_QUOTED == s->words[i].type)) {
+		s->words[i].used = 1;
+		r->alias = &s->words[i++];
+	}
+	return(i);
+}
+
+/*
+ * Mark the columns assigned to in the "set" clause beginning at word
+ * "i" as written by reference "ref".
+ */
+static void
+ref_set(struct scan *s, size_t i, size_t ref)
+{
+	size_t	 depth = 0;
+
+	for ( ; i < s->nwords; i++) {
+		if (WORD_LPAREN == s->words[i].type)
+			depth++;
+		else if (WORD_RPAREN == s->words[i].type && 0 == depth--)
+			break;
+		if (0 != depth)
+			continue;
+		if (KW_WHERE == s->words[i].kw ||
+		    KW_FROM == s->words[i].kw ||
+		    KW_RETURNING == s->words[i].kw)
+			break;
+		if (i + 1 < s->nwords &&
+		    WORD_EQ == s->words[i + 1].type &&
+		    (WORD_NAME == s->words[i].type ||
+		     WORD_QUOTED == s->words[i].type)) {
+			s->words[i].write = 1;
+			s->words[i].ref = ref;
+		}
+	}
+}
+
+/*
+ * Find the tables of the statement and their aliases.
+ */
+static void
+stmt_refs(struct scan *s)
+{
+	size_t	 i, j, target = SIZE_MAX;
+	enum kw	 kw, prev;
+
+	for (i = 0; i < s->nwords; i++) {
+		kw = NULL == s->words[i].qual ? s->words[i].kw : KW_NONE;
+		prev = i > 0 ? s->words[i - 1].kw : KW_NONE;
+		switch (kw) {
+		case (KW_FROM):
+			if (KW_DELETE == prev) {
+				target = s->nrefs;
+				ref_add(s, i + 1, 1);
+				break;
+			}
+			for (j = i + 1; ; j++) {
+				j = ref_add(s, j, 0);
+				if (j >= s->nwords ||
+				    WORD_COMMA != s->words[j].type)
+					break;
+			}
+			break;
+		case (KW_JOIN):
+			ref_add(s, i + 1, 0);
+			break;
+		case (KW_INTO):
+			target = s->nrefs;
+			j = ref_add(s, i + 1, 1);
+			if (target == s->nrefs)
+				break;
+			if (j >= s->nwords ||
+			    WORD_LPAREN != s->words[j].type) {
+				s->refs[target].allcols = 1;
+				break;
+			}
+			for (j++; j < s->nwords; j++) {
+				if (WORD_RPAREN == s->words[j].type)
+					break;
+				s->words[j].write = 1;
+				s->words[j].ref = target;
+			}
+			break;
+		case (KW_UPDATE):
+			if (KW_ON == prev || KW_DO == prev)
+				break;
+			j = i + 1;
+			if (j < s->nwords && KW_OR == s->words[j].kw)
+				j += 2;
+			target = s->nrefs;
+			ref_add(s, j, 1);
+			break;
+		case (KW_SET):
+			if (SIZE_MAX != target && target < s->nrefs)
+				ref_set(s, i + 1, target);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/*
+ * Count a read or write of entry "n" once per statement.
+ */
+static void
+scan_count(struct scan *s, size_t n, int write)
+{
+
+	if (write && s->wseen[n] != s->nstmts) {
+		s->wseen[n] = s->nstmts;
+		s->writes[n]++;
+	} else if ( ! write && s->rseen[n] != s->nstmts) {
+		s->rseen[n] = s->nstmts;
+		s->reads[n]++;
+	}
+}
+
+static void
+scan_cols(struct scan *s, const struct tab *tab, int write)
+{
+	const struct col *col;
+
+	COL_FOREACH(col, s->p, tab)
+		scan_count(s, s->a->colbase[tab->idx] + col->idx, write);
+}
+
+/*
+ * Whether reference "r" is that qualifying word "w", by its alias or
+ * table name.
+ */
+static int
+ref_is(const struct scan *s, const struct ref *r, const struct word *w)
+{
+	const char	*name = SCHEMA_STR(s->p, r->tab->name);
+
+	if (NULL != r->alias)
+		return(r->alias->namesz == w->qualsz &&
+		    0 == strncasecmp(r->alias->name, w->qual, w->qualsz));
+	return(strlen(name) == w->qualsz &&
+	    0 == strncasecmp(name, w->qual, w->qualsz));
+}
+
+/*
+ * Resolve the columns of the statement, qualified by a table name or
+ * alias, or else in the first table having them.
+ */
+static void
+stmt_cols(struct scan *s)
+{
+	const struct word *w, *prev;
+	const struct col *col;
+	const struct ref *r;
+	size_t		 i, j;
+
+	for (i = 0; i < s->nwords; i++) {
+		w = &s->words[i];
+		prev = i > 0 ? &s->words[i - 1] : NULL;
+		if (WORD_STAR == w->type) {
+			if (NULL == w->qual && (NULL == prev ||
+			    (KW_SELECT != prev->kw &&
+			     KW_DISTINCT != prev->kw &&
+			     KW_ALL != prev->kw)))
+				continue;
+		} else if ((WORD_NAME != w->type &&
+		    WORD_QUOTED != w->type) || w->used ||
+		    (WORD_NAME == w->type && KW_NONE != w->kw) ||
+		    (i + 1 < s->nwords &&
+		     WORD_LPAREN == s->words[i + 1].type))
+			continue;
+
+		for (j = 0; j < s->nrefs; j++) {
+			r = &s->refs[j];
+			if (w->write && j != w->ref)
+				continue;
+			if (NULL != w->qual && ! ref_is(s, r, w))
+				continue;
+			if (WORD_STAR == w->type) {
+				if ( ! r->write || NULL != w->qual)
+					scan_cols(s, r->tab, 0);
+				continue;
+			}
+			if (NULL == (col = scan_col(s, r->tab, w)))
+				continue;
+			scan_count(s, s->a->colbase[r->tab->idx] +
+				col->idx, w->write);
+			break;
+		}
+	}
+}
+
+/*
+ * End the current statement, counting its reads and writes.
+ */
+static void
+stmt_end(struct scan *s)
+{
+	size_t	 i;
+
+	if (0 == s->nwords)
+		return;
+
+	if (KW_NONE != s->main) {
+		s->nstmts++;
+		stmt_refs(s);
+		for (i = 0; i < s->nrefs; i++) {
+			scan_count(s, s->refs[i].tab->idx,
+				s->refs[i].write);
+			if (s->refs[i].allcols)
+				scan_cols(s, s->refs[i].tab, 1);
+		}
+		stmt_cols(s);
+	}
+
+	s->nwords = s->nrefs = s->depth = 0;
+	s->main = KW_NONE;
+	s->body = s->dot = 0;
+}
+
+static void *
+scan_run(void *arg)
+{
+	struct scan	*s = arg;
+	struct sqltok	 tok;
+	uint64_t	 start = sqlite_schema_trace_now();
+
+	while (sqlite_schema_token(&s->lp, &tok))
+		scan_token(s, &tok);
+	stmt_end(s);
+	sqlite_schema_trace("access", "scan", s->lp.fname, start);
+	return(NULL);
+}
+
+/*
+ * Run scan_run() on threads other than the caller's, named as such in
+ * the trace.
+ */
+static void *
+scan_thread(void *arg)
+{
+
+	sqlite_schema_trace_thread("log");
+	return(scan_run(arg));
+}
+
+/*
+ * Find where a part of the log beginning at or after "off" may start:
+ * the beginning of a line after one ending with a semicolon, or one
+ * beginning with a statement.
+ * Returns "end" if there's none before it.
+ */
+static size_t
+scan_split(const char *map, size_t off, size_t end)
+{
+	const char	*cp, *nl;
+	size_t		 i, sz;
+
+	while (off < end) {
+		if (NULL == (nl = memchr(map + off, '\n', end - off)))
+			return(end);
+		for (cp = nl; cp > map + off &&
+		     isspace((unsigned char)cp[-1]); cp--)
+			continue;
+		off = nl - map + 1;
+		if (cp > map && ';' == cp[-1])
+			return(off);
+		for (i = off; i < end && ' ' == map[i]; i++)
+			continue;
+		for (sz = 0; i + sz < end &&
+		     isalpha((unsigned char)map[i + sz]); sz++)
+			continue;
+		switch (sqlite_schema_keyword(map + i, sz)) {
+		case (KW_SELECT):
+		case (KW_INSERT):
+		case (KW_UPDATE):
+		case (KW_DELETE):
+		case (KW_REPLACE):
+		case (KW_WITH):
+			return(off);
+		default:
+			break;
+		}
+	}
+	return(end);
+}
+
+/*
+ * Scan the statements of the query log "fname" for the tables and
+ * columns they read and write, adding to those already counted in "a".
+ * The log is split among "jobs" threads (or as many as processors, if
+ * zero), each with its own counts, then summed.
+ * Return zero on failure and non-zero on success.
+ */
+int
+sqlite_schema_access(const struct parse *p, const char *fname,
+	size_t jobs, struct access *a)
+{
+	const struct tab *tab;
+	struct scan	*scans;
+	pthread_t	*threads;
+	struct stat	 st;
+	char		*map;
+	size_t		*bounds, i, j, n;
+	long		 ncpu;
+	int		 fd, c, rc = 1;
+	uint64_t	 start;
+
+	if (NULL == a->colbase) {
+		a->colbase = calloc(p->ntab + 1, sizeof(size_t));
+		if (NULL == a->colbase)
+			err(EXIT_FAILURE, "calloc");
+		a->nents = p->ntab;
+		TAB_FOREACH(tab, p, i) {
+			a->colbase[tab->idx] = a->nents;
+			a->nents += tab->ncol;
+		}
+		a->reads = calloc(a->nents + 1, sizeof(uint64_t));
+		a->writes = calloc(a->nents + 1, sizeof(uint64_t));
+		if (NULL == a->reads || NULL == a->writes)
+			err(EXIT_FAILURE, "calloc");
+	}
+
+	if (-1 == (fd = open(fname, O_RDONLY, 0))) {
+		warn("%s", fname);
+		return(0);
+	} else if (-1 == fstat(fd, &st)) {
+		warn("%s", fname);
+		close(fd);
+		return(0);
+	} else if (0 == st.st_size) {
+		close(fd);
+		return(1);
+	}
+
+	/* Private, as the tokeniser cleans up comments in place. */
+
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE, fd, 0);
+	if (MAP_FAILED == map) {
+		warn("%s", fname);
+		close(fd);
+		return(0);
+	}
+
+	if (0 == (n = jobs)) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		n = ncpu > 0 ? ncpu : 1;
+	}
+	if (n > (size_t)st.st_size / CHUNKMIN + 1)
+		n = (size_t)st.st_size / CHUNKMIN + 1;
+
+	scans = calloc(n, sizeof(struct scan));
+	threads = calloc(n, sizeof(pthread_t));
+	bounds = calloc(n + 1, sizeof(size_t));
+	if (NULL == scans || NULL == threads || NULL == bounds)
+		err(EXIT_FAILURE, "calloc");
+
+	bounds[n] = st.st_size;
+	for (i = 1; i < n; i++) {
+		bounds[i] = (size_t)st.st_size / n * i;
+		if (bounds[i] < bounds[i - 1])
+			bounds[i] = bounds[i - 1];
+		bounds[i] = scan_split(map, bounds[i], bounds[n]);
+	}
+
+	for (i = 0; i < n; i++) {
+		scans[i].p = p;
+		scans[i].a = a;
+		scans[i].lp.map = map + bounds[i];
+		scans[i].lp.len = bounds[i + 1] - bounds[i];
+		scans[i].lp.fname = fname;
+		scans[i].reads = calloc(a->nents + 1, sizeof(uint64_t));
+		scans[i].writes = calloc(a->nents + 1, sizeof(uint64_t));
+		scans[i].rseen = calloc(a->nents + 1, sizeof(size_t));
+		scans[i].wseen = calloc(a->nents + 1, sizeof(size_t));
+		if (NULL == scans[i].reads || NULL == scans[i].writes ||
+		    NULL == scans[i].rseen || NULL == scans[i].wseen)
+			err(EXIT_FAILURE, "calloc");
+	}
+
+	for (i = 1; i < n; i++)
+		if (0 != (c = pthread_create(&threads[i],
+		    NULL, scan_thread, &scans[i])))
+			errx(EXIT_FAILURE, "pthread_create: %s",
+				strerror(c));
+	scan_run(&scans[0]);
+	start = sqlite_schema_trace_now();
+	for (i = 1; i < n; i++)
+		pthread_join(threads[i], NULL);
+	sqlite_schema_trace("wait", "join", NULL, start);
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < a->nents; j++) {
+			a->reads[j] += scans[i].reads[j];
+			a->writes[j] += scans[i].writes[j];
+		}
+		a->nstmts += scans[i].nstmts;
+		free(scans[i].reads);
+		free(scans[i].writes);
+		free(scans[i].rseen);
+		free(scans[i].wseen);
+		free(scans[i].words);
+		free(scans[i].refs);
+		free(scans[i].buf);
+	}
+
+	free(scans);
+	free(threads);
+	free(bounds);
+	if (-1 == munmap(map, st.st_size)) {
+		warn("%s", fname);
+		rc = 0;
+	}
+	close(fd);
+	return(rc);
+}
+
+void
+sqlite_schema_access_free(struct access *a)
+{
+
+	free(a->reads);
+	free(a->writes);
+	free(a->colbase);
+	memset(a, 0, sizeof(struct access));
+}
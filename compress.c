@@ -0,0 +1,627 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <ctype.h>
+#include <err.h>
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+# include <pthread.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+# include <zstd.h>
+#endif
+
+#include "extern.h"
+
+enum	zfmt {
+	ZFMT_GZIP,
+	ZFMT_ZSTD
+};
+
+static	const char *const zfmts[] = {
+	"gzip", /* ZFMT_GZIP */
+	"zstd" /* ZFMT_ZSTD */
+};
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+
+#define	ZBUFS	 4 /* decompressed buffers in flight */
+#define	ZBUFSZ	 (256 * 1024) /* size of each */
+#define	ZHEAD	 16 /* room for carrying over a filter's tail */
+#define	ZINSZ	 (64 * 1024) /* compressed read size */
+
+/*
+ * Decompressed buffers are passed from the reader thread to the parser
+ * through a ring: the reader fills bufs[head % ZBUFS] and the parser
+ * empties bufs[tail % ZBUFS].
+ */
+struct	zread {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 cond;
+	char		*bufs[ZBUFS];
+	size_t		 lens[ZBUFS];
+	size_t		 head; /* buffers filled */
+	size_t		 tail; /* buffers emptied */
+	int		 done; /* reader has finished */
+	int		 rc; /* ...and succeeded */
+	int		 stop; /* parser wants no more */
+	enum zfmt	 fmt;
+	int		 fd;
+	const char	*fname;
+	unsigned char	 in[ZINSZ];
+#ifdef HAVE_ZLIB
+	z_stream	 gz;
+	int		 gzend; /* at the end of a member */
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_DStream	*zs;
+	ZSTD_inBuffer	 zin;
+	size_t		 zret; /* zero at the end of a frame */
+#endif
+};
+
+enum	fmode {
+	FMODE_START, /* between statements */
+	FMODE_KEEP, /* within a "create" statement */
+	FMODE_SKIP /* within any other statement */
+};
+
+/*
+ * Reduces the decompressed stream to what the parser needs: comments
+ * and "create" statements are kept verbatim, while other statements
+ * are reduced to their first word, newlines, and semicolon.
+ * This way, line numbers are unchanged.
+ * The output is charged to the memory limit.
+ */
+struct	filter {
+	struct parse	*p;
+	enum fmode	 mode;
+	char		 close; /* ending quote or comment, if within */
+	char		*buf; /* output */
+	size_t		 bufsz;
+	size_t		 bufmax;
+};
+
+/*
+ * Append to the output, dropping the bytes if the parse has failed for
+ * want of memory.
+ */
+static void
+filter_append(struct filter *f, const char *cp, size_t sz)
+{
+	char	*buf;
+	size_t	 max;
+
+	if (f->bufsz + sz > f->bufmax) {
+		for (max = f->bufmax; f->bufsz + sz > max; )
+			max = 0 == max ? ZBUFSZ : max * 2;
+		buf = sqlite_schema_realloc(f->p, f->buf, f->bufmax, max, 1);
+		if (NULL == buf)
+			return;
+		f->buf = buf;
+		f->bufmax = max;
+	}
+	memcpy(f->buf + f->bufsz, cp, sz);
+	f->bufsz += sz;
+}
+
+/*
+ * Pass through the bytes from "cp" to "end" as fits the mode.
+ */
+static void
+filter_emit(struct filter *f, const char *cp, const char *end)
+{
+
+	if (FMODE_SKIP != f->mode) {
+		filter_append(f, cp, end - cp);
+		return;
+	}
+	while (NULL != (cp = memchr(cp, '\n', end - cp))) {
+		filter_append(f, "\n", 1);
+		cp++;
+	}
+}
+
+/*
+ * Filter the bytes from "cp" to "end".
+ * Returns where filtering stopped, which is before "end" only if the
+ * last few bytes can't be classified without the following ones (the
+ * start of a comment or of the first word) and "eof" is not set.
+ */
+static const char *
+filter(struct filter *f, const char *cp, const char *end, int eof)
+{
+	static const unsigned char special[256] = {
+		[';'] = 1, ['\''] = 1, ['"'] = 1, ['`'] = 1,
+		['['] = 1, ['-'] = 1, ['/'] = 1,
+	};
+	const char	*p;
+
+	while (cp < end) {
+		if ('\0' != f->close) {
+			/* Within a quote or comment: jump to its end. */
+			p = memchr(cp, f->close, end - cp);
+			if (NULL == p) {
+				filter_emit(f, cp, end);
+				return(end);
+			} else if ('*' == f->close) {
+				if (p + 1 == end && ! eof) {
+					filter_emit(f, cp, p);
+					return(p);
+				} else if (p + 1 == end || '/' != p[1]) {
+					filter_emit(f, cp, p + 1);
+					cp = p + 1;
+					continue;
+				}
+				p++;
+			}
+			filter_emit(f, cp, p + 1);
+			cp = p + 1;
+			f->close = '\0';
+			continue;
+		}
+
+		if ('-' == *cp || '/' == *cp) {
+			if (cp + 1 == end && ! eof)
+				return(cp);
+			if (cp + 1 < end &&
+			    (('-' == cp[0] && '-' == cp[1]) ||
+			     ('/' == cp[0] && '*' == cp[1]))) {
+				f->close = '-' == cp[0] ? '\n' : '*';
+				filter_emit(f, cp, cp + 2);
+				cp += 2;
+				continue;
+			}
+		}
+
+		if (FMODE_START == f->mode) {
+			if (';' == *cp || isspace((unsigned char)*cp)) {
+				filter_emit(f, cp, cp + 1);
+				cp++;
+				continue;
+			}
+			for (p = cp; p < end && p - cp < 7; p++)
+				if ( ! isalpha((unsigned char)*p))
+					break;
+			if (p == end && p - cp < 7 && ! eof)
+				return(cp);
+			filter_emit(f, cp, p);
+			f->mode = 6 == p - cp &&
+				0 == strncasecmp(cp, "create", 6) ?
+				FMODE_KEEP : FMODE_SKIP;
+			cp = p;
+			continue;
+		}
+
+		for (p = cp; p < end; p++)
+			if (special[(unsigned char)*p])
+				break;
+		if (p > cp) {
+			filter_emit(f, cp, p);
+			cp = p;
+			continue;
+		}
+
+		switch (*cp) {
+		case (';'):
+			filter_append(f, ";", 1);
+			f->mode = FMODE_START;
+			break;
+		case ('['):
+			f->close = ']';
+			filter_emit(f, cp, cp + 1);
+			break;
+		case ('\''):
+		case ('"'):
+		case ('`'):
+			f->close = *cp;
+			/* FALLTHROUGH */
+		default:
+			filter_emit(f, cp, cp + 1);
+			break;
+		}
+		cp++;
+	}
+
+	return(cp);
+}
+
+#ifdef HAVE_ZLIB
+/*
+ * Fill "out" from a gzip stream of one or more members.
+ * Returns -1 on failure, 0 at the end of input, otherwise 1.
+ */
+static int
+gz_read(struct zread *z, char *out, size_t sz, size_t *len)
+{
+	ssize_t	 ssz;
+	int	 c;
+
+	z->gz.next_out = (Bytef *)out;
+	z->gz.avail_out = sz;
+
+	while (z->gz.avail_out > 0) {
+		if (0 == z->gz.avail_in) {
+			if ((ssz = read(z->fd, z->in, sizeof(z->in))) < 0) {
+				warn("%s", z->fname);
+				return(-1);
+			} else if (0 == ssz) {
+				if (z->gzend)
+					break;
+				warnx("%s: truncated gzip stream", z->fname);
+				return(-1);
+			}
+			z->gz.next_in = z->in;
+			z->gz.avail_in = ssz;
+		}
+		if (z->gzend) {
+			inflateReset(&z->gz);
+			z->gzend = 0;
+		}
+		c = inflate(&z->gz, Z_NO_FLUSH);
+		if (Z_STREAM_END == c)
+			z->gzend = 1;
+		else if (Z_OK != c && Z_BUF_ERROR != c) {
+			warnx("%s: %s", z->fname, NULL != z->gz.msg ?
+				z->gz.msg : "bad gzip stream");
+			return(-1);
+		}
+	}
+
+	*len = sz - z->gz.avail_out;
+	return(z->gz.avail_out > 0 ? 0 : 1);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/*
+ * Like gz_read(), but for a zstd stream of one or more frames.
+ */
+static int
+zs_read(struct zread *z, char *out, size_t sz, size_t *len)
+{
+	ZSTD_outBuffer	 o;
+	ssize_t		 ssz;
+	size_t		 c;
+
+	o.dst = out;
+	o.size = sz;
+	o.pos = 0;
+
+	while (o.pos < o.size) {
+		if (z->zin.pos == z->zin.size) {
+			if ((ssz = read(z->fd, z->in, sizeof(z->in))) < 0) {
+				warn("%s", z->fname);
+				return(-1);
+			} else if (0 == ssz) {
+				if (0 == z->zret)
+					break;
+				warnx("%s: truncated zstd stream", z->fname);
+				return(-1);
+			}
+			z->zin.src = z->in;
+			z->zin.size = ssz;
+			z->zin.pos = 0;
+		}
+		c = ZSTD_decompressStream(z->zs, &o, &z->zin);
+		if (ZSTD_isError(c)) {
+			warnx("%s: %s", z->fname, ZSTD_getErrorName(c));
+			return(-1);
+		}
+		z->zret = c;
+	}
+
+	*len = o.pos;
+	return(o.pos < o.size ? 0 : 1);
+}
+#endif
+
+/*
+ * Reader thread: decompress into the ring until the end of input or an
+ * error, waiting whenever the parser is ZBUFS buffers behind.
+ */
+static void *
+zread(void *arg)
+{
+	struct zread	*z = arg;
+	size_t		 len;
+	int		 c;
+	uint64_t	 start;
+
+	sqlite_schema_trace_thread("decompress");
+	for (c = 1; 1 == c; ) {
+		start = sqlite_schema_trace_now();
+		pthread_mutex_lock(&z->mtx);
+		while (z->head - z->tail == ZBUFS && ! z->stop)
+			pthread_cond_wait(&z->cond, &z->mtx);
+		if (z->stop) {
+			z->done = 1;
+			pthread_mutex_unlock(&z->mtx);
+			break;
+		}
+		pthread_mutex_unlock(&z->mtx);
+		sqlite_schema_trace("wait", "ring full", NULL, start);
+
+		start = sqlite_schema_trace_now();
+		len = 0;
+		switch (z->fmt) {
+#ifdef HAVE_ZLIB
+		case (ZFMT_GZIP):
+			c = gz_read(z, z->bufs[z->head % ZBUFS] +
+				ZHEAD, ZBUFSZ, &len);
+			break;
+#endif
+#ifdef HAVE_ZSTD
+		case (ZFMT_ZSTD):
+			c = zs_read(z, z->bufs[z->head % ZBUFS] +
+				ZHEAD, ZBUFSZ, &len);
+			break;
+#endif
+		default:
+			abort();
+		}
+		sqlite_schema_trace("io", "decompress", NULL, start);
+
+		pthread_mutex_lock(&z->mtx);
+		z->lens[z->head % ZBUFS] = len;
+		z->head++;
+		if (1 != c) {
+			z->done = 1;
+			z->rc = 0 == c;
+		}
+		pthread_cond_broadcast(&z->cond);
+		pthread_mutex_unlock(&z->mtx);
+	}
+
+	return(NULL);
+}
+
+/*
+ * Release the decompressor.
+ */
+static void
+zend(struct zread *z)
+{
+
+#ifdef HAVE_ZLIB
+	if (ZFMT_GZIP == z->fmt)
+		inflateEnd(&z->gz);
+#endif
+#ifdef HAVE_ZSTD
+	if (ZFMT_ZSTD == z->fmt)
+		ZSTD_freeDStream(z->zs);
+#endif
+}
+
+/*
+ * Parse the compressed stream "fd", whose first "headsz" bytes (at most
+ * ZINSZ) have already been read into "head".
+ * The ring and the filtered output are charged to the memory limit.
+ */
+static int
+zparse(const char *fname, int fd, enum zfmt fmt,
+	const char *head, size_t headsz, struct parse *p)
+{
+	struct zread	 z;
+	struct filter	 f;
+	pthread_t	 t;
+	char		 carry[ZHEAD];
+	char		*ring;
+	const char	*cp, *rest, *end;
+	size_t		 i, ncarry, total = 0;
+	int		 c, rc, last;
+	uint64_t	 start;
+
+	memset(&z, 0, sizeof(struct zread));
+	memset(&f, 0, sizeof(struct filter));
+	f.p = p;
+	p->fname = fname;
+	p->line = p->col = 0;
+	p->limited = 0;
+	z.fmt = fmt;
+	z.fd = fd;
+	z.fname = fname;
+	if (headsz > 0)
+		memcpy(z.in, head, headsz);
+
+	switch (fmt) {
+#ifdef HAVE_ZLIB
+	case (ZFMT_GZIP):
+		if (Z_OK != inflateInit2(&z.gz, 15 + 16)) {
+			warnx("%s: inflateInit2", fname);
+			return(0);
+		}
+		z.gz.next_in = z.in;
+		z.gz.avail_in = headsz;
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case (ZFMT_ZSTD):
+		if (NULL == (z.zs = ZSTD_createDStream()))
+			err(EXIT_FAILURE, "ZSTD_createDStream");
+		ZSTD_initDStream(z.zs);
+		z.zret = 1;
+		z.zin.src = z.in;
+		z.zin.size = headsz;
+		break;
+#endif
+	default:
+		warnx("%s: %s compression not supported",
+			fname, zfmts[fmt]);
+		return(0);
+	}
+
+	ring = sqlite_schema_realloc(p, NULL, 0, ZBUFS, ZHEAD + ZBUFSZ);
+	if (NULL == ring) {
+		zend(&z);
+		return(0);
+	}
+	for (i = 0; i < ZBUFS; i++)
+		z.bufs[i] = ring + i * (ZHEAD + ZBUFSZ);
+
+	pthread_mutex_init(&z.mtx, NULL);
+	pthread_cond_init(&z.cond, NULL);
+	if (0 != (c = pthread_create(&t, NULL, zread, &z)))
+		errx(EXIT_FAILURE, "pthread_create: %s", strerror(c));
+
+	/*
+	 * Filter each buffer as it's decompressed, prefixing whatever
+	 * bytes the filter couldn't classify at the end of the last.
+	 * The input limit is of the decompressed bytes, as only those
+	 * bound the work: stop the reader when it's exceeded, or when
+	 * the filtered output has run out of memory.
+	 */
+
+	for (ncarry = 0; ; ) {
+		start = sqlite_schema_trace_now();
+		pthread_mutex_lock(&z.mtx);
+		while (z.tail == z.head && ! z.done)
+			pthread_cond_wait(&z.cond, &z.mtx);
+		sqlite_schema_trace("wait", "decompress", NULL, start);
+		if (z.tail == z.head) {
+			pthread_mutex_unlock(&z.mtx);
+			break;
+		}
+		i = z.tail % ZBUFS;
+		last = z.done && z.tail + 1 == z.head;
+		total += z.lens[i];
+		if (NULL != p->lim && 0 != p->lim->bytes &&
+		    total > p->lim->bytes) {
+			warnx("%s: bytes limit of %zu exceeded",
+				fname, p->lim->bytes);
+			z.stop = 1;
+			pthread_cond_broadcast(&z.cond);
+			pthread_mutex_unlock(&z.mtx);
+			break;
+		}
+		pthread_mutex_unlock(&z.mtx);
+
+		cp = z.bufs[i] + ZHEAD - ncarry;
+		end = z.bufs[i] + ZHEAD + z.lens[i];
+		memcpy(z.bufs[i] + ZHEAD - ncarry, carry, ncarry);
+		rest = filter(&f, cp, end, last);
+		ncarry = end - rest;
+		memcpy(carry, rest, ncarry);
+
+		pthread_mutex_lock(&z.mtx);
+		z.tail++;
+		if (p->limited)
+			z.stop = 1;
+		pthread_cond_broadcast(&z.cond);
+		pthread_mutex_unlock(&z.mtx);
+		if (z.stop)
+			break;
+	}
+
+	pthread_join(t, NULL);
+	pthread_cond_destroy(&z.cond);
+	pthread_mutex_destroy(&z.mtx);
+	sqlite_schema_dealloc(p, ring, ZBUFS, ZHEAD + ZBUFSZ);
+	zend(&z);
+
+	rc = z.rc && ! z.stop ? sqlite_schema_parsebuf(fname, f.buf, f.bufsz, p) : 0;
+	sqlite_schema_dealloc(p, f.buf, f.bufmax, 1);
+	return(rc);
+}
+
+#endif
+
+/*
+ * The compression of a stream beginning with the "sz" bytes "magic".
+ * Returns zero if not compressed.
+ */
+static int
+zmagic(const unsigned char *magic, size_t sz, enum zfmt *fmt)
+{
+
+	if (sz >= 2 && 0x1f == magic[0] && 0x8b == magic[1])
+		*fmt = ZFMT_GZIP;
+	else if (sz >= 4 && 0x28 == magic[0] && 0xb5 == magic[1] &&
+		 0x2f == magic[2] && 0xfd == magic[3])
+		*fmt = ZFMT_ZSTD;
+	else
+		return(0);
+	return(1);
+}
+
+/*
+ * Parse the compressed stream "fd" as "fmt", its first "headsz" bytes
+ * having been read into "head".
+ */
+static int
+zparsefmt(const char *fname, int fd, enum zfmt fmt,
+	const char *head, size_t headsz, struct parse *p)
+{
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+	return(zparse(fname, fd, fmt, head, headsz, p));
+#else
+	(void)fd;
+	(void)head;
+	(void)headsz;
+	(void)p;
+	warnx("%s: %s compression not supported", fname, zfmts[fmt]);
+	return(0);
+#endif
+}
+
+/*
+ * If the file is compressed (by its magic), parse it while streaming
+ * it through the decompressor, without keeping the decompressed file
+ * in memory.
+ * Returns -1 if the file is not compressed, otherwise as with
+ * sqlite_schema_parsefd().
+ */
+int
+sqlite_schema_parsez(const char *fname, int fd, struct parse *p)
+{
+	unsigned char	 magic[4];
+	enum zfmt	 fmt;
+
+	if (pread(fd, magic, sizeof(magic), 0) != sizeof(magic) ||
+	    ! zmagic(magic, sizeof(magic), &fmt))
+		return(-1);
+
+	if (-1 == lseek(fd, 0, SEEK_SET)) {
+		warn("%s", fname);
+		return(0);
+	}
+	return(zparsefmt(fname, fd, fmt, NULL, 0, p));
+}
+
+/*
+ * Like sqlite_schema_parsez(), but for a stream that can't be read
+ * twice (like a pipe), whose first "sz" bytes have been read into
+ * "head", at most ZINSZ and at least enough for the magic unless
+ * that's all there is.
+ */
+int
+sqlite_schema_parsezhead(const char *fname, int fd,
+	const char *head, size_t sz, struct parse *p)
+{
+	enum zfmt	 fmt;
+
+	if ( ! zmagic((const unsigned char *)head, sz, &fmt))
+		return(-1);
+	return(zparsefmt(fname, fd, fmt, head, sz, p));
+}
@@ -0,0 +1,441 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <ctype.h>
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+enum	fmt {
+	FMT_TEXT,
+	FMT_JSON,
+	FMT_HTML
+};
+
+enum	change {
+	CHANGE_ADD,
+	CHANGE_DEL,
+	CHANGE_MOD
+};
+
+static	const char *const changes[] = {
+	"added", /* CHANGE_ADD */
+	"removed", /* CHANGE_DEL */
+	"changed", /* CHANGE_MOD */
+};
+
+/*
+ * Column constraints compared between versions.
+ * The COL_INDEXED flag is derived from indices, so isn't included.
+ */
+#define	COL_CONS (COL_PKEY | COL_UNIQUE | COL_NOTNULL | COL_AUTOINC)
+
+#define	TAB_OPTS (TAB_TEMP | TAB_WITHOUT_ROWID | TAB_STRICT)
+
+struct	diff {
+	enum fmt	 fmt;
+	size_t		 n; /* number of changes */
+	const struct parse *op; /* old schema */
+	const struct parse *np; /* new schema */
+};
+
+/*
+ * Put a string as a single text field: white-space (tabs, newlines) is
+ * normalised into a space.
+ */
+static void
+text_putstr(const char *p)
+{
+
+	for ( ; '\0' != *p; p++)
+		putchar(isspace((unsigned char)*p) ? ' ' : *p);
+}
+
+/*
+ * Emit a single change to table "tab" or, if not NULL, its column
+ * "col".
+ * For changed tables and columns, "attr" names the attribute that
+ * changed from "old" to "new", either of which may be NULL if the
+ * attribute isn't set.
+ */
+static void
+emit(struct diff *d, enum change ch, const char *tab,
+	const char *col, const char *attr,
+	const char *old, const char *new)
+{
+
+	switch (d->fmt) {
+	case (FMT_TEXT):
+		printf("%s\t%s\t", NULL == col ?
+			"table" : "column", changes[ch]);
+		text_putstr(tab);
+		if (NULL != col) {
+			putchar('\t');
+			text_putstr(col);
+		}
+		if (CHANGE_MOD == ch) {
+			printf("\t%s\t", attr);
+			text_putstr(NULL == old ? "" : old);
+			putchar('\t');
+			text_putstr(NULL == new ? "" : new);
+		}
+		putchar('\n');
+		break;
+	case (FMT_JSON):
+		printf("%s\t{\"type\": \"%s\", \"change\": \"%s\", "
+			"\"table\": ", d->n > 0 ? ",\n" : "",
+			NULL == col ? "table" : "column", changes[ch]);
+		sqlite_schema_json_puts(stdout, tab);
+		if (NULL != col) {
+			fputs(", \"column\": ", stdout);
+			sqlite_schema_json_puts(stdout, col);
+		}
+		if (CHANGE_MOD == ch) {
+			printf(", \"attr\": \"%s\", \"old\": ", attr);
+			if (NULL != old)
+				sqlite_schema_json_puts(stdout, old);
+			else
+				fputs("null", stdout);
+			fputs(", \"new\": ", stdout);
+			if (NULL != new)
+				sqlite_schema_json_puts(stdout, new);
+			else
+				fputs("null", stdout);
+		}
+		putchar('}');
+		break;
+	case (FMT_HTML):
+		printf("\t<li class=\"%s %s\">",
+			NULL == col ? "table" : "column", changes[ch]);
+		fputs("<span class=\"name\">", stdout);
+		sqlite_schema_html_puts(stdout, tab);
+		if (NULL != col) {
+			putchar('.');
+			sqlite_schema_html_puts(stdout, col);
+		}
+		fputs("</span>", stdout);
+		if (CHANGE_MOD == ch) {
+			printf(" <span class=\"attr\">%s</span>", attr);
+			if (NULL != old) {
+				fputs(" <del>", stdout);
+				sqlite_schema_html_puts(stdout, old);
+				fputs("</del>", stdout);
+			}
+			if (NULL != new) {
+				fputs(" <ins>", stdout);
+				sqlite_schema_html_puts(stdout, new);
+				fputs("</ins>", stdout);
+			}
+		}
+		puts("</li>");
+		break;
+	}
+	d->n++;
+}
+
+/*
+ * Compare two strings, either of which may be NULL.
+ */
+static int
+strsame(const char *a, const char *b)
+{
+
+	if (NULL == a || NULL == b)
+		return(a == b);
+	return(0 == strcmp(a, b));
+}
+
+/*
+ * Put the constraints in "flags" into "buf" as they'd be declared.
+ * Returns NULL if there are none.
+ */
+static const char *
+col_cons(unsigned int flags, char *buf, size_t sz)
+{
+
+	buf[0] = '\0';
+	if (COL_PKEY & flags)
+		strlcat(buf, " primary key", sz);
+	if (COL_AUTOINC & flags)
+		strlcat(buf, " autoincrement", sz);
+	if (COL_UNIQUE & flags)
+		strlcat(buf, " unique", sz);
+	if (COL_NOTNULL & flags)
+		strlcat(buf, " not null", sz);
+	return('\0' == buf[0] ? NULL : buf + 1);
+}
+
+/*
+ * Like col_cons() but for table options.
+ */
+static const char *
+tab_opts(unsigned int flags, char *buf, size_t sz)
+{
+
+	buf[0] = '\0';
+	if (TAB_TEMP & flags)
+		strlcat(buf, " temp", sz);
+	if (TAB_WITHOUT_ROWID & flags)
+		strlcat(buf, " without rowid", sz);
+	if (TAB_STRICT & flags)
+		strlcat(buf, " strict", sz);
+	return('\0' == buf[0] ? NULL : buf + 1);
+}
+
+/*
+ * Put a foreign key reference, if any, into "buf" as "table.column".
+ */
+static const char *
+col_fkey(const struct parse *p, const struct col *col, char *buf,
+	size_t sz)
+{
+
+	if (SCHEMA_NONE == col->fkey)
+		return(NULL);
+	strlcpy(buf, SCHEMA_STR(p, COL_TAB(p, COL_FKEY(p, col))->name), sz);
+	strlcat(buf, ".", sz);
+	strlcat(buf, SCHEMA_STR(p, COL_FKEY(p, col)->name), sz);
+	return(buf);
+}
+
+/*
+ * Put the actions of a foreign key, if any, into "buf", e.g., "on delete
+ * cascade".
+ */
+static const char *
+col_fkacts(const struct parse *p, const struct col *col, char *buf,
+	size_t sz)
+{
+	const struct fkey *fkey;
+
+	buf[0] = '\0';
+	if (SCHEMA_NONE == col->fkey)
+		return(NULL);
+	fkey = COL_FKDECL(p, col);
+	if (FKACT_NONE != fkey->ondelete) {
+		strlcat(buf, " on delete ", sz);
+		strlcat(buf, fkacts[fkey->ondelete], sz);
+	}
+	if (FKACT_NONE != fkey->onupdate) {
+		strlcat(buf, " on update ", sz);
+		strlcat(buf, fkacts[fkey->onupdate], sz);
+	}
+	return('\0' == buf[0] ? NULL : buf + 1);
+}
+
+static void
+diff_col(struct diff *d, const struct col *o, const struct col *n)
+{
+	const struct parse *op = d->op, *np = d->np;
+	char		 ob[1024], nb[1024];
+	const char	*oa, *na, *tab, *col;
+
+	tab = SCHEMA_STR(np, COL_TAB(np, n)->name);
+	col = SCHEMA_STR(np, n->name);
+
+	oa = SCHEMA_OPT(op, o->type);
+	na = SCHEMA_OPT(np, n->type);
+	if ( ! strsame(oa, na))
+		emit(d, CHANGE_MOD, tab, col, "type", oa, na);
+	if ((o->flags & COL_CONS) != (n->flags & COL_CONS))
+		emit(d, CHANGE_MOD, tab, col, "constraints",
+			col_cons(o->flags, ob, sizeof(ob)),
+			col_cons(n->flags, nb, sizeof(nb)));
+	oa = SCHEMA_OPT(op, o->def);
+	na = SCHEMA_OPT(np, n->def);
+	if ( ! strsame(oa, na))
+		emit(d, CHANGE_MOD, tab, col, "default", oa, na);
+
+	if ((SCHEMA_NONE == o->fkey) != (SCHEMA_NONE == n->fkey) ||
+	    (SCHEMA_NONE != o->fkey &&
+	     (strcmp(SCHEMA_STR(op, COL_TAB(op, COL_FKEY(op, o))->name),
+	       SCHEMA_STR(np, COL_TAB(np, COL_FKEY(np, n))->name)) ||
+	      strcmp(SCHEMA_STR(op, COL_FKEY(op, o)->name),
+	       SCHEMA_STR(np, COL_FKEY(np, n)->name)))))
+		emit(d, CHANGE_MOD, tab, col, "references",
+			col_fkey(op, o, ob, sizeof(ob)),
+			col_fkey(np, n, nb, sizeof(nb)));
+
+	oa = col_fkacts(op, o, ob, sizeof(ob));
+	na = col_fkacts(np, n, nb, sizeof(nb));
+	if ( ! strsame(oa, na))
+		emit(d, CHANGE_MOD, tab, col, "actions", oa, na);
+
+	oa = SCHEMA_OPT(op, o->comment);
+	na = SCHEMA_OPT(np, n->comment);
+	if ( ! strsame(oa, na))
+		emit(d, CHANGE_MOD, tab, col, "comment", oa, na);
+}
+
+/*
+ * Both tables' columns are ordered by name, so they're matched by
+ * merging the two lists in linear time.
+ */
+static void
+diff_tab(struct diff *d, const struct tab *o, const struct tab *n)
+{
+	const struct parse *op = d->op, *np = d->np;
+	const struct col *oc, *nc, *oe, *ne;
+	const char	 *oa, *na;
+	char		  ob[64], nb[64];
+	int		  c;
+
+	if ((o->flags & TAB_OPTS) != (n->flags & TAB_OPTS))
+		emit(d, CHANGE_MOD, SCHEMA_STR(np, n->name), NULL,
+			"options", tab_opts(o->flags, ob, sizeof(ob)),
+			tab_opts(n->flags, nb, sizeof(nb)));
+	oa = SCHEMA_OPT(op, o->comment);
+	na = SCHEMA_OPT(np, n->comment);
+	if ( ! strsame(oa, na))
+		emit(d, CHANGE_MOD, SCHEMA_STR(np, n->name), NULL,
+			"comment", oa, na);
+
+	oc = &op->cols[o->firstcol];
+	oe = oc + o->ncol;
+	nc = &np->cols[n->firstcol];
+	ne = nc + n->ncol;
+	while (oc < oe || nc < ne) {
+		if (oc == oe)
+			c = 1;
+		else if (nc == ne)
+			c = -1;
+		else
+			c = strcmp(SCHEMA_STR(op, oc->name),
+				SCHEMA_STR(np, nc->name));
+		if (c < 0) {
+			emit(d, CHANGE_DEL, SCHEMA_STR(op, o->name),
+				SCHEMA_STR(op, oc->name), NULL, NULL, NULL);
+			oc++;
+		} else if (c > 0) {
+			emit(d, CHANGE_ADD, SCHEMA_STR(np, n->name),
+				SCHEMA_STR(np, nc->name), NULL, NULL, NULL);
+			nc++;
+		} else
+			diff_col(d, oc++, nc++);
+	}
+}
+
+/*
+ * Like diff_tab(), but for the tables of both schemas by name.
+ */
+static void
+diff(struct diff *d)
+{
+	const struct parse *op = d->op, *np = d->np;
+	const struct tab *ot, *nt;
+	size_t		  oi = 0, ni = 0;
+	int		  c;
+
+	while (oi < op->ntab || ni < np->ntab) {
+		ot = oi < op->ntab ? &op->tabs[op->byname[oi]] : NULL;
+		nt = ni < np->ntab ? &np->tabs[np->byname[ni]] : NULL;
+		if (NULL == ot)
+			c = 1;
+		else if (NULL == nt)
+			c = -1;
+		else
+			c = strcmp(SCHEMA_STR(op, ot->name),
+				SCHEMA_STR(np, nt->name));
+		if (c < 0) {
+			emit(d, CHANGE_DEL, SCHEMA_STR(op, ot->name),
+				NULL, NULL, NULL, NULL);
+			oi++;
+		} else if (c > 0) {
+			emit(d, CHANGE_ADD, SCHEMA_STR(np, nt->name),
+				NULL, NULL, NULL, NULL);
+			ni++;
+		} else {
+			diff_tab(d, ot, nt);
+			oi++;
+			ni++;
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	int	 	 c, rc = 0;
+	struct parse	 o, n;
+	struct diff	 d;
+	struct limits	 lim;
+
+	memset(&o, 0, sizeof(struct parse));
+	memset(&n, 0, sizeof(struct parse));
+	memset(&d, 0, sizeof(struct diff));
+	memset(&lim, 0, sizeof(struct limits));
+	o.lim = n.lim = &lim;
+	d.op = &o;
+	d.np = &n;
+
+	while (-1 != (c = getopt(argc, argv, "f:vx:")))
+		switch (c) {
+		case ('f'):
+			if (0 == strcmp(optarg, "text"))
+				d.fmt = FMT_TEXT;
+			else if (0 == strcmp(optarg, "json"))
+				d.fmt = FMT_JSON;
+			else if (0 == strcmp(optarg, "html"))
+				d.fmt = FMT_HTML;
+			else
+				goto usage;
+			break;
+		case ('v'):
+			o.verbose = n.verbose = 1;
+			break;
+		case ('x'):
+			if ( ! sqlite_schema_limit(&lim, optarg))
+				return(2);
+			break;
+		default:
+			goto usage;
+		}
+
+	argc -= optind;
+	argv += optind;
+
+	if (2 != argc)
+		goto usage;
+
+	if (sqlite_schema_parsefile(argv[0], &o) > 0 &&
+	    sqlite_schema_parsefile(argv[1], &n) > 0) {
+		if (FMT_JSON == d.fmt)
+			puts("[");
+		else if (FMT_HTML == d.fmt)
+			puts("<ul class=\"diff\">");
+		diff(&d);
+		if (FMT_JSON == d.fmt)
+			fputs(d.n > 0 ? "\n]\n" : "]\n", stdout);
+		else if (FMT_HTML == d.fmt)
+			puts("</ul>");
+		rc = d.n > 0 ? 1 : 0;
+	} else
+		rc = 2;
+
+	sqlite_schema_free(&o);
+	sqlite_schema_free(&n);
+	return(rc);
+
+usage:
+	fprintf(stderr, "usage: %s [-v] [-f text|json|html] "
+		"[-x limit=value] old new\n", getprogname());
+	return(2);
+}
@@ -14,10 +14,14 @@
  * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
-#include <sys/queue.h>
+#include <sys/stat.h>
 
 #include <ctype.h>
 #include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,76 +29,568 @@
 
 #include "extern.h"
 
+enum	mode {
+	MODE_FULL, /* all columns, edges between columns */
+	MODE_KEYS, /* key columns, merged edges between tables */
+	MODE_NAMES /* table names, merged edges between tables */
+};
+
+/*
+ * Columns listed in MODE_KEYS.
+ */
+#define	MODE_KEY(_c) \
+	((COL_PKEY & (_c)->flags) || SCHEMA_NONE != (_c)->fkey)
+
+struct	opts {
+	const struct parse *p;
+	const char	*prefix;
+	const char	*topts; /* table attributes */
+	const char	*fopts; /* header cell attributes */
+	const char	*ropts; /* cell attributes */
+	const char	*uopts; /* unindexed cell attributes */
+	const char	*hopts; /* hub table attributes */
+	size_t		 hubrefs; /* foreign keys making a hub */
+	int		 levels; /* rank tables by load level */
+	unsigned char	*heat; /* by table, zero for none */
+	const struct plans *plans; /* mark plan uses or NULL */
+	unsigned char	*aheat; /* by log access, as in struct access */
+	const size_t	*colbase; /* ...of the columns of each table */
+	enum mode	 mode;
+};
+
 static void
-safe_putstring(const char *p)
+safe_putstring(FILE *f, const char *p)
 {
 
 	for ( ; '\0' != *p; p++)
 		switch (*p) {
 		case ('<'):
-			fputs("&gt;", stdout);
+			fputs("&lt;", f);
 			break;
 		case ('>'):
-			fputs("&lt;", stdout);
+			fputs("&gt;", f);
 			break;
 		case ('"'):
-			fputs("&quot;", stdout);
+			fputs("&quot;", f);
 			break;
 		case ('&'):
-			fputs("&amp;", stdout);
+			fputs("&amp;", f);
 			break;
 		default:
-			putchar(*p);
+			putc(*p, f);
 			break;
 		}
 }
 
+/*
+ * Edge colours by delete action.
+ */
+static	const char *const fkcolours[FKACT__MAX] = {
+	NULL, /* FKACT_NONE */
+	NULL, /* FKACT_RESTRICT */
+	"orange", /* FKACT_SETNULL */
+	"orange", /* FKACT_SETDEFAULT */
+	"red", /* FKACT_CASCADE */
+};
+
+/*
+ * Edges from a single table merged by the table at the other end.
+ * Arrays are by table index; only the "targets" need be reset.
+ */
+struct	merge {
+	uint32_t	*count; /* foreign keys to the table */
+	unsigned char	*dashed; /* any of them unindexed */
+	unsigned char	*ondelete; /* greatest of their delete actions */
+	uint32_t	*targets; /* tables with non-zero count */
+	size_t		 ntargets;
+};
+
+static void
+merge_init(struct merge *m, const struct parse *p)
+{
+
+	m->count = calloc(p->ntab, sizeof(uint32_t));
+	m->dashed = calloc(p->ntab, 1);
+	m->ondelete = calloc(p->ntab, 1);
+	m->targets = calloc(p->ntab, sizeof(uint32_t));
+	if (NULL == m->count || NULL == m->dashed || 
+	    NULL == m->ondelete || NULL == m->targets)
+		err(EXIT_FAILURE, "calloc");
+	m->ntargets = 0;
+}
+
+static void
+merge_free(struct merge *m)
+{
+
+	free(m->count);
+	free(m->dashed);
+	free(m->ondelete);
+	free(m->targets);
+}
+
+/*
+ * Merge the foreign keys of "tab" by their parent table.
+ * Targets are in order of first foreign key.
+ */
 static void
-output(struct parse *p, const char *prefix, const char *topts, 
-	const char *fopts, const char *ropts)
+merge_tab(struct merge *m, const struct parse *p, const struct tab *tab)
 {
-	struct tab	*tab;
-	struct col	*col;
-	char		*cp;
+	const struct col *col;
+	size_t		  i, dst;
 
-	if (NULL == fopts)
-		fopts = ropts;
+	for (i = 0; i < m->ntargets; i++) {
+		m->count[m->targets[i]] = 0;
+		m->dashed[m->targets[i]] = 0;
+		m->ondelete[m->targets[i]] = FKACT_NONE;
+	}
+	m->ntargets = 0;
+
+	COL_FOREACH(col, p, tab) {
+		if (SCHEMA_NONE == col->fkey)
+			continue;
+		dst = COL_FKEY(p, col)->tab;
+		if (0 == m->count[dst]++)
+			m->targets[m->ntargets++] = dst;
+		if (COL_FKEY_UNINDEXED(col))
+			m->dashed[dst] = 1;
+		if (COL_FKDECL(p, col)->ondelete > m->ondelete[dst])
+			m->ondelete[dst] = COL_FKDECL(p, col)->ondelete;
+	}
+}
+
+/*
+ * Choose the most detailed mode whose label rows (tables and listed
+ * columns) and edges fit within the budget, where zero is unlimited.
+ */
+static enum mode
+mode_auto(const struct parse *p, size_t maxrows, size_t maxedges)
+{
+	const struct tab *tab;
+	const struct col *col;
+	struct merge	  m;
+	size_t		  i, rows = 0, keyrows = 0, edges = 0, merged = 0;
 
-	puts("digraph G {");
-	TAILQ_FOREACH(tab, &p->tabq, entry) {
-		printf("\ttable%zu [shape=none; label=<"
-			"<TABLE%s%s>\n",
-		       tab->idx, NULL == topts ? "" : " ",
+	if (0 == maxrows)
+		maxrows = SIZE_MAX;
+	if (0 == maxedges)
+		maxedges = SIZE_MAX;
+
+	merge_init(&m, p);
+	TAB_FOREACH(tab, p, i) {
+		rows += 1 + tab->ncol;
+		keyrows++;
+		COL_FOREACH(col, p, tab) {
+			if (MODE_KEY(col))
+				keyrows++;
+			if (SCHEMA_NONE != col->fkey)
+				edges++;
+		}
+		merge_tab(&m, p, tab);
+		merged += m.ntargets;
+	}
+	merge_free(&m);
+
+	if (rows <= maxrows && edges <= maxedges)
+		return(MODE_FULL);
+	if (keyrows <= maxrows && merged <= maxedges)
+		return(MODE_KEYS);
+	return(MODE_NAMES);
+}
+
+/*
+ * Format the background colour of "heat", if any, as an attribute.
+ */
+static void
+heat_attr(char *buf, size_t sz, unsigned char heat)
+{
+
+	if (0 == heat) {
+		buf[0] = '\0';
+		return;
+	}
+	snprintf(buf, sz, " BGCOLOR=\"#ff%.2x%.2x\"",
+		255 - (heat - 1) * 207 / 254,
+		204 - (heat - 1) * 204 / 254);
+}
+
+/*
+ * Output the node of a table.
+ * Hubs, tables referenced by at least "hubrefs" foreign keys, have
+ * their own table attributes.
+ * Tables with a heat are coloured from pale yellow (least) to red.
+ * Given query plans, fully scanned tables have a red border, and named
+ * indices no plan uses are listed.
+ * Given a query log, the cells of tables and columns are coloured
+ * likewise by how often they're accessed.
+ */
+static void
+output_node(const struct opts *o, FILE *f, const struct tab *tab)
+{
+	const struct parse *p = o->p;
+	const struct col *col;
+	char		 *cp;
+	const struct idx *idx;
+	const char	 *opts, *topts;
+	char		  attrs[48], cattrs[24];
+
+	topts = tab->nrefs >= o->hubrefs ? o->hopts : o->topts;
+
+	attrs[0] = cattrs[0] = '\0';
+	if (NULL != o->heat)
+		heat_attr(attrs, sizeof(attrs), o->heat[tab->idx]);
+	if (NULL != o->aheat)
+		heat_attr(cattrs, sizeof(cattrs), o->aheat[tab->idx]);
+	if (NULL != o->plans && o->plans->scans[tab->idx] > 0)
+		strlcat(attrs, " COLOR=\"red\"", sizeof(attrs));
+
+	if (MODE_FULL == o->mode) {
+		fprintf(f, "\ttable%" PRIu32 " [shape=none; label=<"
+			"<TABLE%s%s%s>\n",
+		       tab->idx, attrs, NULL == topts ? "" : " ",
 		       NULL == topts ? "" : topts);
-		cp = sqlite_schema_id(tab->name, NULL);
-		printf("\t\t\t<TR><TD %s%sHREF=\"#%s-%s\">", 
-			NULL == fopts ? "" : fopts,
-			NULL == fopts ? "" : " ", prefix, cp);
+		cp = sqlite_schema_id(SCHEMA_STR(p, tab->name), NULL);
+		fprintf(f, "\t\t\t<TR><TD %s%sHREF=\"#%s-%s\"%s>", 
+			NULL == o->fopts ? "" : o->fopts,
+			NULL == o->fopts ? "" : " ", o->prefix, cp, cattrs);
 		free(cp);
-		safe_putstring(tab->name);
-		puts("</TD></TR>");
-		TAILQ_FOREACH(col, &tab->colq, entry) {
-			cp = sqlite_schema_id
-				(col->tab->name, col->name);
-			printf("\t\t\t<TR><TD %s%sHREF=\"#%s-%s\" "
-				"PORT=\"f%zu\">", 
-				NULL == ropts ? "" : ropts,
-				NULL == ropts ? "" : " ",
-				prefix, cp, col->idx);
-			free(cp);
-			safe_putstring(col->name);
-			puts("</TD></TR>");
+	} else {
+		cp = sqlite_schema_id(SCHEMA_STR(p, tab->name), NULL);
+		fprintf(f, "\ttable%" PRIu32 " [shape=none; label=<"
+			"<TABLE HREF=\"#%s-%s\"%s%s%s>\n",
+		       tab->idx, o->prefix, cp, attrs,
+		       NULL == topts ? "" : " ",
+		       NULL == topts ? "" : topts);
+		free(cp);
+		fprintf(f, "\t\t\t<TR><TD%s%s%s>", 
+			NULL == o->fopts ? "" : " ",
+			NULL == o->fopts ? "" : o->fopts, cattrs);
+	}
+	safe_putstring(f, SCHEMA_STR(p, tab->name));
+	fputs("</TD></TR>\n", f);
+	COL_FOREACH(col, p, tab) {
+		opts = COL_FKEY_UNINDEXED(col) ? o->uopts : o->ropts;
+		if (MODE_NAMES == o->mode ||
+		    (MODE_KEYS == o->mode && ! MODE_KEY(col)))
+			continue;
+		if (NULL != o->aheat)
+			heat_attr(cattrs, sizeof(cattrs), 
+				o->aheat[o->colbase[tab->idx] + col->idx]);
+		if (MODE_KEYS == o->mode) {
+			fprintf(f, "\t\t\t<TR><TD%s%s%s>", 
+				NULL == opts ? "" : " ",
+				NULL == opts ? "" : opts, cattrs);
+			safe_putstring(f, SCHEMA_STR(p, col->name));
+			fputs("</TD></TR>\n", f);
+			continue;
 		}
-		puts("\t\t</TABLE>>];");
-		TAILQ_FOREACH(col, &tab->colq, entry) {
-			if (NULL == col->fkey)
+		cp = sqlite_schema_id(SCHEMA_STR(p, tab->name), 
+			SCHEMA_STR(p, col->name));
+		fprintf(f, "\t\t\t<TR><TD %s%sHREF=\"#%s-%s\" "
+			"PORT=\"f%" PRIu32 "\"%s>", 
+			NULL == opts ? "" : opts,
+			NULL == opts ? "" : " ",
+			o->prefix, cp, col->idx, cattrs);
+		free(cp);
+		safe_putstring(f, SCHEMA_STR(p, col->name));
+		fputs("</TD></TR>\n", f);
+	}
+
+	/* Named indices unused by any query plan. */
+
+	if (NULL != o->plans && MODE_NAMES != o->mode)
+		IDX_FOREACH(idx, p, tab) {
+			if (0 == idx->name || o->plans->uses[idx->idx])
 				continue;
-			printf("\ttable%zu:f%zu -> table%zu:f%zu;\n",
-				col->tab->idx, col->idx,
-				col->fkey->tab->idx, col->fkey->idx);
+			fprintf(f, "\t\t\t<TR><TD%s%s><I>",
+				NULL == o->uopts ? "" : " ",
+				NULL == o->uopts ? "" : o->uopts);
+			safe_putstring(f, SCHEMA_STR(p, idx->name));
+			fputs(" (unused)</I></TD></TR>\n", f);
+		}
+	fputs("\t\t</TABLE>>];\n", f);
+}
+
+/*
+ * Output the attributes of an edge for "count" foreign keys, weighted
+ * and labelled if more than one, dashed if any are unindexed, and
+ * coloured by the greatest of their delete actions.
+ */
+static void
+output_edgeattrs(FILE *f, uint32_t count, int dashed, enum fkact ondelete)
+{
+	const char	*sep = " [";
+
+	if (count > 1) {
+		fprintf(f, "%sweight=%" PRIu32 "; label=\"%" PRIu32 "\"",
+			sep, count, count);
+		sep = "; ";
+	}
+	if (dashed) {
+		fprintf(f, "%sstyle=dashed", sep);
+		sep = "; ";
+	}
+	if (NULL != fkcolours[ondelete]) {
+		fprintf(f, "%scolor=%s", sep, fkcolours[ondelete]);
+		sep = "; ";
+	}
+	fputs(';' == *sep ? "];\n" : ";\n", f);
+}
+
+/*
+ * Output the edges of a table's foreign keys.
+ * If "dist" is not NULL, only to tables it has reached.
+ */
+static void
+output_edges(const struct opts *o, FILE *f, const struct tab *tab,
+	struct merge *m, const uint32_t *dist)
+{
+	const struct parse *p = o->p;
+	const struct col *col, *fcol;
+	size_t		  i;
+	uint32_t	  dst;
+
+	if (MODE_FULL != o->mode) {
+		merge_tab(m, p, tab);
+		for (i = 0; i < m->ntargets; i++) {
+			dst = m->targets[i];
+			if (NULL != dist && UINT32_MAX == dist[dst])
+				continue;
+			fprintf(f, "\ttable%" PRIu32 " -> table%" PRIu32,
+				tab->idx, dst);
+			output_edgeattrs(f, m->count[dst], 
+				m->dashed[dst], m->ondelete[dst]);
+		}
+		return;
+	}
+
+	COL_FOREACH(col, p, tab) {
+		if (SCHEMA_NONE == col->fkey)
+			continue;
+		fcol = COL_FKEY(p, col);
+		if (NULL != dist && UINT32_MAX == dist[fcol->tab])
+			continue;
+		fprintf(f, "\ttable%" PRIu32 ":f%" PRIu32 
+			" -> table%" PRIu32 ":f%" PRIu32,
+			col->tab, col->idx, fcol->tab, fcol->idx);
+		output_edgeattrs(f, 1, COL_FKEY_UNINDEXED(col),
+			COL_FKDECL(p, col)->ondelete);
+	}
+}
+
+/*
+ * Rank the tables of each load level together, so that each level is
+ * laid out in its own row.
+ */
+static void
+output_levels(FILE *f, const struct parse *p)
+{
+	struct graph	  g;
+	struct scc	  s;
+	uint32_t	 *tabs;
+	size_t		 *off, i, j;
+
+	sqlite_schema_graph(p, &g);
+	sqlite_schema_scc(&g, &s);
+	tabs = calloc(p->ntab + 1, sizeof(uint32_t));
+	off = calloc(p->ntab + 2, sizeof(size_t));
+	if (NULL == tabs || NULL == off)
+		err(EXIT_FAILURE, "calloc");
+
+	sqlite_schema_scc_tabs(p, &s, 1, tabs, off);
+	for (i = 0; i < s.nlevel; i++) {
+		fputs("\t{rank=same;", f);
+		for (j = off[i]; j < off[i + 1]; j++)
+			fprintf(f, " table%" PRIu32 ";", tabs[j]);
+		fputs("}\n", f);
+	}
+
+	free(tabs);
+	free(off);
+	sqlite_schema_scc_free(&s);
+	sqlite_schema_graph_free(&g);
+}
+
+static void
+output(const struct opts *o, FILE *f, const struct parse *p)
+{
+	const struct tab *tab;
+	struct merge	  m;
+	size_t		  i;
+	uint64_t	  start;
+
+	merge_init(&m, p);
+	fputs("digraph G {\n", f);
+	TAB_FOREACH(tab, p, i) {
+		start = sqlite_schema_trace_now();
+		output_node(o, f, tab);
+		output_edges(o, f, tab, &m, NULL);
+		sqlite_schema_trace("render", "table", 
+			SCHEMA_STR(p, tab->name), start);
+	}
+	if (o->levels)
+		output_levels(f, p);
+	fputs("}\n", f);
+	merge_free(&m);
+}
+
+/*
+ * Write a graph for each table to "dir", with the tables within "hops"
+ * foreign keys in either direction and the edges between them.
+ * The search only touches the neighbourhood, so the cost is that of the
+ * output.
+ */
+static void
+output_hoods(const struct opts *o, const struct parse *p, 
+	const char *dir, size_t hops)
+{
+	const struct tab *tab, *ntab;
+	struct graph	  g;
+	struct bfs	  b;
+	struct merge	  m;
+	struct ofile	  of;
+	size_t		  i, j;
+	char		 *cp, *path;
+	FILE		 *f;
+	uint64_t	  start;
+
+	if (-1 == mkdir(dir, 0755) && EEXIST != errno)
+		err(EXIT_FAILURE, "%s", dir);
+
+	sqlite_schema_graph(p, &g);
+	sqlite_schema_bfs_init(&g, &b);
+	merge_init(&m, p);
+
+	TAB_FOREACH(tab, p, j) {
+		start = sqlite_schema_trace_now();
+		cp = sqlite_schema_id(SCHEMA_STR(p, tab->name), NULL);
+		if (-1 == asprintf(&path, "%s/%s-%s.dot", 
+		    dir, o->prefix, cp))
+			err(EXIT_FAILURE, "asprintf");
+		free(cp);
+		f = sqlite_schema_fopen(&of, path);
+		free(path);
+
+		sqlite_schema_bfs(&g, &b, tab->idx, 
+			GRAPH_FWD | GRAPH_REV, hops);
+		fputs("digraph G {\n", f);
+		for (i = 0; i < b.nqueue; i++) {
+			ntab = &p->tabs[b.queue[i]];
+			output_node(o, f, ntab);
+			output_edges(o, f, ntab, &m, b.dist);
 		}
+		fputs("}\n", f);
+		sqlite_schema_fclose(&of);
+		sqlite_schema_trace("render", "neighbourhood",
+			SCHEMA_STR(p, tab->name), start);
 	}
-	puts("}");
+
+	merge_free(&m);
+	sqlite_schema_bfs_free(&b);
+	sqlite_schema_graph_free(&g);
+}
+
+/*
+ * Heat entries "from" to "to" by their "bits" (one plus the bit length
+ * of their values) on a logarithmic scale from one (least) to 255
+ * (most) of them.
+ * Those with no bits have no heat.
+ */
+static void
+heat_scale(const unsigned int *bits, unsigned char *heat,
+	size_t from, size_t to)
+{
+	unsigned int	 minbits = UINT_MAX, maxbits = 0;
+	size_t		 i;
+
+	for (i = from; i < to; i++) {
+		if (0 == bits[i])
+			continue;
+		if (bits[i] > maxbits)
+			maxbits = bits[i];
+		if (bits[i] < minbits)
+			minbits = bits[i];
+	}
+	for (i = from; i < to; i++)
+		if (bits[i] > 0)
+			heat[i] = maxbits == minbits ? 1 : 1 + 
+				(bits[i] - minbits) * 254 / 
+				(maxbits - minbits);
+}
+
+static unsigned int
+heat_bits(uint64_t v)
+{
+	unsigned int	 bits;
+
+	for (bits = 1; v > 0; v >>= 1)
+		bits++;
+	return(bits);
+}
+
+/*
+ * Heat each table by its volume, in bytes if any have them or else
+ * rows.
+ * Tables without statistics have none.
+ */
+static unsigned char *
+heat_init(const struct parse *p, const struct stats *st)
+{
+	const struct tab *tab;
+	const struct statent *ent;
+	unsigned char	 *heat;
+	unsigned int	  flag = STAT_ROWS;
+	unsigned int	 *bits;
+	size_t		  i;
+
+	heat = calloc(p->ntab + 1, 1);
+	bits = calloc(p->ntab + 1, sizeof(unsigned int));
+	if (NULL == heat || NULL == bits)
+		err(EXIT_FAILURE, "calloc");
+
+	TAB_FOREACH(tab, p, i)
+		if (NULL != (ent = sqlite_schema_stats_get(st, 
+		    SCHEMA_STR(p, tab->name))) &&
+		    (STAT_BYTES & ent->flags))
+			flag = STAT_BYTES;
+
+	TAB_FOREACH(tab, p, i) {
+		ent = sqlite_schema_stats_get(st, SCHEMA_STR(p, tab->name));
+		if (NULL == ent || ! (flag & ent->flags))
+			continue;
+		bits[tab->idx] = heat_bits
+			(STAT_BYTES == flag ? ent->bytes : ent->rows);
+	}
+
+	heat_scale(bits, heat, 0, p->ntab);
+	free(bits);
+	return(heat);
+}
+
+/*
+ * Heat each table and column by how many statements of the query log
+ * access it, tables and columns each on their own scale.
+ * Those not accessed have none.
+ */
+static unsigned char *
+heat_access(const struct parse *p, const struct access *a)
+{
+	unsigned char	 *heat;
+	unsigned int	 *bits;
+	uint64_t	  v;
+	size_t		  i;
+
+	heat = calloc(a->nents + 1, 1);
+	bits = calloc(a->nents + 1, sizeof(unsigned int));
+	if (NULL == heat || NULL == bits)
+		err(EXIT_FAILURE, "calloc");
+	for (i = 0; i < a->nents; i++)
+		if ((v = a->reads[i] + a->writes[i]) > 0)
+			bits[i] = heat_bits(v);
+	heat_scale(bits, heat, 0, p->ntab);
+	heat_scale(bits, heat, p->ntab, a->nents);
+	free(bits);
+	return(heat);
 }
 
 static int
@@ -122,24 +618,105 @@ append(char **val, const char *cp)
 int
 main(int argc, char *argv[])
 {
-	int	 	 rc, c;
-	char		*topts, *fopts, *ropts;
+	int	 	 rc, c, automode = 1, fp = 0;
+	char		*topts, *fopts, *ropts, *uopts, *hopts;
 	struct parse	 p;
-	const char	*prefix;
+	struct opts	 o;
+	struct ofile	 of;
+	struct stats	 stats;
+	struct plans	 plans;
+	struct access	 access;
+	struct limits	 lim;
+	const char	*er, *dir = NULL, *out = NULL, *plan = NULL,
+			*log = NULL, *trace = NULL;
+	size_t		 maxrows = 0, maxedges = 0, hops = 1, jobs = 0;
 
 	memset(&p, 0, sizeof(struct parse));
-	topts = ropts = fopts = NULL;
-	prefix = "sql";
+	memset(&o, 0, sizeof(struct opts));
+	memset(&stats, 0, sizeof(struct stats));
+	memset(&plans, 0, sizeof(struct plans));
+	memset(&access, 0, sizeof(struct access));
+	memset(&lim, 0, sizeof(struct limits));
+	p.lim = &lim;
+	topts = ropts = fopts = uopts = hopts = NULL;
+	o.p = &p;
+	o.prefix = "sql";
+	o.hubrefs = 5;
+	o.mode = MODE_FULL;
 
-	while (-1 != (c = getopt(argc, argv, "h:c:t:p:v"))) 
+	while (-1 != (c = getopt(argc, argv, "a:b:d:E:e:FH:h:c:j:K:k:Lm:n:o:T:t:p:u:vx:z:"))) 
 		switch (c) {
+		case ('b'):
+			maxrows = strtonum(optarg, 0, INT_MAX, &er);
+			if (NULL != er)
+				errx(EXIT_FAILURE, "-b %s: %s", optarg, er);
+			break;
+		case ('d'):
+			dir = optarg;
+			break;
+		case ('a'):
+			log = optarg;
+			break;
+		case ('E'):
+			plan = optarg;
+			break;
+		case ('e'):
+			maxedges = strtonum(optarg, 0, INT_MAX, &er);
+			if (NULL != er)
+				errx(EXIT_FAILURE, "-e %s: %s", optarg, er);
+			break;
+		case ('F'):
+			fp = 1;
+			break;
+		case ('j'):
+			jobs = strtonum(optarg, 1, INT_MAX, &er);
+			if (NULL != er)
+				errx(EXIT_FAILURE, "-j %s: %s", optarg, er);
+			break;
+		case ('K'):
+			p.snapshot = optarg;
+			break;
+		case ('k'):
+			hops = strtonum(optarg, 1, INT_MAX, &er);
+			if (NULL != er)
+				errx(EXIT_FAILURE, "-k %s: %s", optarg, er);
+			break;
+		case ('L'):
+			o.levels = 1;
+			break;
+		case ('m'):
+			automode = 0;
+			if (0 == strcmp(optarg, "full"))
+				o.mode = MODE_FULL;
+			else if (0 == strcmp(optarg, "keys"))
+				o.mode = MODE_KEYS;
+			else if (0 == strcmp(optarg, "names"))
+				o.mode = MODE_NAMES;
+			else
+				goto usage;
+			break;
+		case ('n'):
+			o.hubrefs = strtonum(optarg, 1, INT_MAX, &er);
+			if (NULL != er)
+				errx(EXIT_FAILURE, "-n %s: %s", optarg, er);
+			break;
+		case ('o'):
+			out = optarg;
+			break;
 		case ('p'):
-			prefix = optarg;
+			o.prefix = optarg;
+			break;
+		case ('T'):
+			trace = optarg;
 			break;
 		case ('t'):
 			if ( ! append(&topts, optarg))
 				warnx("-%c %s: ignoring", c, optarg);
 			break;
+		case ('H'):
+			if ( ! append(&hopts, optarg)) 
+				warnx("-%c %s: ignoring", c, optarg);
+			break;
 		case ('h'):
 			if ( ! append(&fopts, optarg)) 
 				warnx("-%c %s: ignoring", c, optarg);
@@ -148,9 +725,21 @@ main(int argc, char *argv[])
 			if ( ! append(&ropts, optarg))
 				warnx("-%c %s: ignoring", c, optarg);
 			break;
+		case ('u'):
+			if ( ! append(&uopts, optarg))
+				warnx("-%c %s: ignoring", c, optarg);
+			break;
 		case ('v'):
 			p.verbose = 1;
 			break;
+		case ('x'):
+			if ( ! sqlite_schema_limit(&lim, optarg))
+				return(EXIT_FAILURE);
+			break;
+		case ('z'):
+			if ( ! sqlite_schema_stats(&stats, optarg))
+				return(EXIT_FAILURE);
+			break;
 		default:
 			goto usage;
 		}
@@ -158,22 +747,85 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
+	o.topts = topts;
+	o.ropts = ropts;
+	o.fopts = NULL == fopts ? ropts : fopts;
+	o.uopts = NULL == uopts ? ropts : uopts;
+	o.hopts = NULL == hopts ? topts : hopts;
+
+	if (NULL != trace && ! sqlite_schema_trace_open(trace))
+		return(EXIT_FAILURE);
+
 	if (0 == argc)
 		rc = sqlite_schema_parsestdin(&p);
 	else 
 		rc = sqlite_schema_parsefile(argv[0], &p);
 
-	if (rc > 0)
-		output(&p, prefix, topts, fopts, ropts);
+	if (rc > 0 && stats.nents > 0)
+		o.heat = heat_init(&p, &stats);
+	if (rc > 0 && NULL != plan) {
+		if ( ! sqlite_schema_plans(&p, plan, &plans))
+			rc = 0;
+		o.plans = &plans;
+	}
+	if (rc > 0 && NULL != log) {
+		if ( ! sqlite_schema_access(&p, log, jobs, &access))
+			rc = 0;
+		o.aheat = heat_access(&p, &access);
+		o.colbase = access.colbase;
+	}
+
+	if (rc > 0 && fp) {
+		sqlite_schema_fingerprint_print(stdout, &p);
+	} else if (rc > 0 && NULL != dir) {
+		output_hoods(&o, &p, dir, hops);
+	} else if (rc > 0) {
+		if (automode)
+			o.mode = mode_auto(&p, maxrows, maxedges);
+		if (NULL != out) {
+			output(&o, sqlite_schema_fopen(&of, out), &p);
+			sqlite_schema_fclose(&of);
+		} else
+			output(&o, stdout, &p);
+	}
 
 	sqlite_schema_free(&p);
+	sqlite_schema_stats_free(&stats);
+	sqlite_schema_plans_free(&plans);
+	sqlite_schema_access_free(&access);
+	free(o.heat);
+	free(o.aheat);
+	free(topts);
+	free(fopts);
+	free(ropts);
+	free(uopts);
+	free(hopts);
+	if ( ! sqlite_schema_trace_close())
+		rc = 0;
 	return(rc ? EXIT_SUCCESS : EXIT_FAILURE);
 
 usage:
-	fprintf(stderr, "usage: %s [-v] "
+	fprintf(stderr, "usage: %s [-FLv] "
+		"[-a log] "
+		"[-b rows] "
 		"[-c attrs] "
+		"[-d dir] "
+		"[-E plans] "
+		"[-e edges] "
+		"[-H attrs] "
 		"[-h attrs] "
+		"[-j jobs] "
+		"[-K snapshot] "
+		"[-k hops] "
+		"[-m mode] "
+		"[-n refs] "
+		"[-o file] "
+		"[-p prefix] "
+		"[-T trace] "
 		"[-t attrs] "
+		"[-u attrs] "
+		"[-x limit=value] "
+		"[-z stats] "
 		"file\n", getprogname());
 	return(EXIT_FAILURE);
 }
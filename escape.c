@@ -0,0 +1,90 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "extern.h"
+
+/*
+ * Put a single character into an HTML stream.
+ * Beyond the usual, this also normalises spaces into white-space.
+ */
+void
+sqlite_schema_html_putc(FILE *f, char c)
+{
+
+	switch (c) {
+	case ('<'):
+		fputs("&lt;", f);
+		break;
+	case ('>'):
+		fputs("&gt;", f);
+		break;
+	case ('"'):
+		fputs("&quot;", f);
+		break;
+	case ('&'):
+		fputs("&amp;", f);
+		break;
+	default:
+		putc(isspace((unsigned char)c) ? ' ' : c, f);
+		break;
+	}
+}
+
+/*
+ * Safely put a buffer of characters into an HTML stream.
+ */
+void
+sqlite_schema_html_putbuf(FILE *f, const char *p, size_t sz)
+{
+	size_t	 i;
+
+	for (i = 0; i < sz; i++)
+		sqlite_schema_html_putc(f, p[i]);
+}
+
+/*
+ * See sqlite_schema_html_putbuf().
+ */
+void
+sqlite_schema_html_puts(FILE *f, const char *p)
+{
+
+	sqlite_schema_html_putbuf(f, p, strlen(p));
+}
+
+/*
+ * Put a string into a JSON stream as a quoted string.
+ * Control characters are escaped by their code.
+ */
+void
+sqlite_schema_json_puts(FILE *f, const char *p)
+{
+
+	putc('"', f);
+	for ( ; '\0' != *p; p++)
+		if ('"' == *p || '\\' == *p)
+			fprintf(f, "\\%c", *p);
+		else if ((unsigned char)*p < 0x20)
+			fprintf(f, "\\u%.4x", (unsigned char)*p);
+		else
+			putc(*p, f);
+	putc('"', f);
+}
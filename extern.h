@@ -17,40 +17,450 @@
 #ifndef EXTERN_H
 #define EXTERN_H
 
+/*
+ * The schema is kept in flat arrays of the parse: tables, columns,
+ * indices, index columns, and foreign keys refer to one another by
+ * their index in those arrays, and to their strings by offset in
+ * "strs", zero being none.
+ */
+#define	SCHEMA_NONE	 UINT32_MAX /* no index */
+#define	SCHEMA_STR(_p, _off)	((_p)->strs + (_off)) /* "" if zero */
+#define	SCHEMA_OPT(_p, _off) \
+	(0 == (_off) ? NULL : SCHEMA_STR(_p, _off)) /* NULL if zero */
+
+#define	COL_PKEY	 0x01 /* part of the primary key */
+#define	COL_UNIQUE	 0x02 /* column-level unique constraint */
+#define	COL_INDEXED	 0x04 /* leading column of an index */
+#define	COL_NOTNULL	 0x08 /* "not null" constraint */
+#define	COL_AUTOINC	 0x10 /* "autoincrement" */
+
+/*
+ * A column, grouped by table and sorted by name once resolved.
+ * The columns referencing it are "nrefs" of the parse's "refs" from
+ * "firstref", in table and column order.
+ */
 struct	col {
-	char		*name;
-	char		*comment;
-	struct tab	*tab;
-	size_t		 idx;
-	struct col	*fkey;
-	TAILQ_ENTRY(col) entry;
+	uint32_t	 name;
+	uint32_t	 comment;
+	uint32_t	 type; /* declared type or zero */
+	uint32_t	 def; /* default value or zero */
+	uint32_t	 tab; /* SCHEMA_NONE if dropped */
+	uint32_t	 idx; /* in order of declaration */
+	uint32_t	 fkey; /* referenced column or SCHEMA_NONE */
+	uint32_t	 fkdecl; /* declaration of "fkey" */
+	uint32_t	 firstref;
+	uint32_t	 nrefs;
+	unsigned int	 flags;
 };
 
-TAILQ_HEAD(colq, col);
+/*
+ * A column within an index.
+ * If "name" is zero, this is the expression "expr".
+ * The "col" is filled in when the index is resolved.
+ */
+struct	idxcol {
+	uint32_t	 name;
+	uint32_t	 expr; /* if "name" is zero */
+	uint32_t	 col; /* or SCHEMA_NONE */
+};
+
+#define	IDX_UNIQUE	 0x01 /* unique index */
+#define	IDX_PKEY	 0x02 /* primary key */
+#define	IDX_AUTO	 0x04 /* implied by a table or column constraint */
+#define	IDX_PARTIAL	 0x08 /* has a "where" clause */
+#define	IDX_IF_NOT_EXIST 0x10
+#define	IDX_DROPPED	 0x20 /* while parsing */
+
+/*
+ * An index, grouped by table once resolved, those implied by
+ * constraints first; indices on unknown tables follow all others.
+ * Its columns are "ncols" of the parse's "idxcols" from "firstcol".
+ */
+struct	idx {
+	uint32_t	 name; /* zero if IDX_AUTO */
+	uint32_t	 comment;
+	uint32_t	 rtab;
+	uint32_t	 tab; /* SCHEMA_NONE until resolved */
+	uint32_t	 firstcol;
+	uint32_t	 ncols;
+	uint32_t	 where; /* if IDX_PARTIAL */
+	uint32_t	 idx; /* position in the parse */
+	unsigned int	 flags;
+};
 
 #define	TAB_TEMP	 0x01
 #define	TAB_IF_NOT_EXIST 0x02
+#define	TAB_WITHOUT_ROWID 0x04
+#define	TAB_STRICT	 0x08
+#define	TAB_DROPPED	 0x10 /* while parsing */
 
+/*
+ * A table, at its declaration order "idx" in the parse.
+ * Once resolved, its columns are "ncol" of the parse's from
+ * "firstcol" and its indices "nidx" from "firstidx".
+ */
 struct	tab {
-	char		*name;
-	char		*comment;
-	size_t		 ncol;
+	uint32_t	 name;
+	uint32_t	 comment;
+	uint32_t	 firstcol;
+	uint32_t	 ncol;
+	uint32_t	 firstidx;
+	uint32_t	 nidx;
+	uint32_t	 nrefs; /* foreign keys referencing columns */
+	uint32_t	 idx;
 	unsigned int	 flags;
-	size_t		 idx;
-	struct colq	 colq;
-	TAILQ_ENTRY(tab) entry;
 };
 
-TAILQ_HEAD(tabq, tab);
+/*
+ * Iterate over the columns or indices of a table, or over the tables
+ * of a resolved parse by name, counting with "_i".
+ */
+#define	COL_FOREACH(_c, _p, _t) \
+	for ((_c) = &(_p)->cols[(_t)->firstcol]; \
+	     (_c) < &(_p)->cols[(_t)->firstcol + (_t)->ncol]; (_c)++)
+#define	IDX_FOREACH(_x, _p, _t) \
+	for ((_x) = &(_p)->idxs[(_t)->firstidx]; \
+	     (_x) < &(_p)->idxs[(_t)->firstidx + (_t)->nidx]; (_x)++)
+#define	TAB_FOREACH(_t, _p, _i) \
+	for ((_i) = 0; (_i) < (_p)->ntab && \
+	     ((_t) = &(_p)->tabs[(_p)->byname[(_i)]], 1); (_i)++)
+
+/*
+ * The table, referenced column, or foreign key declaration of a
+ * column; and the column of an index column.
+ */
+#define	COL_TAB(_p, _c)		(&(_p)->tabs[(_c)->tab])
+#define	COL_FKEY(_p, _c)	(&(_p)->cols[(_c)->fkey])
+#define	COL_FKDECL(_p, _c)	(&(_p)->fkeys[(_c)->fkdecl])
+#define	IDXCOL(_p, _x, _i)	(&(_p)->idxcols[(_x)->firstcol + (_i)])
+
+/*
+ * A foreign key column without an index in which it is the leading
+ * column: updates and deletes on the parent must scan the child.
+ */
+#define	COL_FKEY_UNINDEXED(_c) \
+	(SCHEMA_NONE != (_c)->fkey && 0 == ((_c)->flags & COL_INDEXED))
+
+/*
+ * Foreign key actions on deleting or updating the parent.
+ */
+enum	fkact {
+	FKACT_NONE, /* no action (the default) */
+	FKACT_RESTRICT,
+	FKACT_SETNULL,
+	FKACT_SETDEFAULT,
+	FKACT_CASCADE,
+	FKACT__MAX
+};
 
+/*
+ * A foreign key as declared by the column "col", in the order parsed.
+ */
 struct	fkey {
-	struct col	*col;
-	char		*rtab;
-	char		*rcol;
-	TAILQ_ENTRY(fkey) entry;
+	uint32_t	 col;
+	uint32_t	 rtab;
+	uint32_t	 rcol;
+	enum fkact	 ondelete;
+	enum fkact	 onupdate;
+};
+
+enum	affinity {
+	AFF_INTEGER,
+	AFF_TEXT,
+	AFF_BLOB,
+	AFF_REAL,
+	AFF_NUMERIC,
+	AFF__MAX
+};
+
+enum	overflow {
+	OVERFLOW_NONE, /* rows fit in a page */
+	OVERFLOW_POSSIBLE, /* unbounded text or blob columns */
+	OVERFLOW_LIKELY /* estimated row exceeds the page */
+};
+
+/*
+ * Estimated storage of a table's rows.
+ * All sizes are in bytes.
+ */
+struct	storage {
+	size_t		 hdr; /* record header */
+	size_t		 payload; /* record header and body */
+	size_t		 cell; /* b-tree cell including the key */
+	size_t		 maxlocal; /* payload before overflow */
+	size_t		 rows; /* rows per leaf page */
+	size_t		 unbounded; /* columns without length */
+	enum overflow	 overflow;
+};
+
+/*
+ * A foreign key edge in the table graph: "col" is the referencing
+ * (child) column and "tab" the index of the table at the other end.
+ */
+struct	gedge {
+	uint32_t	 col;
+	uint32_t	 tab;
+};
+
+/*
+ * Foreign key graph over tables by their index.
+ * The forward (child to parent) edges of table "i" are edges[fwd[i]]
+ * up to edges[fwd[i + 1]]; the reverse (parent to child) edges are
+ * indexed likewise by "rev", but offset by "nedge".
+ */
+struct	graph {
+	size_t		 ntab;
+	size_t		 nedge;
+	uint32_t	*fwd;
+	uint32_t	*rev;
+	struct gedge	*edges;
 };
 
-TAILQ_HEAD(fkeyq, fkey);
+#define	GRAPH_FWD	 0x01 /* follow child to parent */
+#define	GRAPH_REV	 0x02 /* follow parent to child */
+
+/*
+ * State of a breadth-first search over the graph.
+ * Unvisited tables have a "dist" of UINT32_MAX.
+ */
+struct	bfs {
+	uint32_t	*queue;
+	size_t		 nqueue;
+	uint32_t	*dist;
+	const struct gedge **via;
+};
+
+/*
+ * A table touched by deleting or updating rows of another, reached by
+ * the foreign key of the column "via" with action "act" (on delete if
+ * "ondelete", else on update) after "depth" of them.
+ * Rows of the table of "via" are deleted if "del", else their "via" is
+ * set.
+ */
+struct	cascent {
+	uint32_t	 via;
+	enum fkact	 act;
+	size_t		 depth;
+	int		 ondelete;
+	int		 del;
+};
+
+/*
+ * Tables touched by a cascade in breadth-first order, each deletion
+ * of a table and update of a column at most once.
+ */
+struct	cascade {
+	const struct parse *p;
+	struct cascent	*ents;
+	size_t		 nents;
+	unsigned char	*seen; /* tables, then columns by position */
+};
+
+#define	STAT_ROWS	 0x01 /* "rows" known */
+#define	STAT_PAGES	 0x02 /* "pages" known */
+#define	STAT_BYTES	 0x04 /* "bytes" known */
+#define	STAT_ROWSIDX	 0x08 /* "rows" only from an index */
+#define	STAT_CELLS	 0x10 /* "cells" known */
+
+/*
+ * Statistics of a table or index from sqlite_stat1 or dbstat.
+ */
+struct	statent {
+	char		*name;
+	uint64_t	 rows;
+	uint64_t	 pages;
+	uint64_t	 bytes;
+	uint64_t	 cells; /* in leaf pages */
+	unsigned int	 flags;
+};
+
+/*
+ * Statistics by name in an open-addressed hash table.
+ */
+struct	stats {
+	struct statent	*ents;
+	size_t		 entsz;
+	size_t		 nents;
+};
+
+/*
+ * Uses of tables and indices in captured query plans.
+ */
+struct	plans {
+	size_t		*scans; /* by table */
+	size_t		*searches; /* by table */
+	size_t		*uses; /* by index */
+	size_t		 nlines; /* plan lines read */
+};
+
+/*
+ * Reads and writes of tables and columns by the statements of a query
+ * log: tables by their index, and columns of a table from its "colbase"
+ * in the order of declaration.
+ */
+struct	access {
+	uint64_t	*reads;
+	uint64_t	*writes;
+	size_t		*colbase; /* by table */
+	size_t		 nents; /* tables and columns */
+	size_t		 nstmts; /* statements read */
+};
+
+/*
+ * Functions called with "arg" as tables are parsed, in source order.
+ * Any may be NULL.
+ * Foreign keys and "create index" statements are resolved only once
+ * the parse is complete, so columns don't yet have their "fkey".
+ * If "stream" is set, each table is discarded after "tab_end", which
+ * gets it with sorted columns and resolved table constraints; nothing
+ * is resolved at the end of the parse.
+ * The parse's arrays grow as it goes, so what's passed may only be
+ * kept by its index.
+ */
+struct	parsecb {
+	void		(*tab_begin)(void *, const struct parse *, const struct tab *);
+	void		(*col)(void *, const struct parse *, const struct col *);
+	void		(*fkey)(void *, const struct parse *, const struct fkey *);
+	void		(*tab_end)(void *, const struct parse *, const struct tab *);
+	void		 *arg;
+	int		  stream;
+};
+
+/*
+ * An output file, written beside "path" and renamed over it when
+ * closed, unless the contents are unchanged.
+ */
+struct	ofile {
+	FILE		*f;
+	char		*path;
+	char		*tmp;
+};
+
+/*
+ * Strongly connected components of the graph's forward edges.
+ * Components are numbered parents first, and "level" is the length of
+ * the longest chain of foreign keys from a component to those without
+ * any: all tables of a level may be loaded once earlier levels are.
+ * Arrays "level" and "cyclic" are by component.
+ */
+struct	scc {
+	uint32_t	*comp; /* component of each table */
+	uint32_t	*level; /* load level */
+	unsigned char	*cyclic; /* tables within reference each other */
+	size_t		 ncomp;
+	size_t		 nlevel;
+};
+
+/*
+ * Keywords, as classified by sqlite_schema_keyword().
+ * Punctuation is only classified when read as a token.
+ */
+enum	kw {
+	KW_NONE = 0, /* not a keyword */
+	KW_LPAREN, /* ( */
+	KW_RPAREN, /* ) */
+	KW_COMMA, /* , */
+	KW_SEMI, /* ; */
+	KW_ACTION,
+	KW_ADD,
+	KW_ALL,
+	KW_ALTER,
+	KW_AS,
+	KW_ASC,
+	KW_AUTOINCREMENT,
+	KW_CASCADE,
+	KW_CHECK,
+	KW_COLLATE,
+	KW_COLUMN,
+	KW_CONSTRAINT,
+	KW_CREATE,
+	KW_CROSS,
+	KW_DEFAULT,
+	KW_DELETE,
+	KW_DESC,
+	KW_DISTINCT,
+	KW_DO,
+	KW_DROP,
+	KW_EXCEPT,
+	KW_EXISTS,
+	KW_FOREIGN,
+	KW_FROM,
+	KW_FULL,
+	KW_GENERATED,
+	KW_GROUP,
+	KW_HAVING,
+	KW_IF,
+	KW_INDEX,
+	KW_INDEXED,
+	KW_INNER,
+	KW_INSERT,
+	KW_INTERSECT,
+	KW_INTO,
+	KW_JOIN,
+	KW_KEY,
+	KW_LEFT,
+	KW_LIMIT,
+	KW_NATURAL,
+	KW_NO,
+	KW_NOT,
+	KW_NULL,
+	KW_ON,
+	KW_OR,
+	KW_ORDER,
+	KW_OUTER,
+	KW_PRIMARY,
+	KW_REFERENCES,
+	KW_RENAME,
+	KW_REPLACE,
+	KW_RESTRICT,
+	KW_RETURNING,
+	KW_RIGHT,
+	KW_ROWID,
+	KW_SELECT,
+	KW_SET,
+	KW_STRICT,
+	KW_TABLE,
+	KW_TEMP,
+	KW_TEMPORARY,
+	KW_TO,
+	KW_UNION,
+	KW_UNIQUE,
+	KW_UPDATE,
+	KW_USING,
+	KW_VALUES,
+	KW_WHERE,
+	KW_WINDOW,
+	KW_WITH,
+	KW_WITHOUT,
+	KW__MAX
+};
+
+/*
+ * A token of a statement read by sqlite_schema_token().
+ * Quoted tokens are without their quotes, "quot" being the quote
+ * character; others are words (possibly with operators) or single
+ * parentheses, commas, and semicolons.
+ */
+struct	sqltok {
+	const char	*start;
+	size_t		 sz;
+	char		 quot; /* quote character or NUL */
+	enum kw		 kw; /* if the whole token is a keyword */
+};
+
+/*
+ * Bounds on a parse, each zero for none.
+ * A parse exceeding any of them fails.
+ */
+struct	limits {
+	size_t		 bytes; /* input, decompressed */
+	size_t		 stmt; /* bytes of a statement */
+	size_t		 depth; /* nested parentheses */
+	size_t		 tabs; /* tables */
+	size_t		 cols; /* columns of a table */
+	size_t		 mem; /* bytes allocated for tables */
+	size_t		 msecs; /* time spent parsing */
+};
 
 struct	parse {
 	char		*map;
@@ -58,22 +468,102 @@ struct	parse {
 	size_t		 len;
 	size_t		 line;
 	size_t		 col;
-	size_t		 ntab;
 	const char	*fname;
-	struct tabq	 tabq;
-	struct fkeyq	 fkeyq;
+	struct tab	*tabs; /* by declaration order */
+	size_t		 ntab;
+	size_t		 tabmax;
+	struct col	*cols; /* by table, then name, once resolved */
+	size_t		 ncol;
+	size_t		 colmax;
+	struct idx	*idxs;
+	size_t		 nidx;
+	size_t		 idxmax;
+	struct idxcol	*idxcols; /* by index */
+	size_t		 nidxcol;
+	size_t		 idxcolmax;
+	struct fkey	*fkeys;
+	size_t		 nfkey;
+	size_t		 fkeymax;
+	char		*strs; /* names, comments, and expressions */
+	size_t		 strsz;
+	size_t		 strmax;
+	uint32_t	*refs; /* referencing columns, once resolved */
+	uint32_t	*byname; /* tables by name, once resolved */
+	uint32_t	*tabhash; /* by name, once resolved */
+	size_t		 tabhashsz;
+	size_t		 mem; /* bytes allocated for the above */
+	const struct parsecb *cb; /* or NULL */
+	const struct limits *lim; /* or NULL */
+	const char	*snapshot; /* of migrations, or NULL */
+	size_t		 stmt; /* start of statement */
+	uint64_t	 deadline; /* of parse in milliseconds */
+	int		 limited; /* a limit was exceeded */
 	int		 verbose;
 };
 
 __BEGIN_DECLS
 
+extern const char *const affinities[AFF__MAX];
+extern const char *const fkacts[FKACT__MAX];
+
+int	 sqlite_schema_access(const struct parse *, const char *, size_t, struct access *);
+void	 sqlite_schema_access_free(struct access *);
+enum affinity
+	 sqlite_schema_affinity(const char *);
+void	 sqlite_schema_bfs(const struct graph *, struct bfs *, size_t, unsigned int, size_t);
+void	 sqlite_schema_bfs_free(struct bfs *);
+void	 sqlite_schema_bfs_init(const struct graph *, struct bfs *);
+size_t	 sqlite_schema_bfs_path(const struct parse *, const struct bfs *, size_t, uint32_t *);
+void	 sqlite_schema_cascade(struct cascade *, const struct tab *, int);
+void	 sqlite_schema_cascade_free(struct cascade *);
+void	 sqlite_schema_cascade_init(const struct parse *, struct cascade *);
+void	 sqlite_schema_dealloc(struct parse *, void *, size_t, size_t);
+void	 sqlite_schema_fabort(struct ofile *);
+int	 sqlite_schema_fclose(struct ofile *);
+int	 sqlite_schema_fclose_warn(struct ofile *);
+uint64_t sqlite_schema_fingerprint(const struct parse *);
+void	 sqlite_schema_fingerprint_print(FILE *, const struct parse *);
+FILE	*sqlite_schema_fopen(struct ofile *, const char *);
+FILE	*sqlite_schema_fopen_warn(struct ofile *, const char *);
 void	 sqlite_schema_free(struct parse *);
+void	 sqlite_schema_graph(const struct parse *, struct graph *);
+void	 sqlite_schema_graph_free(struct graph *);
+void	 sqlite_schema_html_putbuf(FILE *, const char *, size_t);
+void	 sqlite_schema_html_putc(FILE *, char);
+void	 sqlite_schema_html_puts(FILE *, const char *);
 char	*sqlite_schema_id(const char *, const char *);
 char	*sqlite_schema_idbuf(const char *, size_t);
+void	 sqlite_schema_json_puts(FILE *, const char *);
+enum kw	 sqlite_schema_keyword(const char *, size_t);
+int	 sqlite_schema_limit(struct limits *, const char *);
 int	 sqlite_schema_parsebuf(const char *, const char *, size_t, struct parse *);
 int	 sqlite_schema_parsefd(const char *, int, struct parse *);
 int	 sqlite_schema_parsefile(const char *, struct parse *);
 int	 sqlite_schema_parsestdin(struct parse *);
+int	 sqlite_schema_parsez(const char *, int, struct parse *);
+int	 sqlite_schema_parsezhead(const char *, int, const char *, size_t, struct parse *);
+int	 sqlite_schema_plans(const struct parse *, const char *, struct plans *);
+void	 sqlite_schema_plans_free(struct plans *);
+void	*sqlite_schema_realloc(struct parse *, void *, size_t, size_t, size_t);
+void	 sqlite_schema_reset(struct parse *);
+void	 sqlite_schema_scc(const struct graph *, struct scc *);
+void	 sqlite_schema_scc_free(struct scc *);
+void	 sqlite_schema_scc_tabs(const struct parse *, const struct scc *, int, uint32_t *, size_t *);
+void	 sqlite_schema_snapshot(const struct parse *, const char *, const char *);
+char	*sqlite_schema_snapshot_mark(const char *, size_t);
+int	 sqlite_schema_stats(struct stats *, const char *);
+void	 sqlite_schema_stats_free(struct stats *);
+const struct statent
+	*sqlite_schema_stats_get(const struct stats *, const char *);
+void	 sqlite_schema_storage(const struct parse *, const struct tab *, size_t, struct storage *);
+struct tab
+	*sqlite_schema_tab(const struct parse *, const char *);
+int	 sqlite_schema_token(struct parse *, struct sqltok *);
+void	 sqlite_schema_trace(const char *, const char *, const char *, uint64_t);
+int	 sqlite_schema_trace_close(void);
+uint64_t sqlite_schema_trace_now(void);
+int	 sqlite_schema_trace_open(const char *);
+void	 sqlite_schema_trace_thread(const char *);
 
 __END_DECLS
 
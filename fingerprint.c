@@ -0,0 +1,156 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "extern.h"
+
+/*
+ * Structural fingerprints are 64-bit FNV-1a hashes over the resolved
+ * model, so they don't change with whitespace, comment style, keyword
+ * case, or the order of constraints within a definition.
+ * Everything that may show in the output is hashed, including the
+ * declaration order used for graph identifiers.
+ */
+
+#define	FP_INIT	 14695981039346656037ULL
+#define	FP_PRIME 1099511628211ULL
+
+static uint64_t
+fp_bytes(uint64_t h, const void *buf, size_t sz)
+{
+	const unsigned char *cp = buf;
+
+	while (sz-- > 0) {
+		h ^= *cp++;
+		h *= FP_PRIME;
+	}
+	return(h);
+}
+
+/*
+ * Hash a string with its terminator, so adjacent strings can't run
+ * into each other.
+ * NULL is distinguished from the empty string.
+ */
+static uint64_t
+fp_str(uint64_t h, const char *cp)
+{
+
+	if (NULL == cp)
+		return(fp_bytes(h, "\1", 1));
+	return(fp_bytes(h, cp, strlen(cp) + 1));
+}
+
+/*
+ * Hash a number by its bytes from least to most significant, so the
+ * result doesn't depend on the host.
+ */
+static uint64_t
+fp_num(uint64_t h, uint64_t v)
+{
+	unsigned char	 buf[8];
+	size_t		 i;
+
+	for (i = 0; i < sizeof(buf); i++, v >>= 8)
+		buf[i] = v & 0xff;
+	return(fp_bytes(h, buf, sizeof(buf)));
+}
+
+static uint64_t
+fp_tab(const struct parse *p, const struct tab *tab)
+{
+	const struct col *col;
+	const struct idx *idx;
+	const struct idxcol *ic;
+	uint64_t	  h = FP_INIT;
+	size_t		  i;
+
+	h = fp_str(h, SCHEMA_STR(p, tab->name));
+	h = fp_str(h, SCHEMA_OPT(p, tab->comment));
+	h = fp_num(h, tab->flags);
+	h = fp_num(h, tab->idx);
+
+	h = fp_num(h, tab->ncol);
+	COL_FOREACH(col, p, tab) {
+		h = fp_str(h, SCHEMA_STR(p, col->name));
+		h = fp_str(h, SCHEMA_OPT(p, col->comment));
+		h = fp_str(h, SCHEMA_OPT(p, col->type));
+		h = fp_str(h, SCHEMA_OPT(p, col->def));
+		h = fp_num(h, col->idx);
+		h = fp_num(h, col->flags);
+		if (SCHEMA_NONE != col->fkey) {
+			h = fp_str(h, SCHEMA_STR(p, 
+				COL_TAB(p, COL_FKEY(p, col))->name));
+			h = fp_str(h, SCHEMA_STR(p, COL_FKEY(p, col)->name));
+			h = fp_num(h, COL_FKDECL(p, col)->ondelete);
+			h = fp_num(h, COL_FKDECL(p, col)->onupdate);
+		} else
+			h = fp_str(h, NULL);
+	}
+
+	IDX_FOREACH(idx, p, tab) {
+		h = fp_str(h, SCHEMA_OPT(p, idx->name));
+		h = fp_str(h, SCHEMA_OPT(p, idx->comment));
+		h = fp_str(h, SCHEMA_OPT(p, idx->where));
+		h = fp_num(h, idx->flags);
+		h = fp_num(h, idx->ncols);
+		for (i = 0; i < idx->ncols; i++) {
+			ic = IDXCOL(p, idx, i);
+			h = fp_str(h, SCHEMA_OPT(p, ic->name));
+			h = fp_str(h, SCHEMA_OPT(p, ic->expr));
+		}
+	}
+
+	return(h);
+}
+
+/*
+ * The schema's fingerprint is over those of its tables, by name.
+ */
+uint64_t
+sqlite_schema_fingerprint(const struct parse *p)
+{
+	const struct tab *tab;
+	uint64_t	  h = FP_INIT;
+	size_t		  i;
+
+	h = fp_num(h, p->ntab);
+	TAB_FOREACH(tab, p, i)
+		h = fp_num(h, fp_tab(p, tab));
+	return(h);
+}
+
+/*
+ * Print the schema's fingerprint, then that of each table by name
+ * followed by the table's name, one per line.
+ * A table whose fingerprint is unchanged has unchanged output.
+ */
+void
+sqlite_schema_fingerprint_print(FILE *f, const struct parse *p)
+{
+	const struct tab *tab;
+	size_t		  i;
+
+	fprintf(f, "%016" PRIx64 "\n", sqlite_schema_fingerprint(p));
+	TAB_FOREACH(tab, p, i)
+		fprintf(f, "%016" PRIx64 "\t%s\n", 
+			fp_tab(p, tab), SCHEMA_STR(p, tab->name));
+}
@@ -0,0 +1,467 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "extern.h"
+
+/*
+ * Build the foreign key graph over the resolved schema.
+ * Edges are stored in compressed (offset and edge array) form, both
+ * child-to-parent (forward) and parent-to-child (reverse), so the whole
+ * graph is two allocations of O(tables + foreign keys).
+ */
+void
+sqlite_schema_graph(const struct parse *p, struct graph *g)
+{
+	const struct tab *tab;
+	const struct col *col;
+	size_t		  i, nedge;
+	uint32_t	  t, f;
+
+	memset(g, 0, sizeof(struct graph));
+	g->ntab = p->ntab;
+
+	g->fwd = calloc((g->ntab + 1) * 2, sizeof(uint32_t));
+	if (NULL == g->fwd)
+		err(EXIT_FAILURE, "calloc");
+	g->rev = g->fwd + g->ntab + 1;
+
+	/* First count degrees into the offset arrays. */
+
+	nedge = 0;
+	for (i = 0; i < p->ncol; i++)
+		if (SCHEMA_NONE != p->cols[i].fkey) {
+			g->fwd[p->cols[i].tab + 1]++;
+			g->rev[COL_FKEY(p, &p->cols[i])->tab + 1]++;
+			nedge++;
+		}
+
+	for (i = 0; i < g->ntab; i++) {
+		g->fwd[i + 1] += g->fwd[i];
+		g->rev[i + 1] += g->rev[i];
+	}
+
+	g->nedge = nedge;
+	g->edges = calloc(nedge * 2 + 1, sizeof(struct gedge));
+	if (NULL == g->edges)
+		err(EXIT_FAILURE, "calloc");
+
+	/* Now fill in, advancing offsets, then shift them back. */
+
+	TAB_FOREACH(tab, p, i)
+		COL_FOREACH(col, p, tab) {
+			if (SCHEMA_NONE == col->fkey)
+				continue;
+			t = COL_FKEY(p, col)->tab;
+			f = g->fwd[tab->idx]++;
+			g->edges[f].col = col - p->cols;
+			g->edges[f].tab = t;
+			f = nedge + g->rev[t]++;
+			g->edges[f].col = col - p->cols;
+			g->edges[f].tab = tab->idx;
+		}
+
+	for (i = g->ntab; i > 0; i--) {
+		g->fwd[i] = g->fwd[i - 1];
+		g->rev[i] = g->rev[i - 1];
+	}
+	g->fwd[0] = g->rev[0] = 0;
+}
+
+void
+sqlite_schema_graph_free(struct graph *g)
+{
+
+	free(g->fwd);
+	free(g->edges);
+	memset(g, 0, sizeof(struct graph));
+}
+
+void
+sqlite_schema_bfs_init(const struct graph *g, struct bfs *b)
+{
+
+	memset(b, 0, sizeof(struct bfs));
+	b->queue = calloc(g->ntab + 1, sizeof(uint32_t));
+	b->dist = calloc(g->ntab + 1, sizeof(uint32_t));
+	b->via = calloc(g->ntab + 1, sizeof(struct gedge *));
+	if (NULL == b->queue || NULL == b->dist || NULL == b->via)
+		err(EXIT_FAILURE, "calloc");
+	memset(b->dist, 0xff, (g->ntab + 1) * sizeof(uint32_t));
+}
+
+void
+sqlite_schema_bfs_free(struct bfs *b)
+{
+
+	free(b->queue);
+	free(b->dist);
+	free(b->via);
+	memset(b, 0, sizeof(struct bfs));
+}
+
+/*
+ * Breadth-first search from table "src" along forward (GRAPH_FWD),
+ * reverse (GRAPH_REV), or both kinds of edges, to at most "depth"
+ * hops (zero for no limit).
+ * Visited tables are in "queue" in order of distance; "dist" and "via"
+ * give the distance and the edge by which each was first reached.
+ * Only the entries visited by the last search are reset, so repeated
+ * searches cost what they visit, not the size of the schema.
+ */
+void
+sqlite_schema_bfs(const struct graph *g, struct bfs *b, 
+	size_t src, unsigned int flags, size_t depth)
+{
+	size_t		 	 i, head, d;
+	uint32_t		 t, e, end;
+	const struct gedge	*ge;
+
+	for (i = 0; i < b->nqueue; i++) {
+		b->dist[b->queue[i]] = UINT32_MAX;
+		b->via[b->queue[i]] = NULL;
+	}
+
+	b->nqueue = 0;
+	b->queue[b->nqueue++] = src;
+	b->dist[src] = 0;
+
+	for (head = 0; head < b->nqueue; head++) {
+		t = b->queue[head];
+		d = b->dist[t];
+		if (depth > 0 && d == depth)
+			continue;
+		if (GRAPH_FWD & flags)
+			for (e = g->fwd[t], end = g->fwd[t + 1]; 
+			     e < end; e++) {
+				ge = &g->edges[e];
+				if (UINT32_MAX != b->dist[ge->tab])
+					continue;
+				b->dist[ge->tab] = d + 1;
+				b->via[ge->tab] = ge;
+				b->queue[b->nqueue++] = ge->tab;
+			}
+		if (GRAPH_REV & flags)
+			for (e = g->rev[t], end = g->rev[t + 1]; 
+			     e < end; e++) {
+				ge = &g->edges[g->nedge + e];
+				if (UINT32_MAX != b->dist[ge->tab])
+					continue;
+				b->dist[ge->tab] = d + 1;
+				b->via[ge->tab] = ge;
+				b->queue[b->nqueue++] = ge->tab;
+			}
+	}
+}
+
+/*
+ * After a search, fill "path" (of at least dist[dst] entries) with the
+ * foreign key columns joining the source to "dst", in order.
+ * Each column joins its own table to that of its foreign key.
+ * Returns the number of hops or zero if "dst" was not reached (or is
+ * the source).
+ */
+size_t
+sqlite_schema_bfs_path(const struct parse *p, const struct bfs *b, 
+	size_t dst, uint32_t *path)
+{
+	size_t		 	 n, i;
+	const struct col	*col;
+
+	if (UINT32_MAX == b->dist[dst])
+		return(0);
+
+	n = i = b->dist[dst];
+	while (i > 0) {
+		path[--i] = b->via[dst]->col;
+		col = &p->cols[path[i]];
+		/* The far end of the edge from "dst". */
+		dst = col->tab == dst ? COL_FKEY(p, col)->tab : col->tab;
+	}
+	return(n);
+}
+
+/*
+ * Strongly connected components of the forward edges by Tarjan's
+ * algorithm, iteratively so that long chains can't exhaust the stack.
+ * A component is complete only once those of all of its parents are,
+ * so components are numbered parents first: a component's load level
+ * is one more than the highest of its parents', or zero if it has none.
+ * Components of more than one table, or of one referencing itself, are
+ * cyclic.
+ * This is linear in the tables and foreign keys.
+ */
+void
+sqlite_schema_scc(const struct graph *g, struct scc *s)
+{
+	uint32_t	*index, *low, *stack, *calls, *edge;
+	unsigned char	*onstack;
+	size_t		 nstack = 0, ncalls = 0, top, i, j, n = 0;
+	uint32_t	 v, w, x, c, e, lvl;
+
+	memset(s, 0, sizeof(struct scc));
+	s->comp = calloc(g->ntab + 1, sizeof(uint32_t));
+	s->level = calloc(g->ntab + 1, sizeof(uint32_t));
+	s->cyclic = calloc(g->ntab + 1, 1);
+	index = calloc(g->ntab + 1, sizeof(uint32_t));
+	low = calloc(g->ntab + 1, sizeof(uint32_t));
+	stack = calloc(g->ntab + 1, sizeof(uint32_t));
+	calls = calloc(g->ntab + 1, sizeof(uint32_t));
+	edge = calloc(g->ntab + 1, sizeof(uint32_t));
+	onstack = calloc(g->ntab + 1, 1);
+	if (NULL == s->comp || NULL == s->level || NULL == s->cyclic ||
+	    NULL == index || NULL == low || NULL == stack || 
+	    NULL == calls || NULL == edge || NULL == onstack)
+		err(EXIT_FAILURE, "calloc");
+	memset(index, 0xff, (g->ntab + 1) * sizeof(uint32_t));
+
+	for (i = 0; i < g->ntab; i++) {
+		if (UINT32_MAX != index[i])
+			continue;
+
+		/* Visit the root, then descend until back at it. */
+
+		index[i] = low[i] = n++;
+		stack[nstack++] = i;
+		onstack[i] = 1;
+		calls[ncalls] = i;
+		edge[ncalls++] = g->fwd[i];
+
+		while (ncalls > 0) {
+			v = calls[ncalls - 1];
+			if (edge[ncalls - 1] < g->fwd[v + 1]) {
+				w = g->edges[edge[ncalls - 1]++].tab;
+				if (UINT32_MAX == index[w]) {
+					index[w] = low[w] = n++;
+					stack[nstack++] = w;
+					onstack[w] = 1;
+					calls[ncalls] = w;
+					edge[ncalls++] = g->fwd[w];
+				} else if (onstack[w] && index[w] < low[v])
+					low[v] = index[w];
+				continue;
+			}
+
+			ncalls--;
+			if (ncalls > 0 && low[v] < low[calls[ncalls - 1]])
+				low[calls[ncalls - 1]] = low[v];
+			if (low[v] != index[v])
+				continue;
+
+			/* The root of a component: pop and level it. */
+
+			c = s->ncomp++;
+			top = nstack;
+			do {
+				x = stack[--nstack];
+				onstack[x] = 0;
+				s->comp[x] = c;
+			} while (x != v);
+			if (top - nstack > 1)
+				s->cyclic[c] = 1;
+
+			for (lvl = 0, j = nstack; j < top; j++) {
+				x = stack[j];
+				for (e = g->fwd[x]; e < g->fwd[x + 1]; e++) {
+					w = s->comp[g->edges[e].tab];
+					if (w == c && g->edges[e].tab == x)
+						s->cyclic[c] = 1;
+					else if (w != c && s->level[w] >= lvl)
+						lvl = s->level[w] + 1;
+				}
+			}
+			s->level[c] = lvl;
+			if (lvl + 1 > s->nlevel)
+				s->nlevel = lvl + 1;
+		}
+	}
+
+	free(index);
+	free(low);
+	free(stack);
+	free(calls);
+	free(edge);
+	free(onstack);
+}
+
+void
+sqlite_schema_scc_free(struct scc *s)
+{
+
+	free(s->comp);
+	free(s->level);
+	free(s->cyclic);
+	memset(s, 0, sizeof(struct scc));
+}
+
+/*
+ * Order all tables into "tabs", by their index, by component or, if
+ * "bylevel", by load level, and otherwise by name.
+ * The tables of component or level "i" are from off[i] to off[i + 1],
+ * so "off" must have one more than that many entries.
+ * This is a counting sort over the name-ordered tables, so linear.
+ */
+void
+sqlite_schema_scc_tabs(const struct parse *p, const struct scc *s,
+	int bylevel, uint32_t *tabs, size_t *off)
+{
+	const struct tab *tab;
+	size_t		  i, n, key;
+
+	n = bylevel ? s->nlevel : s->ncomp;
+	memset(off, 0, (n + 1) * sizeof(size_t));
+	TAB_FOREACH(tab, p, i) {
+		key = s->comp[tab->idx];
+		if (bylevel)
+			key = s->level[key];
+		off[key + 1]++;
+	}
+	for (i = 0; i < n; i++)
+		off[i + 1] += off[i];
+	TAB_FOREACH(tab, p, i) {
+		key = s->comp[tab->idx];
+		if (bylevel)
+			key = s->level[key];
+		tabs[off[key]++] = tab->idx;
+	}
+	for (i = n; i > 0; i--)
+		off[i] = off[i - 1];
+	off[0] = 0;
+}
+
+/*
+ * The state of a cascade is the deletion of each table, then the update
+ * of each column by its position.
+ */
+void
+sqlite_schema_cascade_init(const struct parse *p, struct cascade *c)
+{
+
+	memset(c, 0, sizeof(struct cascade));
+	c->p = p;
+	c->ents = calloc(p->ntab + p->ncol + 1, sizeof(struct cascent));
+	c->seen = calloc(p->ntab + p->ncol + 1, 1);
+	if (NULL == c->ents || NULL == c->seen)
+		err(EXIT_FAILURE, "calloc");
+}
+
+void
+sqlite_schema_cascade_free(struct cascade *c)
+{
+
+	free(c->ents);
+	free(c->seen);
+	memset(c, 0, sizeof(struct cascade));
+}
+
+/*
+ * The state of a cascent: its table deleted or its column updated.
+ */
+static size_t
+cascade_state(const struct cascade *c, const struct col *col, int del)
+{
+
+	return(del ? col->tab : c->p->ntab + (col - c->p->cols));
+}
+
+/*
+ * Queue what happens to the referencing columns of "col" when it's
+ * deleted or updated at "depth": tables deleted by cascading deletes,
+ * columns updated by cascading updates or set to null or default.
+ */
+static void
+cascade_col(struct cascade *c, const struct col *col, 
+	int del, size_t depth)
+{
+	const struct parse *p = c->p;
+	const struct col *ref;
+	struct cascent	 *ent;
+	enum fkact	  act;
+	size_t		  i, state;
+	int		  rdel;
+
+	for (i = 0; i < col->nrefs; i++) {
+		ref = &p->cols[p->refs[col->firstref + i]];
+		act = del ? COL_FKDECL(p, ref)->ondelete : 
+			COL_FKDECL(p, ref)->onupdate;
+		if (FKACT_NONE == act || FKACT_RESTRICT == act)
+			continue;
+		rdel = del && FKACT_CASCADE == act;
+		state = cascade_state(c, ref, rdel);
+		if (c->seen[state])
+			continue;
+		c->seen[state] = 1;
+		ent = &c->ents[c->nents++];
+		ent->via = ref - p->cols;
+		ent->act = act;
+		ent->depth = depth + 1;
+		ent->ondelete = del;
+		ent->del = rdel;
+	}
+}
+
+/*
+ * Find the tables touched by deleting ("del") or updating the keys of
+ * rows of "tab", following foreign key actions breadth-first, so each
+ * table is first reached by its shortest chain of them.
+ * Deletions cascade to the referencing tables' rows; updates, including
+ * setting null or default, cascade to the referencing columns.
+ * Restrict and no action stop the cascade.
+ */
+void
+sqlite_schema_cascade(struct cascade *c, const struct tab *tab, int del)
+{
+	const struct parse *p = c->p;
+	const struct tab *t;
+	const struct col *col;
+	const struct cascent *ent;
+	size_t		  i;
+
+	for (i = 0; i < c->nents; i++) {
+		ent = &c->ents[i];
+		c->seen[cascade_state(c, &p->cols[ent->via], ent->del)] = 0;
+	}
+	c->nents = 0;
+
+	/* The root table is deleted, or all of its columns updated. */
+
+	if (del)
+		c->seen[tab->idx] = 1;
+	else
+		memset(&c->seen[p->ntab + tab->firstcol], 1, tab->ncol);
+	COL_FOREACH(col, p, tab)
+		cascade_col(c, col, del, 0);
+
+	for (i = 0; i < c->nents; i++) {
+		ent = &c->ents[i];
+		if ( ! ent->del) {
+			cascade_col(c, &p->cols[ent->via], 0, ent->depth);
+			continue;
+		}
+		t = COL_TAB(p, &p->cols[ent->via]);
+		COL_FOREACH(col, p, t)
+			cascade_col(c, col, 1, ent->depth);
+	}
+	if (del)
+		c->seen[tab->idx] = 0;
+	else
+		memset(&c->seen[p->ntab + tab->firstcol], 0, tab->ncol);
+}
@@ -14,68 +14,146 @@
  * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
-#include <sys/queue.h>
+#include <sys/stat.h>
 
 #include <ctype.h>
 #include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
 #include "extern.h"
 
 struct	opts {
 	const char	*prefix;
+	size_t		 pagesz; /* for storage estimates */
+	int		 reach; /* show reachable tables */
+	FILE		*f; /* current output */
+	const struct parse *p;
+	char		**pages; /* page of each table or NULL */
+	const char	*page; /* current page or NULL */
+	uint32_t	*fkeys; /* if streaming, by column or SCHEMA_NONE */
+	size_t		 nfkeys;
+	const struct levels *levels; /* show load levels or NULL */
+	struct cascade	*cascade; /* show cascades or NULL */
+	const struct stats *stats; /* show statistics or NULL */
+	const struct plans *plans; /* show plan uses or NULL */
+	const struct access *access; /* show log accesses or NULL */
 };
 
 /*
- * Put a single character into an HTML stream on stdout.
- * Beyond the usual, this also normalises spaces into white-space.
+ * Foreign key graph and its components for showing reachable tables,
+ * with the tables of component "i" from tabs[off[i]] to
+ * tabs[off[i + 1]], the first being its representative.
+ * Component "i" was last listed as reached when seen[i] was "stamp".
  */
-static void
-safe_putchar(char c)
-{
+struct	reach {
+	struct graph	  g;
+	struct scc	  s;
+	uint32_t	 *tabs;
+	size_t		 *off;
+	uint32_t	 *seen;
+	uint32_t	  stamp;
+};
 
-	switch (c) {
-	case ('<'):
-		fputs("&gt;", stdout);
-		break;
-	case ('>'):
-		fputs("&lt;", stdout);
-		break;
-	case ('"'):
-		fputs("&quot;", stdout);
-		break;
-	case ('&'):
-		fputs("&amp;", stdout);
-		break;
-	default:
-		putchar(isspace((int)c) ? ' ' : c);
-		break;
-	}
-}
+/*
+ * Foreign key components for showing load levels and cycles, with the
+ * tables of component "i" from tabs[off[i]] to tabs[off[i + 1]].
+ */
+struct	levels {
+	struct scc	  s;
+	uint32_t	 *tabs;
+	size_t		 *off;
+};
 
 /*
- * Safely put a buffer of characters into an HTML stream to stdout.
+ * A table "idx" of the parse to be sorted by its "name".
  */
-static void
-safe_putbuf(const char *p, size_t sz)
-{
-	size_t	 i;
+struct	tabkey {
+	const char	 *name;
+	uint32_t	  idx;
+};
 
-	for (i = 0; i < sz; i++)
-		safe_putchar(p[i]);
-}
+/*
+ * A template read once for all manifest entries using it: the output
+ * is "head", then the schema, then "tail".
+ * If "buf" is NULL, it couldn't be read.
+ */
+struct	tmpl {
+	char		 *path;
+	char		 *buf;
+	size_t		  headsz;
+	const char	 *tail;
+	size_t		  tailsz;
+};
+
+/*
+ * An entry of the manifest and how it went: negative on failure, zero
+ * if the output was unchanged, positive if written.
+ */
+struct	ment {
+	char		 *input;
+	const struct tmpl *tmpl; /* or NULL */
+	char		 *prefix; /* or NULL */
+	char		 *output;
+	size_t		  line;
+	int		  rc;
+};
+
+/*
+ * Entries of a manifest, taken in turn by the threads of the pool.
+ */
+struct	manifest {
+	const char	 *fname;
+	struct ment	 *ents;
+	size_t		  nents;
+	struct tmpl	 *tmpls;
+	size_t		  ntmpls;
+	pthread_mutex_t	  mtx;
+	size_t		  next; /* next entry to take */
+	const struct opts *opts; /* of all entries */
+	const struct limits *lim; /* of each parse */
+	int		  levels;
+	int		  cascade;
+	int		  verbose;
+};
 
 /*
- * See safe_putbuf().
+ * A search term and the document (table or column, in output order)
+ * containing it.
+ */
+struct	term {
+	char		*term;
+	uint32_t	 doc;
+};
+
+struct	terms {
+	struct term	*terms;
+	size_t		 nterms;
+	size_t		 maxterms;
+};
+
+/*
+ * Open a link to the identifier "id" within table "tab", which may be
+ * NULL if not known.
+ * If the table is on another page, link into that page.
  */
 static void
-safe_putstr(const char *p)
+output_link(const struct opts *opts, const struct tab *tab, const char *id)
 {
+	const char	*page = "";
 
-	safe_putbuf(p, strlen(p));
+	if (NULL != tab && NULL != opts->pages &&
+	    opts->pages[tab->idx] != opts->page)
+		page = opts->pages[tab->idx];
+	fprintf(opts->f, "<a href=\"%s#%s-%s\">", page, opts->prefix, id);
 }
 
 static int
@@ -88,40 +166,42 @@ escaped_streq(const char *op, const char *p, const char *str)
 }
 
 /*
- * Put a comment into the stdout HTML stream.
+ * Put a comment into the HTML stream.
  * This will automatically convert @-references into links.
  */
 static void
 safe_putcomment(const struct opts *opts, const char *p)
 {
 	const char	*op, *link;
-	char		*cp;
+	char		*cp, *name;
 	size_t		 sz, linksz;
+	const struct tab *tab;
+	FILE		*f = opts->f;
 
 	for (op = p; '\0' != *p; ) {
 		if ('\\' == *p) {
 			if (op != p && '\\' == p[-1])
-				safe_putchar(*p);
+				sqlite_schema_html_putc(f, *p);
 			p++;
 			continue;
 		} else if (escaped_streq(op, p, "\n")) {
-			fputs("<p></p>", stdout);
+			fputs("<p></p>", f);
 			p += 1;
 			continue;
 		} else if (escaped_streq(op, p, "``")) {
-			fputs("&#x201c;", stdout);
+			fputs("&#x201c;", f);
 			p += 2;
 			continue;
 		} else if (escaped_streq(op, p, "\'\'")) {
-			fputs("&#x201d;", stdout);
+			fputs("&#x201d;", f);
 			p += 2;
 			continue;
 		} else if (escaped_streq(op, p, "---")) {
-			fputs("&#8212;", stdout);
+			fputs("&#8212;", f);
 			p += 3;
 			continue;
 		} else if (escaped_streq(op, p, "--")) {
-			fputs("&#8211;", stdout);
+			fputs("&#8211;", f);
 			p += 2;
 			continue;
 		} 
@@ -134,7 +214,7 @@ safe_putcomment(const struct opts *opts, const char *p)
 
 		if ( ! escaped_streq(op, p, "@") &&
 		     ! escaped_streq(op, p, "[")) {
-			safe_putchar(*p++);
+			sqlite_schema_html_putc(f, *p++);
 			continue;
 		}
 
@@ -175,101 +255,1546 @@ safe_putcomment(const struct opts *opts, const char *p)
 
 		if ((NULL != link && 0 == linksz) || 
 		    (NULL == link && 0 == sz)) {
-			putchar('@');
+			putc('@', f);
 			continue;
 		} 
 
 		if (NULL != link) {
 			if (NULL != op)
-				printf("<a href=\"%.*s\">", (int)sz, op);
+				fprintf(f, "<a href=\"%.*s\">", (int)sz, op);
 			else
-				printf("<a href=\"%.*s\">", (int)linksz, link);
-			safe_putbuf(link, linksz);
+				fprintf(f, "<a href=\"%.*s\">", (int)linksz, link);
+			sqlite_schema_html_putbuf(f, link, linksz);
 		} else {
+			tab = NULL;
+			if (NULL != opts->pages) {
+				linksz = 0;
+				while (linksz < sz && '.' != op[linksz])
+					linksz++;
+				if (NULL == (name = strndup(op, linksz)))
+					err(EXIT_FAILURE, "strndup");
+				tab = sqlite_schema_tab(opts->p, name);
+				free(name);
+			}
 			cp = sqlite_schema_idbuf(op, sz);
-			printf("<a href=\"#%s-%s\">", opts->prefix, cp);
+			output_link(opts, tab, cp);
 			free(cp);
-			safe_putbuf(op, sz);
+			sqlite_schema_html_putbuf(f, op, sz);
 		}
-		fputs("</a>", stdout);
+		fputs("</a>", f);
 	}
 }
 
+/*
+ * Output the declared type and constraints of a column, if any.
+ */
 static void
-output(const struct opts *opts, struct parse *p)
+output_type(FILE *f, const struct parse *p, const struct col *col)
 {
-	struct tab	*tab;
-	struct col	*col;
-	char		*cp;
 
-	puts("<dl class=\"tabs\">");
-	TAILQ_FOREACH(tab, &p->tabq, entry) {
-		cp = sqlite_schema_id(tab->name, NULL);
-		printf("\t<dt id=\"%s-%s\">", opts->prefix, cp);
+	if (0 == col->type && 0 == col->def &&
+	    0 == ((COL_PKEY | COL_UNIQUE | 
+	           COL_NOTNULL | COL_AUTOINC) & col->flags))
+		return;
+
+	fputs("\t\t\t\t<div class=\"type\">", f);
+	if (0 != col->type) {
+		fputs("<span class=\"decl\">", f);
+		sqlite_schema_html_puts(f, SCHEMA_STR(p, col->type));
+		fputs("</span>", f);
+	}
+	if (COL_PKEY & col->flags)
+		fputs(" <span class=\"cons\">primary key</span>", f);
+	if (COL_AUTOINC & col->flags)
+		fputs(" <span class=\"cons\">autoincrement</span>", f);
+	if (COL_UNIQUE & col->flags)
+		fputs(" <span class=\"cons\">unique</span>", f);
+	if (COL_NOTNULL & col->flags)
+		fputs(" <span class=\"cons\">not null</span>", f);
+	if (0 != col->def) {
+		fputs(" <span class=\"cons\">default ", f);
+		sqlite_schema_html_puts(f, SCHEMA_STR(p, col->def));
+		fputs("</span>", f);
+	}
+	fputs("</div>\n", f);
+}
+
+/*
+ * Output the table options and its storage estimate.
+ */
+static void
+output_storage(const struct opts *opts, const struct tab *tab)
+{
+	struct storage	 st;
+	FILE		*f = opts->f;
+
+	if ((TAB_TEMP | TAB_WITHOUT_ROWID | TAB_STRICT) & tab->flags)
+		fprintf(f, "\t\t<div class=\"tabopts\">%s%s%s</div>\n",
+			TAB_TEMP & tab->flags ? 
+			" <span>temporary</span>" : "",
+			TAB_WITHOUT_ROWID & tab->flags ? 
+			" <span>without rowid</span>" : "",
+			TAB_STRICT & tab->flags ? 
+			" <span>strict</span>" : "");
+
+	sqlite_schema_storage(opts->p, tab, opts->pagesz, &st);
+	fprintf(f, "\t\t<div class=\"storage\">"
+		"~%zu bytes per row (%zu in header), "
+		"~%zu rows per %zu-byte page%s</div>\n",
+		st.payload, st.hdr, st.rows, opts->pagesz,
+		OVERFLOW_LIKELY == st.overflow ? 
+		", <span class=\"overflow\">likely to overflow</span>" :
+		OVERFLOW_POSSIBLE == st.overflow ? 
+		", <span class=\"overflow\">may overflow</span>" : "");
+}
+
+/*
+ * Output the statistics of the table or index "name", if any, after
+ * "indent" tabs.
+ */
+static void
+output_stats(const struct opts *opts, const char *name, size_t indent)
+{
+	const struct statent *ent;
+	const char	*sep = "";
+	FILE		*f = opts->f;
+
+	if (NULL == opts->stats ||
+	    NULL == (ent = sqlite_schema_stats_get(opts->stats, name)))
+		return;
+
+	while (indent-- > 0)
+		putc('\t', f);
+	fputs("<div class=\"stats\">", f);
+	if (STAT_ROWS & ent->flags) {
+		fprintf(f, "%" PRIu64 " rows", ent->rows);
+		sep = ", ";
+	}
+	if (STAT_PAGES & ent->flags) {
+		fprintf(f, "%s%" PRIu64 " pages", sep, ent->pages);
+		sep = ", ";
+	}
+	if (STAT_BYTES & ent->flags)
+		fprintf(f, "%s%" PRIu64 " bytes", sep, ent->bytes);
+	fputs("</div>\n", f);
+}
+
+/*
+ * Output how often a table is scanned and searched by query plans.
+ */
+static void
+output_tabplans(const struct opts *opts, const struct tab *tab)
+{
+	size_t	 scans, searches;
+
+	if (NULL == opts->plans)
+		return;
+	scans = opts->plans->scans[tab->idx];
+	searches = opts->plans->searches[tab->idx];
+	if (0 == scans && 0 == searches)
+		fputs("\t\t<div class=\"plans unused\">"
+			"not in any plan</div>\n", opts->f);
+	else
+		fprintf(opts->f, "\t\t<div class=\"plans%s\">"
+			"%zu full scans, %zu searches</div>\n",
+			scans > 0 ? " scanned" : "", scans, searches);
+}
+
+/*
+ * Output how often an index is used by query plans.
+ * Only named indices are unused: the others enforce constraints.
+ */
+static void
+output_idxplans(const struct opts *opts, const struct idx *idx)
+{
+	size_t	 uses;
+
+	if (NULL == opts->plans)
+		return;
+	if ((uses = opts->plans->uses[idx->idx]) > 0)
+		fprintf(opts->f, "\t\t\t\t<div class=\"plans\">"
+			"%zu uses</div>\n", uses);
+	else if (0 != idx->name)
+		fputs("\t\t\t\t<div class=\"plans unused\">"
+			"not in any plan</div>\n", opts->f);
+}
+
+/*
+ * Output how often the table or column "n" of the query log's accesses
+ * is read and written.
+ */
+static void
+output_access(const struct opts *opts, size_t n, size_t indent)
+{
+	const struct access *a = opts->access;
+	FILE		*f = opts->f;
+
+	if (NULL == a)
+		return;
+	while (indent-- > 0)
+		fputc('\t', f);
+	if (0 == a->reads[n] && 0 == a->writes[n])
+		fputs("<div class=\"access unused\">"
+			"not in the log</div>\n", f);
+	else
+		fprintf(f, "<div class=\"access\">%" PRIu64 " reads, "
+			"%" PRIu64 " writes</div>\n",
+			a->reads[n], a->writes[n]);
+}
+
+/*
+ * Output the indices of a table, if any.
+ * Automatic indices (from constraints) have no name, so we label them
+ * by their constraint type.
+ */
+static void
+output_idxs(const struct opts *opts, const struct tab *tab)
+{
+	const struct parse *p = opts->p;
+	const struct idx *idx;
+	const struct idxcol *ic;
+	char		 *cp;
+	size_t		  i;
+	FILE		 *f = opts->f;
+
+	if (0 == tab->nidx)
+		return;
+
+	fputs("\t\t<dl class=\"idxs\">\n", f);
+	IDX_FOREACH(idx, p, tab) {
+		fprintf(f, "\t\t\t<dt class=\"%s%s%s\"", 
+			IDX_AUTO & idx->flags ? "auto" : "index",
+			IDX_UNIQUE & idx->flags ? " unique" : "",
+			IDX_PARTIAL & idx->flags ? " partial" : "");
+		if (0 != idx->name) {
+			cp = sqlite_schema_id(SCHEMA_STR(p, idx->name), NULL);
+			fprintf(f, " id=\"%s-%s\">", opts->prefix, cp);
+			free(cp);
+			sqlite_schema_html_puts(f, SCHEMA_STR(p, idx->name));
+		} else if (IDX_PKEY & idx->flags)
+			fputs(">primary key", f);
+		else
+			fputs(">unique", f);
+		fputs("</dt>\n", f);
+		fputs("\t\t\t<dd>\n", f);
+		fputs("\t\t\t\t<div class=\"idxcols\">", f);
+		for (i = 0; i < idx->ncols; i++) {
+			if (i > 0)
+				fputs(", ", f);
+			ic = IDXCOL(p, idx, i);
+			if (0 == ic->name) {
+				fputs("<i>expression</i>", f);
+				continue;
+			} else if (SCHEMA_NONE == ic->col) {
+				sqlite_schema_html_puts(f, 
+					SCHEMA_STR(p, ic->name));
+				continue;
+			}
+			cp = sqlite_schema_id(SCHEMA_STR(p, tab->name), 
+				SCHEMA_STR(p, p->cols[ic->col].name));
+			output_link(opts, tab, cp);
+			free(cp);
+			sqlite_schema_html_puts(f, SCHEMA_STR(p, ic->name));
+			fputs("</a>", f);
+		}
+		fputs("</div>\n", f);
+		if (0 != idx->name)
+			output_stats(opts, SCHEMA_STR(p, idx->name), 4);
+		output_idxplans(opts, idx);
+		if (0 != idx->where) {
+			fputs("\t\t\t\t<div class=\"where\">", f);
+			sqlite_schema_html_puts(f, SCHEMA_STR(p, idx->where));
+			fputs("</div>\n", f);
+		}
+		if (0 != idx->comment) {
+			fputs("\t\t\t\t<div class=\"comment\">\n", f);
+			fputs("\t\t\t\t\t", f);
+			safe_putcomment(opts, SCHEMA_STR(p, idx->comment));
+			fputs("\n\t\t\t\t</div>\n", f);
+		}
+		fputs("\t\t\t</dd>\n", f);
+	}
+	fputs("\t\t</dl>\n", f);
+}
+
+/*
+ * Output the tables reachable from "tab" by following foreign keys,
+ * once for each strongly connected component of them.
+ * Only the representative of a component lists what it reaches: the
+ * component's other tables, then the components its foreign keys
+ * reference, each by its representative and the first column leading
+ * to it.
+ * Any other table links only to its representative, which it reaches.
+ * The reached components list what they reach in turn, so the output
+ * is linear in the tables and foreign keys.
+ */
+static void
+output_reach(const struct opts *opts, const struct tab *tab, 
+	struct reach *r)
+{
+	const struct parse *p = opts->p;
+	const struct tab *to, *ctab;
+	const struct col *col;
+	size_t	 i, c, d;
+	uint32_t e, rep;
+	int	 open = 0;
+	char	*cp;
+	FILE	*f = opts->f;
+
+	c = r->s.comp[tab->idx];
+	rep = r->tabs[r->off[c]];
+	r->seen[c] = ++r->stamp;
+
+	for (i = r->off[c]; i < r->off[c + 1]; i++) {
+		if (r->tabs[i] == tab->idx)
+			continue;
+		if ( ! open++)
+			fputs("\t\t<ul class=\"reach\">\n", f);
+		to = &p->tabs[r->tabs[i]];
+		cp = sqlite_schema_id(SCHEMA_STR(p, to->name), NULL);
+		fputs("\t\t\t<li class=\"cycle\">", f);
+		output_link(opts, to, cp);
 		free(cp);
-		safe_putstr(tab->name);
-		puts("</dt>");
-		puts("\t<dd>");
-		if (NULL != tab->comment) {
-			puts("\t\t<div class=\"comment\">");
-			fputs("\t\t\t", stdout);
-			safe_putcomment(opts, tab->comment);
-			puts("\n\t\t</div>");
+		sqlite_schema_html_puts(f, SCHEMA_STR(p, to->name));
+		fputs("</a></li>\n", f);
+		if (tab->idx != rep)
+			break;
+	}
+
+	for (i = r->off[c]; tab->idx == rep && i < r->off[c + 1]; i++)
+		for (e = r->g.fwd[r->tabs[i]]; 
+		     e < r->g.fwd[r->tabs[i] + 1]; e++) {
+			d = r->s.comp[r->g.edges[e].tab];
+			if (r->seen[d] == r->stamp)
+				continue;
+			r->seen[d] = r->stamp;
+			if ( ! open++)
+				fputs("\t\t<ul class=\"reach\">\n", f);
+			to = &p->tabs[r->tabs[r->off[d]]];
+			col = &p->cols[r->g.edges[e].col];
+			ctab = COL_TAB(p, col);
+			cp = sqlite_schema_id(SCHEMA_STR(p, to->name), NULL);
+			fputs("\t\t\t<li>", f);
+			output_link(opts, to, cp);
+			free(cp);
+			sqlite_schema_html_puts(f, SCHEMA_STR(p, to->name));
+			fputs("</a>: ", f);
+			cp = sqlite_schema_id(SCHEMA_STR(p, ctab->name), 
+				SCHEMA_STR(p, col->name));
+			output_link(opts, ctab, cp);
+			free(cp);
+			sqlite_schema_html_puts(f, SCHEMA_STR(p, ctab->name));
+			sqlite_schema_html_putc(f, '.');
+			sqlite_schema_html_puts(f, SCHEMA_STR(p, col->name));
+			fputs("</a></li>\n", f);
+		}
+
+	if (open)
+		fputs("\t\t</ul>\n", f);
+}
+
+/*
+ * Order tables by name, then by declaration.
+ */
+static int
+tabcmp(const void *a, const void *b)
+{
+	const struct tabkey *ka = a, *kb = b;
+	int		  c;
+
+	if (0 != (c = strcmp(ka->name, kb->name)))
+		return(c);
+	return(ka->idx < kb->idx ? -1 : ka->idx > kb->idx);
+}
+
+/*
+ * Output the tables with foreign keys referencing "tab", if any.
+ */
+static void
+output_tabrefs(const struct opts *opts, const struct tab *tab)
+{
+	const struct parse *p = opts->p;
+	const struct col *col;
+	const struct tab *ref;
+	struct tabkey	 *tabs;
+	size_t		  i, n = 0;
+	uint32_t	  j;
+	char		 *cp;
+	FILE		 *f = opts->f;
+
+	if (0 == tab->nrefs)
+		return;
+
+	tabs = reallocarray(NULL, tab->nrefs, sizeof(struct tabkey));
+	if (NULL == tabs)
+		err(EXIT_FAILURE, "reallocarray");
+	COL_FOREACH(col, p, tab)
+		for (j = 0; j < col->nrefs; j++) {
+			ref = COL_TAB(p, &p->cols[p->refs[col->firstref + j]]);
+			tabs[n].name = SCHEMA_STR(p, ref->name);
+			tabs[n++].idx = ref->idx;
 		}
-		puts("\t\t<dl class=\"cols\">");
-		TAILQ_FOREACH(col, &tab->colq, entry) {
-			cp = sqlite_schema_id
-				(col->tab->name, col->name);
-			printf("\t\t\t<dt id=\"%s-%s\">", 
-				opts->prefix, cp);
+	qsort(tabs, n, sizeof(struct tabkey), tabcmp);
+
+	fputs("\t\t<div class=\"refs\">", f);
+	for (i = 0; i < n; i++) {
+		if (i > 0 && tabs[i].idx == tabs[i - 1].idx)
+			continue;
+		if (i > 0)
+			fputs(", ", f);
+		ref = &p->tabs[tabs[i].idx];
+		cp = sqlite_schema_id(tabs[i].name, NULL);
+		output_link(opts, ref, cp);
+		free(cp);
+		sqlite_schema_html_puts(f, tabs[i].name);
+		fputs("</a>", f);
+	}
+	fputs("</div>\n", f);
+	free(tabs);
+}
+
+/*
+ * Output the columns with foreign keys referencing "col", if any.
+ */
+static void
+output_colrefs(const struct opts *opts, const struct col *col)
+{
+	const struct parse *p = opts->p;
+	const struct col *ref;
+	const struct tab *rtab;
+	uint32_t	  i;
+	char		 *cp;
+	FILE		 *f = opts->f;
+
+	if (0 == col->nrefs)
+		return;
+
+	fputs("\t\t\t\t<div class=\"refs\">", f);
+	for (i = 0; i < col->nrefs; i++) {
+		if (i > 0)
+			fputs(", ", f);
+		ref = &p->cols[p->refs[col->firstref + i]];
+		rtab = COL_TAB(p, ref);
+		cp = sqlite_schema_id(SCHEMA_STR(p, rtab->name), 
+			SCHEMA_STR(p, ref->name));
+		output_link(opts, rtab, cp);
+		free(cp);
+		sqlite_schema_html_puts(f, SCHEMA_STR(p, rtab->name));
+		sqlite_schema_html_putc(f, '.');
+		sqlite_schema_html_puts(f, SCHEMA_STR(p, ref->name));
+		fputs("</a>", f);
+	}
+	fputs("</div>\n", f);
+}
+
+/*
+ * Output the actions of a foreign key, if any.
+ */
+static void
+output_fkacts(FILE *f, const struct fkey *fkey)
+{
+
+	if (FKACT_NONE != fkey->ondelete)
+		fprintf(f, " <span class=\"ondelete\">%s</span>",
+			fkacts[fkey->ondelete]);
+	if (FKACT_NONE != fkey->onupdate)
+		fprintf(f, " <span class=\"onupdate\">%s</span>",
+			fkacts[fkey->onupdate]);
+}
+
+/*
+ * Output the tables touched by deleting ("del") or updating rows of
+ * "tab" by cascading foreign key actions, if any, in order of depth.
+ */
+static void
+output_cascade(const struct opts *opts, const struct tab *tab, int del)
+{
+	const struct parse *p = opts->p;
+	const struct cascent *ent;
+	const struct col *via;
+	const struct tab *vtab;
+	struct cascade	*c = opts->cascade;
+	size_t		 i;
+	char		*cp;
+	FILE		*f = opts->f;
+
+	sqlite_schema_cascade(c, tab, del);
+	if (0 == c->nents)
+		return;
+
+	fprintf(f, "\t\t<ul class=\"%s\">\n", 
+		del ? "cascdelete" : "cascupdate");
+	for (i = 0; i < c->nents; i++) {
+		ent = &c->ents[i];
+		via = &p->cols[ent->via];
+		vtab = COL_TAB(p, via);
+		fprintf(f, "\t\t\t<li>%zu: ", ent->depth);
+		cp = sqlite_schema_id(SCHEMA_STR(p, vtab->name), NULL);
+		output_link(opts, vtab, cp);
+		free(cp);
+		sqlite_schema_html_puts(f, SCHEMA_STR(p, vtab->name));
+		fprintf(f, "</a> %s by ", ent->del ? "deleted" : "updated");
+		cp = sqlite_schema_id(SCHEMA_STR(p, vtab->name), 
+			SCHEMA_STR(p, via->name));
+		output_link(opts, vtab, cp);
+		free(cp);
+		sqlite_schema_html_puts(f, SCHEMA_STR(p, vtab->name));
+		sqlite_schema_html_putc(f, '.');
+		sqlite_schema_html_puts(f, SCHEMA_STR(p, via->name));
+		fprintf(f, "</a> on %s %s</li>\n", 
+			ent->ondelete ? "delete" : "update",
+			fkacts[ent->act]);
+	}
+	fputs("\t\t</ul>\n", f);
+}
+
+/*
+ * Output the load level of "tab" and, if it's in a cycle of foreign
+ * keys, all tables of the cycle.
+ */
+static void
+output_level(const struct opts *opts, const struct tab *tab)
+{
+	const struct parse *p = opts->p;
+	const struct levels *l = opts->levels;
+	const struct tab *ctab;
+	size_t		 c, i;
+	char		*cp;
+	FILE		*f = opts->f;
+
+	c = l->s.comp[tab->idx];
+	fprintf(f, "\t\t<div class=\"level\">%" PRIu32 "</div>\n",
+		l->s.level[c]);
+	if ( ! l->s.cyclic[c])
+		return;
+
+	fputs("\t\t<div class=\"cycle\">", f);
+	for (i = l->off[c]; i < l->off[c + 1]; i++) {
+		if (i > l->off[c])
+			fputs(", ", f);
+		ctab = &p->tabs[l->tabs[i]];
+		cp = sqlite_schema_id(SCHEMA_STR(p, ctab->name), NULL);
+		output_link(opts, ctab, cp);
+		free(cp);
+		sqlite_schema_html_puts(f, SCHEMA_STR(p, ctab->name));
+		fputs("</a>", f);
+	}
+	fputs("</div>\n", f);
+}
+
+/*
+ * Output a table's definition list entry.
+ * If "r" is not NULL, this also shows the reachable tables.
+ */
+static void
+output_tab(const struct opts *opts, const struct tab *tab, struct reach *r)
+{
+	const struct parse *p = opts->p;
+	const struct col *col, *fcol;
+	const struct tab *ftab;
+	const struct fkey *fkey;
+	const char	 *name = SCHEMA_STR(p, tab->name);
+	char		 *cp;
+	size_t		  i;
+	FILE		 *f = opts->f;
+	uint64_t	  start = sqlite_schema_trace_now();
+
+	cp = sqlite_schema_id(name, NULL);
+	fprintf(f, "\t<dt id=\"%s-%s\">", opts->prefix, cp);
+	free(cp);
+	sqlite_schema_html_puts(f, name);
+	fputs("</dt>\n", f);
+	fputs("\t<dd>\n", f);
+	if (0 != tab->comment) {
+		fputs("\t\t<div class=\"comment\">\n", f);
+		fputs("\t\t\t", f);
+		safe_putcomment(opts, SCHEMA_STR(p, tab->comment));
+		fputs("\n\t\t</div>\n", f);
+	}
+	output_storage(opts, tab);
+	output_stats(opts, name, 2);
+	output_tabplans(opts, tab);
+	output_access(opts, tab->idx, 2);
+	if (NULL != opts->levels)
+		output_level(opts, tab);
+	output_tabrefs(opts, tab);
+	fputs("\t\t<dl class=\"cols\">\n", f);
+	COL_FOREACH(col, p, tab) {
+		cp = sqlite_schema_id(name, SCHEMA_STR(p, col->name));
+		fprintf(f, "\t\t\t<dt id=\"%s-%s\">", opts->prefix, cp);
+		free(cp);
+		sqlite_schema_html_puts(f, SCHEMA_STR(p, col->name));
+		fputs("</dt>\n", f);
+		fputs("\t\t\t<dd>\n", f);
+		output_type(f, p, col);
+		if (NULL != opts->access)
+			output_access(opts,
+				opts->access->colbase[tab->idx] + col->idx, 4);
+		i = col - &p->cols[tab->firstcol];
+		if (SCHEMA_NONE != col->fkey) {
+			fcol = COL_FKEY(p, col);
+			ftab = COL_TAB(p, fcol);
+			fputs("\t\t\t\t<div class=\"foreign\">", f);
+			cp = sqlite_schema_id(SCHEMA_STR(p, ftab->name), 
+				SCHEMA_STR(p, fcol->name));
+			output_link(opts, ftab, cp);
 			free(cp);
-			safe_putstr(col->name);
-			puts("</dt>");
-			puts("\t\t\t<dd>");
-			if (NULL != col->fkey) {
-				fputs("\t\t\t\t<div "
-					"class=\"foreign\">", stdout);
-				cp = sqlite_schema_id
-					(col->fkey->tab->name, 
-					 col->fkey->name);
-				printf("<a href=\"#%s-%s\">", 
-					opts->prefix, cp);
-				free(cp);
-				safe_putstr(col->fkey->tab->name);
-				safe_putstr(".");
-				safe_putstr(col->fkey->name);
-				puts("</a></div>");
-			}
-			if (NULL != col->comment) {
-				puts("\t\t\t\t<div class=\"comment\">");
-				fputs("\t\t\t\t\t", stdout);
-				safe_putcomment(opts, col->comment);
-				puts("\n\t\t\t\t</div>");
-			}
-			puts("\t\t\t</dd>");
+			sqlite_schema_html_puts(f, SCHEMA_STR(p, ftab->name));
+			sqlite_schema_html_puts(f, ".");
+			sqlite_schema_html_puts(f, SCHEMA_STR(p, fcol->name));
+			fputs("</a>", f);
+			output_fkacts(f, COL_FKDECL(p, col));
+			fputs("</div>\n", f);
+		} else if (i < opts->nfkeys && 
+		    SCHEMA_NONE != opts->fkeys[i]) {
+			fkey = &p->fkeys[opts->fkeys[i]];
+			fputs("\t\t\t\t<div class=\"foreign\">", f);
+			cp = sqlite_schema_id(SCHEMA_STR(p, fkey->rtab), 
+				SCHEMA_STR(p, fkey->rcol));
+			output_link(opts, NULL, cp);
+			free(cp);
+			sqlite_schema_html_puts(f, SCHEMA_STR(p, fkey->rtab));
+			sqlite_schema_html_puts(f, ".");
+			sqlite_schema_html_puts(f, SCHEMA_STR(p, fkey->rcol));
+			fputs("</a>", f);
+			output_fkacts(f, fkey);
+			fputs("</div>\n", f);
 		}
-		puts("\t\t</dl>");
-		puts("\t</dd>");
+		if (COL_FKEY_UNINDEXED(col))
+			fputs("\t\t\t\t<div class=\"unindexed\">"
+				"not covered by an index</div>\n", f);
+		output_colrefs(opts, col);
+		if (0 != col->comment) {
+			fputs("\t\t\t\t<div class=\"comment\">\n", f);
+			fputs("\t\t\t\t\t", f);
+			safe_putcomment(opts, SCHEMA_STR(p, col->comment));
+			fputs("\n\t\t\t\t</div>\n", f);
+		}
+		fputs("\t\t\t</dd>\n", f);
+	}
+	fputs("\t\t</dl>\n", f);
+	output_idxs(opts, tab);
+	if (NULL != opts->cascade) {
+		output_cascade(opts, tab, 1);
+		output_cascade(opts, tab, 0);
 	}
-	puts("</dl>");
+	if (NULL != r)
+		output_reach(opts, tab, r);
+	fputs("\t</dd>\n", f);
+	sqlite_schema_trace("render", "table", name, start);
+}
+
+/*
+ * Output the tables in name order from "first" up to, not including,
+ * "last".
+ */
+static void
+output_tabs(const struct opts *opts, size_t first, size_t last,
+	struct reach *r)
+{
+	const struct parse *p = opts->p;
+
+	fputs("<dl class=\"tabs\">\n", opts->f);
+	for ( ; first < last; first++)
+		output_tab(opts, &p->tabs[p->byname[first]], r);
+	fputs("</dl>\n", opts->f);
+}
+
+/*
+ * Open a stand-alone page "page" in directory "dir" titled by the
+ * range of tables from "first" to "last" or, if NULL, as the index.
+ */
+static FILE *
+page_open(struct ofile *of, const char *dir, const char *page, 
+	const char *css, const struct parse *p, 
+	const struct tab *first, const struct tab *last)
+{
+	char	*path;
+	FILE	*f;
+
+	if (-1 == asprintf(&path, "%s/%s", dir, page))
+		err(EXIT_FAILURE, "asprintf");
+	f = sqlite_schema_fopen(of, path);
+	free(path);
+
+	fputs("<!DOCTYPE html>\n"
+	      "<html>\n"
+	      "\t<head>\n"
+	      "\t\t<meta charset=\"utf-8\" />\n"
+	      "\t\t<title>", f);
+	if (NULL == first)
+		fputs("Index", f);
+	else
+		sqlite_schema_html_puts(f, SCHEMA_STR(p, first->name));
+	if (NULL != last && last != first) {
+		fputs(" &#8211; ", f);
+		sqlite_schema_html_puts(f, SCHEMA_STR(p, last->name));
+	}
+	fputs("</title>\n", f);
+	if (NULL != css) {
+		fputs("\t\t<link rel=\"stylesheet\" href=\"", f);
+		sqlite_schema_html_puts(f, css);
+		fputs("\" />\n", f);
+	}
+	fputs("\t</head>\n"
+	      "\t<body>\n", f);
+	if (NULL != first)
+		fputs("<nav class=\"index\">"
+		      "<a href=\"index.html\">Index</a></nav>\n", f);
+	return(f);
+}
+
+static void
+page_close(struct ofile *of)
+{
+
+	fputs("\t</body>\n"
+	      "</html>\n", of->f);
+	sqlite_schema_fclose(of);
+}
+
+/*
+ * Case-insensitive FNV-1a hash of a page name, as pages may be written
+ * to case-insensitive file-systems.
+ */
+static uint32_t
+page_hash(const char *cp)
+{
+	uint32_t	 h = 2166136261U;
+
+	for ( ; '\0' != *cp; cp++) {
+		h ^= (unsigned char)tolower((unsigned char)*cp);
+		h *= 16777619U;
+	}
+	return(h);
+}
+
+/*
+ * Name the page of table "tab" for it, adding it to the hash "pages"
+ * of "pagesz" names.
+ * Distinct table names may have the same identifier, so a name already
+ * taken gets the first free numeric suffix.
+ */
+static char *
+page_name(const struct opts *opts, const struct tab *tab,
+	char **pages, size_t pagesz)
+{
+	char	*cp, *page;
+	size_t	 h, n = 0;
+
+	cp = sqlite_schema_id(SCHEMA_STR(opts->p, tab->name), NULL);
+	if (-1 == asprintf(&page, "%s-%s.html", opts->prefix, cp))
+		err(EXIT_FAILURE, "asprintf");
+	for (;;) {
+		h = page_hash(page) & (pagesz - 1);
+		for ( ; NULL != pages[h]; h = (h + 1) & (pagesz - 1))
+			if (0 == strcasecmp(pages[h], page))
+				break;
+		if (NULL == pages[h])
+			break;
+		free(page);
+		if (-1 == asprintf(&page, 
+		    "%s-%s-%zu.html", opts->prefix, cp, ++n))
+			err(EXIT_FAILURE, "asprintf");
+	}
+	free(cp);
+	return(pages[h] = page);
+}
+
+/*
+ * Assign tables to pages named for their first table.
+ * Tables are grouped by "group" tables per page or, if zero, by the
+ * name up to the first underscore.
+ * Links to tables on other pages are then directed to those pages.
+ */
+static void
+pages_init(struct opts *opts, const struct parse *p, size_t group)
+{
+	const struct tab *tab;
+	const char	 *name, *pfx = NULL;
+	char		 *page = NULL, **pages;
+	size_t		  i, n = 0, sz, pfxsz = 0, pagesz;
+
+	if (NULL == (opts->pages = calloc(p->ntab, sizeof(char *))))
+		err(EXIT_FAILURE, "calloc");
+	for (pagesz = 16; pagesz < p->ntab * 2; )
+		pagesz <<= 1;
+	if (NULL == (pages = calloc(pagesz, sizeof(char *))))
+		err(EXIT_FAILURE, "calloc");
+
+	TAB_FOREACH(tab, p, i) {
+		name = SCHEMA_STR(p, tab->name);
+		sz = strcspn(name, "_");
+		if (NULL == page || 
+		    (group > 0 && n == group) ||
+		    (0 == group && (sz != pfxsz || 
+		     strncmp(name, pfx, sz)))) {
+			page = page_name(opts, tab, pages, pagesz);
+			pfx = name;
+			pfxsz = sz;
+			n = 0;
+		}
+		opts->pages[tab->idx] = page;
+		n++;
+	}
+
+	free(pages);
+}
+
+static void
+pages_free(struct opts *opts, const struct parse *p)
+{
+	const struct tab *tab;
+	char		 *page = NULL;
+	size_t		  i;
+
+	TAB_FOREACH(tab, p, i)
+		if (opts->pages[tab->idx] != page)
+			free(page = opts->pages[tab->idx]);
+	free(opts->pages);
+	opts->pages = NULL;
+}
+
+/*
+ * Write each page of tables assigned by pages_init() into "dir", with
+ * an index page linking to all tables.
+ */
+static void
+output_pages(struct opts *opts, const struct parse *p, struct reach *r,
+	const char *dir, const char *css)
+{
+	const struct tab *tab, *first;
+	struct ofile	  of;
+	char		 *cp;
+	size_t		  i, j;
+
+	if (-1 == mkdir(dir, 0755) && EEXIST != errno)
+		err(EXIT_FAILURE, "%s", dir);
+
+	for (i = 0; i < p->ntab; i = j) {
+		first = &p->tabs[p->byname[i]];
+		opts->page = opts->pages[first->idx];
+		for (j = i + 1; j < p->ntab; j++)
+			if (opts->pages[p->byname[j]] != opts->page)
+				break;
+		opts->f = page_open(&of, dir, opts->page, css, p, 
+			first, &p->tabs[p->byname[j - 1]]);
+		output_tabs(opts, i, j, r);
+		page_close(&of);
+	}
+
+	opts->page = NULL;
+	opts->f = page_open(&of, dir, "index.html", css, p, NULL, NULL);
+	fputs("<ul class=\"index\">\n", opts->f);
+	TAB_FOREACH(tab, p, i) {
+		cp = sqlite_schema_id(SCHEMA_STR(p, tab->name), NULL);
+		fputs("\t<li>", opts->f);
+		output_link(opts, tab, cp);
+		free(cp);
+		sqlite_schema_html_puts(opts->f, SCHEMA_STR(p, tab->name));
+		fputs("</a></li>\n", opts->f);
+	}
+	fputs("</ul>\n", opts->f);
+	page_close(&of);
+}
+
+/*
+ * Add the lower-cased term "cp" of "sz" bytes for document "doc".
+ * Terms shorter than two bytes aren't worth searching for.
+ */
+static void
+terms_add(struct terms *ts, const char *cp, size_t sz, uint32_t doc)
+{
+	size_t	 i;
+	char	*term;
+
+	if (0 == sz)
+		return;
+	if (ts->nterms == ts->maxterms) {
+		ts->maxterms = 0 == ts->maxterms ? 
+			1024 : ts->maxterms * 2;
+		ts->terms = reallocarray(ts->terms, 
+			ts->maxterms, sizeof(struct term));
+		if (NULL == ts->terms)
+			err(EXIT_FAILURE, "reallocarray");
+	}
+	if (NULL == (term = malloc(sz + 1)))
+		err(EXIT_FAILURE, "malloc");
+	for (i = 0; i < sz; i++)
+		term[i] = tolower((unsigned char)cp[i]);
+	term[sz] = '\0';
+	ts->terms[ts->nterms].term = term;
+	ts->terms[ts->nterms].doc = doc;
+	ts->nterms++;
+}
+
+/*
+ * Add each alphanumeric word in "cp" of at least two letters for
+ * document "doc".
+ */
+static void
+terms_words(struct terms *ts, const char *cp, uint32_t doc)
+{
+	size_t	 sz;
+
+	while ('\0' != *cp) {
+		for (sz = 0; isalnum((unsigned char)cp[sz]); sz++)
+			continue;
+		if (sz >= 2)
+			terms_add(ts, cp, sz, doc);
+		cp += sz;
+		if ('\0' != *cp)
+			cp++;
+	}
+}
+
+/*
+ * Add the name "cp" for document "doc" and, if it's compound (like
+ * "user_id"), each of its parts.
+ */
+static void
+terms_name(struct terms *ts, const char *cp, uint32_t doc)
+{
+
+	terms_add(ts, cp, strlen(cp), doc);
+	if (strlen(cp) != strcspn(cp, "_"))
+		terms_words(ts, cp, doc);
+}
+
+static int
+termcmp(const void *a, const void *b)
+{
+	const struct term *ta = a, *tb = b;
+	int		   c;
+
+	if (0 != (c = strcmp(ta->term, tb->term)))
+		return(c);
+	return(ta->doc < tb->doc ? -1 : ta->doc > tb->doc);
+}
+
+/*
+ * Output the search index to "fname" as a JSON object.
+ * Its "docs" are the tables and columns, each as the index into
+ * "pages" (just the empty string if not split into pages) and its
+ * name, from which the link is formed as in sqlite_schema_id().
+ * The "terms" are the sorted words of their names and comments, the
+ * "postings" of each being the ordered indices into "docs".
+ */
+static void
+output_search(const struct opts *opts, const struct parse *p, 
+	const char *fname)
+{
+	const struct tab *tab;
+	const struct col *col;
+	const char	 *name;
+	struct terms	  ts;
+	uint32_t	  doc = 0;
+	size_t		  i, j, page = 0;
+	const char	 *last = NULL;
+	struct ofile	  of;
+	FILE		 *f;
+
+	memset(&ts, 0, sizeof(struct terms));
+	f = sqlite_schema_fopen(&of, fname);
+
+	fputs("{\"prefix\":", f);
+	sqlite_schema_json_puts(f, opts->prefix);
+	fputs(",\n\"pages\":[", f);
+	if (NULL == opts->pages)
+		fputs("\"\"", f);
+	else
+		TAB_FOREACH(tab, p, i) {
+			if (opts->pages[tab->idx] == last)
+				continue;
+			if (NULL != last)
+				putc(',', f);
+			last = opts->pages[tab->idx];
+			sqlite_schema_json_puts(f, last);
+		}
+	fputs("],\n", f);
+
+	last = NULL;
+	fputs("\"docs\":[", f);
+	TAB_FOREACH(tab, p, i) {
+		if (NULL != opts->pages) {
+			if (NULL != last && last != opts->pages[tab->idx])
+				page++;
+			last = opts->pages[tab->idx];
+		}
+		name = SCHEMA_STR(p, tab->name);
+		terms_name(&ts, name, doc);
+		if (0 != tab->comment)
+			terms_words(&ts, SCHEMA_STR(p, tab->comment), doc);
+		fprintf(f, "%s[%zu,", 0 == doc++ ? "\n" : ",\n", page);
+		sqlite_schema_json_puts(f, name);
+		putc(']', f);
+		COL_FOREACH(col, p, tab) {
+			terms_name(&ts, SCHEMA_STR(p, col->name), doc);
+			if (0 != col->comment)
+				terms_words(&ts, 
+					SCHEMA_STR(p, col->comment), doc);
+			fprintf(f, ",\n[%zu,", page);
+			sqlite_schema_json_puts(f, name);
+			putc(',', f);
+			sqlite_schema_json_puts(f, SCHEMA_STR(p, col->name));
+			putc(']', f);
+			doc++;
+		}
+	}
+	fputs("],\n", f);
+
+	if (ts.nterms > 0)
+		qsort(ts.terms, ts.nterms, sizeof(struct term), termcmp);
+
+	fputs("\"terms\":[", f);
+	for (i = 0; i < ts.nterms; i = j) {
+		fputs(0 == i ? "\n" : ",\n", f);
+		sqlite_schema_json_puts(f, ts.terms[i].term);
+		for (j = i + 1; j < ts.nterms; j++)
+			if (strcmp(ts.terms[i].term, ts.terms[j].term))
+				break;
+	}
+	fputs("],\n", f);
+
+	fputs("\"postings\":[", f);
+	for (i = 0; i < ts.nterms; i = j) {
+		fprintf(f, "%s[%" PRIu32, 0 == i ? "\n" : ",\n", 
+			ts.terms[i].doc);
+		for (j = i + 1; j < ts.nterms; j++) {
+			if (strcmp(ts.terms[i].term, ts.terms[j].term))
+				break;
+			if (ts.terms[j].doc != ts.terms[j - 1].doc)
+				fprintf(f, ",%" PRIu32, ts.terms[j].doc);
+		}
+		putc(']', f);
+	}
+	fputs("]}\n", f);
+	sqlite_schema_fclose(&of);
+
+	for (i = 0; i < ts.nterms; i++)
+		free(ts.terms[i].term);
+	free(ts.terms);
+}
+
+/*
+ * When streaming, output each table as soon as it's parsed.
+ * Its foreign keys aren't resolved, so are linked by name: the parse
+ * holds only this table's, by its columns' positions.
+ */
+static void
+stream_tab(void *arg, const struct parse *p, const struct tab *tab)
+{
+	struct opts	*opts = arg;
+	size_t		 i;
+	uint32_t	 j;
+
+	if (tab->ncol > opts->nfkeys) {
+		opts->fkeys = reallocarray(opts->fkeys, 
+			tab->ncol, sizeof(uint32_t));
+		if (NULL == opts->fkeys)
+			err(EXIT_FAILURE, "reallocarray");
+		opts->nfkeys = tab->ncol;
+	}
+	for (i = 0; i < opts->nfkeys; i++)
+		opts->fkeys[i] = SCHEMA_NONE;
+	for (j = 0; j < p->nfkey; j++)
+		if (p->fkeys[j].col >= tab->firstcol &&
+		    p->fkeys[j].col < tab->firstcol + tab->ncol)
+			opts->fkeys[p->fkeys[j].col - tab->firstcol] = j;
+
+	opts->p = p;
+	output_tab(opts, tab, NULL);
+}
+
+static void
+reach_init(struct reach *r, const struct parse *p)
+{
+
+	sqlite_schema_graph(p, &r->g);
+	sqlite_schema_scc(&r->g, &r->s);
+	r->tabs = calloc(p->ntab + 1, sizeof(uint32_t));
+	r->off = calloc(r->s.ncomp + 1, sizeof(size_t));
+	r->seen = calloc(r->s.ncomp + 1, sizeof(uint32_t));
+	if (NULL == r->tabs || NULL == r->off || NULL == r->seen)
+		err(EXIT_FAILURE, "calloc");
+	sqlite_schema_scc_tabs(p, &r->s, 0, r->tabs, r->off);
+	r->stamp = 0;
+}
+
+static void
+reach_free(struct reach *r)
+{
+
+	free(r->tabs);
+	free(r->off);
+	free(r->seen);
+	sqlite_schema_scc_free(&r->s);
+	sqlite_schema_graph_free(&r->g);
+}
+
+static void
+levels_init(struct levels *l, const struct parse *p)
+{
+	struct graph	 g;
+
+	sqlite_schema_graph(p, &g);
+	sqlite_schema_scc(&g, &l->s);
+	sqlite_schema_graph_free(&g);
+	l->tabs = calloc(p->ntab + 1, sizeof(uint32_t));
+	l->off = calloc(l->s.ncomp + 1, sizeof(size_t));
+	if (NULL == l->tabs || NULL == l->off)
+		err(EXIT_FAILURE, "calloc");
+	sqlite_schema_scc_tabs(p, &l->s, 0, l->tabs, l->off);
+}
+
+static void
+levels_free(struct levels *l)
+{
+
+	free(l->tabs);
+	free(l->off);
+	sqlite_schema_scc_free(&l->s);
+}
+
+/*
+ * Read the template "path" and split it around the line containing
+ * "@SCHEMA@".
+ * Returns zero on failure.
+ */
+static int
+tmpl_read(struct tmpl *t, const char *path)
+{
+	FILE		*f;
+	const char	*cp, *nl;
+	size_t		 sz = 0, bufsz = 0;
+	ssize_t		 ssz;
+	char		*line = NULL;
+	size_t		 linesz = 0;
+
+	if (NULL == (t->path = strdup(path)))
+		err(EXIT_FAILURE, "strdup");
+	if (NULL == (f = fopen(path, "r"))) {
+		warn("%s", path);
+		return(0);
+	}
+	while ((ssz = getline(&line, &linesz, f)) > 0) {
+		if (sz + ssz + 1 > bufsz) {
+			bufsz = 2 * (sz + ssz + 1);
+			if (NULL == (t->buf = realloc(t->buf, bufsz)))
+				err(EXIT_FAILURE, "realloc");
+		}
+		memcpy(t->buf + sz, line, ssz);
+		sz += ssz;
+		t->buf[sz] = '\0';
+	}
+	free(line);
+	if (ferror(f)) {
+		warn("%s", path);
+		fclose(f);
+		free(t->buf);
+		t->buf = NULL;
+		return(0);
+	}
+	fclose(f);
+
+	if (NULL == t->buf || NULL == (cp = strstr(t->buf, "@SCHEMA@"))) {
+		warnx("%s: no @SCHEMA@ line", path);
+		free(t->buf);
+		t->buf = NULL;
+		return(0);
+	}
+	while (cp > t->buf && '\n' != cp[-1])
+		cp--;
+	t->headsz = cp - t->buf;
+	t->tail = NULL == (nl = strchr(cp, '\n')) ? t->buf + sz : nl + 1;
+	t->tailsz = t->buf + sz - t->tail;
+	return(1);
+}
+
+/*
+ * Look up the template "path", reading it if not already.
+ * Returns its index or SIZE_MAX if "-", for none.
+ */
+static size_t
+tmpl_get(struct manifest *m, const char *path)
+{
+	size_t	 i;
+
+	if (0 == strcmp(path, "-"))
+		return(SIZE_MAX);
+	for (i = 0; i < m->ntmpls; i++)
+		if (0 == strcmp(m->tmpls[i].path, path))
+			return(i);
+
+	m->tmpls = reallocarray(m->tmpls,
+		m->ntmpls + 1, sizeof(struct tmpl));
+	if (NULL == m->tmpls)
+		err(EXIT_FAILURE, "reallocarray");
+	memset(&m->tmpls[m->ntmpls], 0, sizeof(struct tmpl));
+	tmpl_read(&m->tmpls[m->ntmpls], path);
+	return(m->ntmpls++);
+}
+
+/*
+ * Read the manifest "fname", each line of which has an input schema,
+ * template (or "-" for none), prefix (or "-" for the default), and
+ * output file separated by white-space.
+ * Blank lines and those beginning with "#" are ignored.
+ * Each template is read once, however many entries use it.
+ * Returns zero on failure.
+ */
+static int
+manifest_read(struct manifest *m, const char *fname)
+{
+	FILE		*f;
+	char		*line = NULL, *cp, *fields[4];
+	size_t		 linesz = 0, ln = 0, i, n, *tidx = NULL;
+	struct ment	*e;
+	int		 rc = 1;
+
+	m->fname = fname;
+	if (NULL == (f = fopen(fname, "r"))) {
+		warn("%s", fname);
+		return(0);
+	}
+
+	while (getline(&line, &linesz, f) > 0) {
+		ln++;
+		cp = line;
+		for (n = 0; n < 4; n++) {
+			while (isspace((unsigned char)*cp))
+				cp++;
+			if ('\0' == *cp || (0 == n && '#' == *cp))
+				break;
+			fields[n] = cp;
+			while ('\0' != *cp && ! isspace((unsigned char)*cp))
+				cp++;
+			if ('\0' != *cp)
+				*cp++ = '\0';
+		}
+		while (isspace((unsigned char)*cp))
+			cp++;
+		if (0 == n)
+			continue;
+		if (n < 4 || '\0' != *cp) {
+			warnx("%s:%zu: expected input, template, prefix, "
+				"and output", fname, ln);
+			rc = 0;
+			break;
+		}
+
+		m->ents = reallocarray(m->ents,
+			m->nents + 1, sizeof(struct ment));
+		tidx = reallocarray(tidx, m->nents + 1, sizeof(size_t));
+		if (NULL == m->ents || NULL == tidx)
+			err(EXIT_FAILURE, "reallocarray");
+		e = &m->ents[m->nents];
+		memset(e, 0, sizeof(struct ment));
+		e->line = ln;
+		tidx[m->nents++] = tmpl_get(m, fields[1]);
+		if (NULL == (e->input = strdup(fields[0])) ||
+		    NULL == (e->output = strdup(fields[3])))
+			err(EXIT_FAILURE, "strdup");
+		if (strcmp(fields[2], "-") &&
+		    NULL == (e->prefix = strdup(fields[2])))
+			err(EXIT_FAILURE, "strdup");
+	}
+
+	if (ferror(f)) {
+		warn("%s", fname);
+		rc = 0;
+	}
+	free(line);
+	fclose(f);
+
+	/* Only now that the templates won't move. */
+
+	for (i = 0; i < m->nents; i++)
+		m->ents[i].tmpl = SIZE_MAX == tidx[i] ? 
+			NULL : &m->tmpls[tidx[i]];
+	free(tidx);
+	return(rc);
+}
+
+static void
+manifest_free(struct manifest *m)
+{
+	size_t	 i;
+
+	for (i = 0; i < m->nents; i++) {
+		free(m->ents[i].input);
+		free(m->ents[i].prefix);
+		free(m->ents[i].output);
+	}
+	for (i = 0; i < m->ntmpls; i++) {
+		free(m->tmpls[i].path);
+		free(m->tmpls[i].buf);
+	}
+	free(m->ents);
+	free(m->tmpls);
+}
+
+/*
+ * Render the entry "e" with the parse "p" (reused between entries).
+ * Returns as for the "rc" of the entry.
+ */
+static int
+manifest_ent(const struct manifest *m, struct parse *p,
+	const struct ment *e)
+{
+	struct opts	 opts;
+	struct ofile	 of;
+	struct reach	 r;
+	struct levels	 l;
+	struct cascade	 casc;
+	int		 rc;
+	uint64_t	 start = sqlite_schema_trace_now();
+
+	if ( ! sqlite_schema_parsefile(e->input, p)) {
+		sqlite_schema_reset(p);
+		return(-1);
+	} else if (NULL != e->tmpl && NULL == e->tmpl->buf) {
+		sqlite_schema_reset(p);
+		return(-1);
+	} else if (NULL == sqlite_schema_fopen_warn(&of, e->output)) {
+		sqlite_schema_reset(p);
+		return(-1);
+	}
+
+	opts = *m->opts;
+	opts.p = p;
+	if (NULL != e->prefix)
+		opts.prefix = e->prefix;
+	opts.f = of.f;
+
+	if (opts.reach)
+		reach_init(&r, p);
+	if (m->levels) {
+		levels_init(&l, p);
+		opts.levels = &l;
+	}
+	if (m->cascade) {
+		sqlite_schema_cascade_init(p, &casc);
+		opts.cascade = &casc;
+	}
+
+	if (NULL != e->tmpl)
+		fwrite(e->tmpl->buf, 1, e->tmpl->headsz, opts.f);
+	output_tabs(&opts, 0, p->ntab, opts.reach ? &r : NULL);
+	if (NULL != e->tmpl)
+		fwrite(e->tmpl->tail, 1, e->tmpl->tailsz, opts.f);
+	rc = sqlite_schema_fclose_warn(&of);
+
+	if (opts.reach)
+		reach_free(&r);
+	if (m->levels)
+		levels_free(&l);
+	if (m->cascade)
+		sqlite_schema_cascade_free(&casc);
+	sqlite_schema_reset(p);
+	sqlite_schema_trace("render", "schema", e->output, start);
+	return(rc);
+}
+
+/*
+ * A thread of the pool: render entries until there are none left.
+ * Each has its own parse, whose allocator is reused from one schema to
+ * the next.
+ */
+static void *
+manifest_run(void *arg)
+{
+	struct manifest	*m = arg;
+	struct parse	 p;
+	size_t		 i;
+
+	memset(&p, 0, sizeof(struct parse));
+	p.verbose = m->verbose;
+	p.lim = m->lim;
+	for (;;) {
+		pthread_mutex_lock(&m->mtx);
+		i = m->next < m->nents ? m->next++ : m->nents;
+		pthread_mutex_unlock(&m->mtx);
+		if (i == m->nents)
+			break;
+		m->ents[i].rc = manifest_ent(m, &p, &m->ents[i]);
+		if (m->ents[i].rc < 0)
+			warnx("%s:%zu: %s: failed", m->fname, 
+				m->ents[i].line, m->ents[i].output);
+	}
+	sqlite_schema_free(&p);
+	return(NULL);
+}
+
+/*
+ * Run manifest_run() on threads other than the caller's, named as such
+ * in the trace.
+ */
+static void *
+manifest_thread(void *arg)
+{
+
+	sqlite_schema_trace_thread("manifest");
+	return(manifest_run(arg));
+}
+
+/*
+ * Render all entries of the manifest on a pool of "jobs" threads (or as
+ * many as processors, if zero), then summarise.
+ * Returns zero if any failed.
+ */
+static int
+manifest(struct manifest *m, size_t jobs)
+{
+	pthread_t	*threads;
+	size_t		 i, n, written = 0, failed = 0;
+	long		 ncpu;
+	int		 c;
+	uint64_t	 start;
+
+	if (0 == (n = jobs)) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		n = ncpu > 0 ? ncpu : 1;
+	}
+	if (n > m->nents)
+		n = m->nents;
+	if (NULL == (threads = calloc(n + 1, sizeof(pthread_t))))
+		err(EXIT_FAILURE, "calloc");
+
+	pthread_mutex_init(&m->mtx, NULL);
+	for (i = 1; i < n; i++)
+		if (0 != (c = pthread_create(&threads[i],
+		    NULL, manifest_thread, m)))
+			errx(EXIT_FAILURE, "pthread_create: %s",
+				strerror(c));
+	manifest_run(m);
+	start = sqlite_schema_trace_now();
+	for (i = 1; i < n; i++)
+		pthread_join(threads[i], NULL);
+	sqlite_schema_trace("wait", "join", NULL, start);
+	pthread_mutex_destroy(&m->mtx);
+	free(threads);
+
+	for (i = 0; i < m->nents; i++)
+		if (m->ents[i].rc < 0)
+			failed++;
+		else if (m->ents[i].rc > 0)
+			written++;
+	fprintf(stderr, "%s: %zu written, %zu unchanged, %zu failed\n",
+		m->fname, written, m->nents - written - failed, failed);
+	return(0 == failed);
 }
 
 int
 main(int argc, char *argv[])
 {
-	int	 	 rc, c;
+	int	 	 rc, c, fp = 0, stream = 0, levels = 0, cascade = 0;
 	struct parse	 p;
 	struct opts	 opts;
+	struct reach	 r;
+	struct levels	 l;
+	struct cascade	 casc;
+	struct stats	 stats;
+	struct plans	 plans;
+	struct access	 access;
+	struct ofile	 of;
+	struct parsecb	 cb;
+	struct manifest	 m;
+	struct limits	 lim;
+	const char	*er, *dir = NULL, *css = NULL, *search = NULL,
+			*out = NULL, *plan = NULL, *log = NULL,
+			*mfile = NULL, *trace = NULL;
+	size_t		 group = 1, jobs = 0;
 
 	memset(&opts, 0, sizeof(struct opts));
 	memset(&p, 0, sizeof(struct parse));
+	memset(&stats, 0, sizeof(struct stats));
+	memset(&plans, 0, sizeof(struct plans));
+	memset(&access, 0, sizeof(struct access));
+	memset(&lim, 0, sizeof(struct limits));
+	p.lim = &lim;
 	opts.prefix = "sql";
+	opts.pagesz = 4096;
+	opts.f = stdout;
 
-	while (-1 != (c = getopt(argc, argv, "v"))) 
+	while (-1 != (c = getopt(argc, argv, "a:CE:c:d:Fg:i:j:K:lM:o:p:rSs:T:vx:z:"))) 
 		switch (c) {
+		case ('a'):
+			log = optarg;
+			break;
+		case ('C'):
+			cascade = 1;
+			break;
+		case ('E'):
+			plan = optarg;
+			break;
+		case ('c'):
+			css = optarg;
+			break;
+		case ('d'):
+			dir = optarg;
+			break;
+		case ('F'):
+			fp = 1;
+			break;
+		case ('g'):
+			if (0 == strcmp(optarg, "prefix")) {
+				group = 0;
+				break;
+			}
+			group = strtonum(optarg, 1, INT_MAX, &er);
+			if (NULL != er)
+				errx(EXIT_FAILURE, "-g %s: bad group", optarg);
+			break;
+		case ('i'):
+			search = optarg;
+			break;
+		case ('j'):
+			jobs = strtonum(optarg, 1, INT_MAX, &er);
+			if (NULL != er)
+				errx(EXIT_FAILURE, "-j %s: %s", optarg, er);
+			break;
+		case ('K'):
+			p.snapshot = optarg;
+			break;
+		case ('l'):
+			levels = 1;
+			break;
+		case ('M'):
+			mfile = optarg;
+			break;
+		case ('o'):
+			out = optarg;
+			break;
+		case ('p'):
+			opts.prefix = optarg;
+			break;
+		case ('r'):
+			opts.reach = 1;
+			break;
+		case ('S'):
+			stream = 1;
+			break;
+		case ('s'):
+			opts.pagesz = strtonum(optarg, 512, 65536, &er);
+			if (NULL != er || (opts.pagesz & (opts.pagesz - 1)))
+				errx(EXIT_FAILURE, "-s %s: bad page size", optarg);
+			break;
+		case ('T'):
+			trace = optarg;
+			break;
 		case ('v'):
 			p.verbose = 1;
 			break;
+		case ('x'):
+			if ( ! sqlite_schema_limit(&lim, optarg))
+				return(EXIT_FAILURE);
+			break;
+		case ('z'):
+			if ( ! sqlite_schema_stats(&stats, optarg))
+				return(EXIT_FAILURE);
+			opts.stats = &stats;
+			break;
 		default:
 			goto usage;
 		}
@@ -277,18 +1802,130 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
+	if (NULL != out && NULL != dir)
+		goto usage;
+	if (NULL != mfile && (argc > 0 || stream || fp ||
+	    NULL != plan || NULL != log || NULL != stats.ents ||
+	    NULL != out || NULL != dir || NULL != search ||
+	    NULL != p.snapshot))
+		goto usage;
+	if (stream && (fp || opts.reach || levels || cascade ||
+	    NULL != plan || NULL != log || NULL != p.snapshot ||
+	    NULL != dir || NULL != search))
+		goto usage;
+
+	if (NULL != trace && ! sqlite_schema_trace_open(trace))
+		return(EXIT_FAILURE);
+
+	if (NULL != mfile) {
+		memset(&m, 0, sizeof(struct manifest));
+		m.opts = &opts;
+		m.levels = levels;
+		m.cascade = cascade;
+		m.verbose = p.verbose;
+		m.lim = &lim;
+		rc = manifest_read(&m, mfile) && manifest(&m, jobs);
+		manifest_free(&m);
+		sqlite_schema_stats_free(&stats);
+		if ( ! sqlite_schema_trace_close())
+			rc = 0;
+		return(rc ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	if (stream) {
+		memset(&cb, 0, sizeof(struct parsecb));
+		cb.tab_end = stream_tab;
+		cb.arg = &opts;
+		cb.stream = 1;
+		p.cb = &cb;
+		if (NULL != out)
+			opts.f = sqlite_schema_fopen(&of, out);
+		fputs("<dl class=\"tabs\">\n", opts.f);
+		if (0 == argc)
+			rc = sqlite_schema_parsestdin(&p);
+		else 
+			rc = sqlite_schema_parsefile(argv[0], &p);
+		fputs("</dl>\n", opts.f);
+		if (NULL != out && rc)
+			sqlite_schema_fclose(&of);
+		else if (NULL != out)
+			sqlite_schema_fabort(&of);
+		sqlite_schema_free(&p);
+		sqlite_schema_stats_free(&stats);
+		free(opts.fkeys);
+		if ( ! sqlite_schema_trace_close())
+			rc = 0;
+		return(rc ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
 	if (0 == argc)
 		rc = sqlite_schema_parsestdin(&p);
 	else 
 		rc = sqlite_schema_parsefile(argv[0], &p);
 
-	if (rc > 0)
-		output(&opts, &p);
+	if (rc > 0 && NULL != plan) {
+		if ( ! sqlite_schema_plans(&p, plan, &plans))
+			rc = 0;
+		opts.plans = &plans;
+	}
+	if (rc > 0 && NULL != log) {
+		if ( ! sqlite_schema_access(&p, log, jobs, &access))
+			rc = 0;
+		opts.access = &access;
+	}
+
+	if (rc > 0 && fp) {
+		sqlite_schema_fingerprint_print(stdout, &p);
+	} else if (rc > 0) {
+		opts.p = &p;
+		if (NULL != out)
+			opts.f = sqlite_schema_fopen(&of, out);
+		if (opts.reach)
+			reach_init(&r, &p);
+		if (levels) {
+			levels_init(&l, &p);
+			opts.levels = &l;
+		}
+		if (cascade) {
+			sqlite_schema_cascade_init(&p, &casc);
+			opts.cascade = &casc;
+		}
+		if (NULL != dir) {
+			pages_init(&opts, &p, group);
+			output_pages(&opts, &p, 
+				opts.reach ? &r : NULL, dir, css);
+		} else
+			output_tabs(&opts, 0, p.ntab, 
+				opts.reach ? &r : NULL);
+		if (NULL != out)
+			sqlite_schema_fclose(&of);
+		if (NULL != search)
+			output_search(&opts, &p, search);
+		if (NULL != dir)
+			pages_free(&opts, &p);
+		if (opts.reach)
+			reach_free(&r);
+		if (levels)
+			levels_free(&l);
+		if (cascade)
+			sqlite_schema_cascade_free(&casc);
+	}
 
 	sqlite_schema_free(&p);
+	sqlite_schema_stats_free(&stats);
+	sqlite_schema_plans_free(&plans);
+	sqlite_schema_access_free(&access);
+	if ( ! sqlite_schema_trace_close())
+		rc = 0;
 	return(rc ? EXIT_SUCCESS : EXIT_FAILURE);
 
 usage:
-	fprintf(stderr, "usage: %s [-v] file\n", getprogname());
+	fprintf(stderr, "usage: %s [-CFlrSv] [-a log] [-c css] [-d dir] "
+		"[-E plans] [-g group] [-i index] [-j jobs] "
+		"[-K snapshot] [-o file] "
+		"[-p prefix] [-s pagesize] [-T trace] [-x limit=value] "
+		"[-z stats] file\n"
+		"       %s [-Clrv] [-j jobs] [-p prefix] [-s pagesize] "
+		"[-T trace] [-x limit=value] -M manifest\n", getprogname(), getprogname());
 	return(EXIT_FAILURE);
 }
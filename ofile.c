@@ -0,0 +1,206 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <sys/stat.h>
+
+#include <err.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+static	pthread_once_t	 masked = PTHREAD_ONCE_INIT;
+static	mode_t		 mask;
+
+/*
+ * Read the umask, which may only be done by setting it, so only once
+ * lest threads opening files at once see each other's.
+ */
+static void
+ofile_mask(void)
+{
+
+	mask = umask(0);
+	umask(mask);
+}
+
+/*
+ * Release what sqlite_schema_fopen_warn() allocated.
+ */
+static void
+ofile_free(struct ofile *o)
+{
+
+	free(o->tmp);
+	free(o->path);
+	o->f = NULL;
+	o->tmp = o->path = NULL;
+}
+
+/*
+ * Open "path" for writing by way of a temporary file beside it, so that
+ * sqlite_schema_fclose_warn() may atomically replace it.
+ * Returns NULL (having warned) if the file can't be created.
+ */
+FILE *
+sqlite_schema_fopen_warn(struct ofile *o, const char *path)
+{
+	int	 fd;
+
+	if (NULL == (o->path = strdup(path)))
+		err(EXIT_FAILURE, "strdup");
+	if (-1 == asprintf(&o->tmp, "%s.XXXXXXXXXX", path))
+		err(EXIT_FAILURE, "asprintf");
+	if (-1 == (fd = mkstemp(o->tmp))) {
+		warn("%s", o->tmp);
+		ofile_free(o);
+		return(NULL);
+	}
+
+	/* mkstemp(3) creates the file private to us. */
+
+	pthread_once(&masked, ofile_mask);
+	if (-1 == fchmod(fd, 0666 & ~mask) ||
+	    NULL == (o->f = fdopen(fd, "w+"))) {
+		warn("%s", o->tmp);
+		close(fd);
+		unlink(o->tmp);
+		ofile_free(o);
+		return(NULL);
+	}
+	return(o->f);
+}
+
+/*
+ * As sqlite_schema_fopen_warn(), but exits on failure.
+ */
+FILE *
+sqlite_schema_fopen(struct ofile *o, const char *path)
+{
+	FILE	*f;
+
+	if (NULL == (f = sqlite_schema_fopen_warn(o, path)))
+		exit(EXIT_FAILURE);
+	return(f);
+}
+
+/*
+ * Whether the written file has the same contents as "path".
+ */
+static int
+ofile_same(struct ofile *o)
+{
+	struct stat	 st;
+	char		 buf1[BUFSIZ], buf2[BUFSIZ];
+	size_t		 sz;
+	FILE		*f;
+	int		 same;
+
+	if (-1 == stat(o->path, &st) || ! S_ISREG(st.st_mode) ||
+	    st.st_size != ftello(o->f))
+		return(0);
+	if (NULL == (f = fopen(o->path, "r")))
+		return(0);
+
+	rewind(o->f);
+	for (same = 1; same; ) {
+		sz = fread(buf1, 1, sizeof(buf1), o->f);
+		if (sz != fread(buf2, 1, sizeof(buf2), f) ||
+		    memcmp(buf1, buf2, sz))
+			same = 0;
+		else if (sz < sizeof(buf1))
+			break;
+	}
+	if (ferror(o->f) || ferror(f))
+		same = 0;
+
+	fclose(f);
+	return(same);
+}
+
+/*
+ * Finish a file opened with sqlite_schema_fopen_warn().
+ * If its contents are unchanged, the original is left untouched (along
+ * with its modification time); otherwise, it's atomically replaced.
+ * Returns zero if the file was unchanged, one if replaced, or -1 (having
+ * warned and removed the temporary file) on failure.
+ */
+int
+sqlite_schema_fclose_warn(struct ofile *o)
+{
+	int	 	 same, rc;
+	uint64_t	 start = sqlite_schema_trace_now();
+
+	if (EOF == fflush(o->f) || ferror(o->f)) {
+		warnx("%s: write error", o->path);
+		fclose(o->f);
+		unlink(o->tmp);
+		ofile_free(o);
+		return(-1);
+	}
+
+	same = ofile_same(o);
+	rc = ! same;
+
+	if (EOF == fclose(o->f)) {
+		warnx("%s: write error", o->path);
+		unlink(o->tmp);
+		rc = -1;
+	} else if (same && -1 == unlink(o->tmp)) {
+		warn("%s", o->tmp);
+		rc = -1;
+	} else if ( ! same && -1 == rename(o->tmp, o->path)) {
+		warn("%s", o->path);
+		unlink(o->tmp);
+		rc = -1;
+	}
+	if (rc >= 0)
+		sqlite_schema_trace("io", "close", o->path, start);
+
+	ofile_free(o);
+	return(rc);
+}
+
+/*
+ * As sqlite_schema_fclose_warn(), but exits on failure.
+ */
+int
+sqlite_schema_fclose(struct ofile *o)
+{
+	int	 rc;
+
+	if (-1 == (rc = sqlite_schema_fclose_warn(o)))
+		exit(EXIT_FAILURE);
+	return(rc);
+}
+
+/*
+ * Discard a file opened with sqlite_schema_fopen(), leaving the
+ * original untouched.
+ */
+void
+sqlite_schema_fabort(struct ofile *o)
+{
+
+	fclose(o->f);
+	if (-1 == unlink(o->tmp))
+		warn("%s", o->tmp);
+	ofile_free(o);
+}
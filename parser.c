@@ -15,16 +15,20 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 #include <sys/mman.h>
-#include <sys/queue.h>
 #include <sys/stat.h>
 
 #include <ctype.h>
+#include <dirent.h>
 #include <err.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "extern.h"
@@ -36,11 +40,188 @@ enum	tokent {
 	TOK_IDENT
 };
 
+/*
+ * Keywords are classified once, when the token is read, by way of a
+ * perfect hash over the first two characters, the last character, and
+ * the length of the (case-folded) word.
+ * The table below is laid out by the compiler using designated
+ * initialisers on KWHASH(), so adding a keyword means adding it to the
+ * enumeration (in extern.h), to kwnames, and to kwtab.
+ * Collisions are reported by -Woverride-init (part of -W).
+ */
+#define	KWHASH_SIZE	 256
+#define	KWHASH_MAXSZ	 13
+#define	KWHASH(_a, _b, _z, _sz) \
+	((((_a) * 156) ^ ((_b) * 19) ^ \
+	  ((_z) * 202) ^ ((_sz) * 15)) % KWHASH_SIZE)
+
+const char *const fkacts[FKACT__MAX] = {
+	"no action", /* FKACT_NONE */
+	"restrict", /* FKACT_RESTRICT */
+	"set null", /* FKACT_SETNULL */
+	"set default", /* FKACT_SETDEFAULT */
+	"cascade", /* FKACT_CASCADE */
+};
+
+static	const char *const kwnames[KW__MAX] = {
+	NULL, /* KW_NONE */
+	"(", /* KW_LPAREN */
+	")", /* KW_RPAREN */
+	",", /* KW_COMMA */
+	";", /* KW_SEMI */
+	"action",
+	"add",
+	"all",
+	"alter",
+	"as",
+	"asc",
+	"autoincrement",
+	"cascade",
+	"check",
+	"collate",
+	"column",
+	"constraint",
+	"create",
+	"cross",
+	"default",
+	"delete",
+	"desc",
+	"distinct",
+	"do",
+	"drop",
+	"except",
+	"exists",
+	"foreign",
+	"from",
+	"full",
+	"generated",
+	"group",
+	"having",
+	"if",
+	"index",
+	"indexed",
+	"inner",
+	"insert",
+	"intersect",
+	"into",
+	"join",
+	"key",
+	"left",
+	"limit",
+	"natural",
+	"no",
+	"not",
+	"null",
+	"on",
+	"or",
+	"order",
+	"outer",
+	"primary",
+	"references",
+	"rename",
+	"replace",
+	"restrict",
+	"returning",
+	"right",
+	"rowid",
+	"select",
+	"set",
+	"strict",
+	"table",
+	"temp",
+	"temporary",
+	"to",
+	"union",
+	"unique",
+	"update",
+	"using",
+	"values",
+	"where",
+	"window",
+	"with",
+	"without",
+};
+
+static	const enum kw kwtab[KWHASH_SIZE] = {
+	[KWHASH('a', 'c', 'n', 6)] = KW_ACTION,
+	[KWHASH('a', 'd', 'd', 3)] = KW_ADD,
+	[KWHASH('a', 'l', 'l', 3)] = KW_ALL,
+	[KWHASH('a', 'l', 'r', 5)] = KW_ALTER,
+	[KWHASH('a', 's', 's', 2)] = KW_AS,
+	[KWHASH('a', 's', 'c', 3)] = KW_ASC,
+	[KWHASH('a', 'u', 't', 13)] = KW_AUTOINCREMENT,
+	[KWHASH('c', 'a', 'e', 7)] = KW_CASCADE,
+	[KWHASH('c', 'h', 'k', 5)] = KW_CHECK,
+	[KWHASH('c', 'o', 'e', 7)] = KW_COLLATE,
+	[KWHASH('c', 'o', 'n', 6)] = KW_COLUMN,
+	[KWHASH('c', 'o', 't', 10)] = KW_CONSTRAINT,
+	[KWHASH('c', 'r', 'e', 6)] = KW_CREATE,
+	[KWHASH('c', 'r', 's', 5)] = KW_CROSS,
+	[KWHASH('d', 'e', 't', 7)] = KW_DEFAULT,
+	[KWHASH('d', 'e', 'e', 6)] = KW_DELETE,
+	[KWHASH('d', 'e', 'c', 4)] = KW_DESC,
+	[KWHASH('d', 'i', 't', 8)] = KW_DISTINCT,
+	[KWHASH('d', 'o', 'o', 2)] = KW_DO,
+	[KWHASH('d', 'r', 'p', 4)] = KW_DROP,
+	[KWHASH('e', 'x', 't', 6)] = KW_EXCEPT,
+	[KWHASH('e', 'x', 's', 6)] = KW_EXISTS,
+	[KWHASH('f', 'o', 'n', 7)] = KW_FOREIGN,
+	[KWHASH('f', 'r', 'm', 4)] = KW_FROM,
+	[KWHASH('f', 'u', 'l', 4)] = KW_FULL,
+	[KWHASH('g', 'e', 'd', 9)] = KW_GENERATED,
+	[KWHASH('g', 'r', 'p', 5)] = KW_GROUP,
+	[KWHASH('h', 'a', 'g', 6)] = KW_HAVING,
+	[KWHASH('i', 'f', 'f', 2)] = KW_IF,
+	[KWHASH('i', 'n', 'x', 5)] = KW_INDEX,
+	[KWHASH('i', 'n', 'd', 7)] = KW_INDEXED,
+	[KWHASH('i', 'n', 'r', 5)] = KW_INNER,
+	[KWHASH('i', 'n', 't', 6)] = KW_INSERT,
+	[KWHASH('i', 'n', 't', 9)] = KW_INTERSECT,
+	[KWHASH('i', 'n', 'o', 4)] = KW_INTO,
+	[KWHASH('j', 'o', 'n', 4)] = KW_JOIN,
+	[KWHASH('k', 'e', 'y', 3)] = KW_KEY,
+	[KWHASH('l', 'e', 't', 4)] = KW_LEFT,
+	[KWHASH('l', 'i', 't', 5)] = KW_LIMIT,
+	[KWHASH('n', 'a', 'l', 7)] = KW_NATURAL,
+	[KWHASH('n', 'o', 'o', 2)] = KW_NO,
+	[KWHASH('n', 'o', 't', 3)] = KW_NOT,
+	[KWHASH('n', 'u', 'l', 4)] = KW_NULL,
+	[KWHASH('o', 'n', 'n', 2)] = KW_ON,
+	[KWHASH('o', 'r', 'r', 2)] = KW_OR,
+	[KWHASH('o', 'r', 'r', 5)] = KW_ORDER,
+	[KWHASH('o', 'u', 'r', 5)] = KW_OUTER,
+	[KWHASH('p', 'r', 'y', 7)] = KW_PRIMARY,
+	[KWHASH('r', 'e', 's', 10)] = KW_REFERENCES,
+	[KWHASH('r', 'e', 'e', 6)] = KW_RENAME,
+	[KWHASH('r', 'e', 'e', 7)] = KW_REPLACE,
+	[KWHASH('r', 'e', 't', 8)] = KW_RESTRICT,
+	[KWHASH('r', 'e', 'g', 9)] = KW_RETURNING,
+	[KWHASH('r', 'i', 't', 5)] = KW_RIGHT,
+	[KWHASH('r', 'o', 'd', 5)] = KW_ROWID,
+	[KWHASH('s', 'e', 't', 6)] = KW_SELECT,
+	[KWHASH('s', 'e', 't', 3)] = KW_SET,
+	[KWHASH('s', 't', 't', 6)] = KW_STRICT,
+	[KWHASH('t', 'a', 'e', 5)] = KW_TABLE,
+	[KWHASH('t', 'e', 'p', 4)] = KW_TEMP,
+	[KWHASH('t', 'e', 'y', 9)] = KW_TEMPORARY,
+	[KWHASH('t', 'o', 'o', 2)] = KW_TO,
+	[KWHASH('u', 'n', 'n', 5)] = KW_UNION,
+	[KWHASH('u', 'n', 'e', 6)] = KW_UNIQUE,
+	[KWHASH('u', 'p', 'e', 6)] = KW_UPDATE,
+	[KWHASH('u', 's', 'g', 5)] = KW_USING,
+	[KWHASH('v', 'a', 's', 6)] = KW_VALUES,
+	[KWHASH('w', 'h', 'e', 5)] = KW_WHERE,
+	[KWHASH('w', 'i', 'w', 6)] = KW_WINDOW,
+	[KWHASH('w', 'i', 'h', 4)] = KW_WITH,
+	[KWHASH('w', 'i', 't', 7)] = KW_WITHOUT,
+};
+
 struct	token {
 	const char	*start;
 	size_t		 sz;
 	int		 eof;
 	enum tokent	 type;
+	enum kw		 kw;
 };
 
 static	void dowarnx(const struct parse *, const char *, ...)
@@ -49,6 +230,9 @@ static	void dogwarnx(const struct parse *, const char *, ...)
 	__attribute__((format(printf, 2, 3)));
 static	void domsg(const struct parse *, const char *, ...)
 	__attribute__((format(printf, 2, 3)));
+static	void comment_free(struct parse *, char *);
+static	int columns(struct parse *, struct tab *, uint32_t *);
+static	void table_indices(struct parse *, struct tab *);
 
 /*
  * Emit some debugging information.
@@ -101,6 +285,120 @@ dowarnx(const struct parse *p, const char *fmt, ...)
 	fputc('\n', stderr);
 }
 
+static uint64_t
+msecs(void)
+{
+	struct timespec	 ts;
+
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &ts))
+		err(EXIT_FAILURE, "clock_gettime");
+	return((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/*
+ * Fail the parse for exceeding a limit or, if "max" is zero, for
+ * running out of "what" altogether.
+ * Once failed, no more tokens are read, so the parse unwinds as if at
+ * the end of the file, and is then failed.
+ */
+static int
+limit_fail(struct parse *p, const char *what, size_t max)
+{
+
+	if (p->limited)
+		return(0);
+	if (0 == max)
+		dowarnx(p, "out of %s", what);
+	else
+		dowarnx(p, "%s limit of %zu exceeded", what, max);
+	p->limited = 1;
+	return(0);
+}
+
+/*
+ * Check the time limit.
+ * Return zero if exceeded.
+ */
+static int
+limit_time(struct parse *p)
+{
+
+	if (p->limited)
+		return(0);
+	if (0 != p->deadline && msecs() > p->deadline)
+		return(limit_fail(p, "time", p->lim->msecs));
+	return(1);
+}
+
+/*
+ * Check the limits at the beginning of each statement.
+ * Time is only checked here and while resolving: statements are
+ * otherwise bounded by their size, if limited.
+ * Return zero if exceeded.
+ */
+static int
+limit_stmt(struct parse *p)
+{
+
+	p->stmt = p->i;
+	if (NULL == p->lim)
+		return( ! p->limited);
+	return(limit_time(p));
+}
+
+/*
+ * Check the limits before each token.
+ * Return zero if exceeded.
+ */
+static int
+limit_tok(struct parse *p)
+{
+
+	if (p->limited)
+		return(0);
+	if (NULL != p->lim && 0 != p->lim->stmt && 
+	    p->i - p->stmt > p->lim->stmt)
+		return(limit_fail(p, "stmt", p->lim->stmt));
+	return(1);
+}
+
+/*
+ * Check parentheses nested "nest" deep.
+ * Return zero if exceeded.
+ */
+static int
+limit_nest(struct parse *p, size_t nest)
+{
+
+	if (NULL == p->lim || 0 == p->lim->depth ||
+	    nest <= p->lim->depth)
+		return(1);
+	return(limit_fail(p, "depth", p->lim->depth));
+}
+
+/*
+ * Look up a word in the keyword table.
+ * Matching is exact and case-insensitive.
+ * Returns KW_NONE if the word is not a keyword.
+ */
+enum kw
+sqlite_schema_keyword(const char *cp, size_t sz)
+{
+	enum kw	 kw;
+
+	if (sz < 2 || sz > KWHASH_MAXSZ)
+		return(KW_NONE);
+
+	kw = kwtab[KWHASH(tolower((unsigned char)cp[0]),
+		tolower((unsigned char)cp[1]),
+		tolower((unsigned char)cp[sz - 1]), sz)];
+
+	if (KW_NONE == kw || strlen(kwnames[kw]) != sz ||
+	    strncasecmp(kwnames[kw], cp, sz))
+		return(KW_NONE);
+	return(kw);
+}
+
 static size_t
 tok_nextchar(struct parse *p, size_t n)
 {
@@ -149,6 +447,9 @@ tok_next(struct token *tok, struct parse *p, int eofok)
 	memset(tok, 0, sizeof(struct token));
 	tok->type = TOK_EOF;
 
+	if ( ! limit_tok(p))
+		return(0);
+
 	tok_skipws(p);
 	if (p->i == p->len) {
 		tok->eof = 1;
@@ -158,7 +459,7 @@ tok_next(struct token *tok, struct parse *p, int eofok)
 	}
 
 
-	if ('/' == p->map[p->i] && p->i < p->len - 2 && 
+	if ('/' == p->map[p->i] && p->i + 2 < p->len && 
 	    '*' == p->map[p->i + 1]) {
 		/* 
 		 * Are we in a multi-line comment?
@@ -167,7 +468,7 @@ tok_next(struct token *tok, struct parse *p, int eofok)
 		 */
 		tok_nextchar(p, 2);
 		tok_init(tok, p);
-		while (p->i < p->len - 2) {
+		while (p->i + 2 < p->len) {
 			if ('*' == p->map[p->i] &&
 			    '/' == p->map[p->i + 1])
 				break;
@@ -197,7 +498,7 @@ tok_next(struct token *tok, struct parse *p, int eofok)
 					p->map[save] = ' ';
 				}
 				/* Blank after newline-asterisk. */
-				if (p->i < p->len - 1 && 
+				if (p->i + 1 < p->len && 
 				    '*' == p->map[p->i] &&
 				    '/' != p->map[p->i + 1]) {
 					save = p->i;
@@ -212,7 +513,7 @@ tok_next(struct token *tok, struct parse *p, int eofok)
 				tok->sz++;
 			}
 		}
-		if (p->i == p->len - 2) {
+		if (p->i + 2 == p->len) {
 			tok->eof = 1;
 			if ( ! eofok)
 				dowarnx(p, "unexpected eof");
@@ -221,7 +522,7 @@ tok_next(struct token *tok, struct parse *p, int eofok)
 		tok_nextchar(p, 2);
 		tok->type = TOK_COMMENT;
 		return(1);
-	} else if ('-' == p->map[p->i] && p->i < p->len - 2 && 
+	} else if ('-' == p->map[p->i] && p->i + 2 < p->len && 
 	           '-' == p->map[p->i + 1]) {
 		/*
 		 * Are we in a single-line comment?
@@ -278,81 +579,172 @@ tok_next(struct token *tok, struct parse *p, int eofok)
 	tok->sz++;
 	tok->type = TOK_IDENT;
 
-	if ('(' == p->map[p->i - 1] ||
-	    ',' == p->map[p->i - 1] ||
-	    ')' == p->map[p->i - 1] ||
-	    ';' == p->map[p->i - 1])
+	switch (p->map[p->i - 1]) {
+	case ('('):
+		tok->kw = KW_LPAREN;
+		return(1);
+	case (')'):
+		tok->kw = KW_RPAREN;
+		return(1);
+	case (','):
+		tok->kw = KW_COMMA;
+		return(1);
+	case (';'):
+		tok->kw = KW_SEMI;
 		return(1);
+	default:
+		break;
+	}
 
 	while (p->i < p->len && ! isspace((int)p->map[p->i])) {
 		if ('(' == p->map[p->i] ||
 		    ',' == p->map[p->i] ||
 		    ')' == p->map[p->i] ||
-		    ';' == p->map[p->i])
+		    ';' == p->map[p->i] ||
+		    '\'' == p->map[p->i] ||
+		    '"' == p->map[p->i])
 			break;
 		tok_nextchar(p, 1);
 		tok->sz++;
 	}
 
+	tok->kw = sqlite_schema_keyword(tok->start, tok->sz);
 	return(1);
 }
 
-static int
-tok_strsame(const struct token *tok, const char *str)
-{
-
-	if (0 == tok->sz)
-		return(0);
-	return(0 == strncasecmp(str, tok->start, tok->sz));
-}
-
+/*
+ * Skip past the semicolon ending the current statement.
+ * This is used for the bulk of dump files (insertions), so instead of
+ * tokenising, only look at bytes that may begin a quote, a comment, or
+ * end the statement, then jump over quotes and comments by searching
+ * for their end.
+ * Doubled quotes within a quote are read as two adjacent quotes.
+ * Line and column are computed once at the end.
+ */
 static void
 tok_skipstmt(struct parse *p)
 {
-	struct token	 tok;
+	static const unsigned char special[256] = {
+		[';'] = 1, ['\''] = 1, ['"'] = 1, ['`'] = 1,
+		['['] = 1, ['-'] = 1, ['/'] = 1,
+	};
+	const char	*cp, *start, *end, *nl;
+	char		 c;
+	int		 semi = 0;
+
+	start = cp = &p->map[p->i];
+	end = &p->map[p->len];
+
+	while (cp < end) {
+		while (cp < end && ! special[(unsigned char)*cp])
+			cp++;
+		if (cp == end)
+			break;
+		switch ((c = *cp++)) {
+		case (';'):
+			semi = 1;
+			goto out;
+		case ('['):
+			c = ']';
+			/* FALLTHROUGH */
+		case ('\''):
+		case ('"'):
+		case ('`'):
+			cp = memchr(cp, c, end - cp);
+			cp = NULL == cp ? end : cp + 1;
+			break;
+		case ('-'):
+			if (cp == end || '-' != *cp)
+				break;
+			cp = memchr(cp, '\n', end - cp);
+			cp = NULL == cp ? end : cp + 1;
+			break;
+		case ('/'):
+			if (cp == end || '*' != *cp)
+				break;
+			for (cp++; cp < end; cp++) {
+				cp = memchr(cp, '*', end - cp);
+				if (NULL == cp || cp + 1 == end) {
+					cp = end;
+					break;
+				} else if ('/' == cp[1]) {
+					cp += 2;
+					break;
+				}
+			}
+			break;
+		default:
+			abort();
+		}
+	}
+out:
+	/* As in tok_nextchar(), a newline itself counts as a column. */
 
-	do {
-		do if ( ! tok_next(&tok, p, 0)) 
-			return;
-		while (TOK_COMMENT == tok.type);
-	} while ( ! tok_strsame(&tok, ";"));
+	for (nl = start; NULL != (nl = memchr(nl, '\n', cp - nl)); ) {
+		p->line++;
+		p->col = 0;
+		start = nl++;
+	}
+	p->col += cp - start;
+	p->i = cp - p->map;
+
+	if ( ! limit_tok(p))
+		return;
+	if ( ! semi)
+		dowarnx(p, "unexpected eof");
 }
 
 static int
 tok_nextsame(struct token *tok, struct parse *p, 
-	const char *str, int eofok)
+	enum kw kw, int eofok)
 {
 
 	do if ( ! tok_next(tok, p, eofok)) 
 		return(-1);
 	while (TOK_COMMENT == tok->type);
 
-	if (TOK_LITERAL == tok->type)
-		return(0);
-	return(tok_strsame(tok, str));
+	return(kw == tok->kw);
 }
 
 static int
-tok_nextexpect(struct token *tok, struct parse *p, const char *str)
+tok_nextexpect(struct token *tok, struct parse *p, enum kw kw)
 {
 	int	 c;
 
-	if ((c = tok_nextsame(tok, p, str, 0)) > 0)
+	if ((c = tok_nextsame(tok, p, kw, 0)) > 0)
 		return(1);
 	else if (c < 0)
 		return(0);
 
 	dowarnx(p, "unexpected: %.*s (wanted \"%s\")", 
-		(int)tok->sz, tok->start, str);
+		(int)tok->sz, tok->start, kwnames[kw]);
 	return(0);
 }
 
+/*
+ * The extent of a token in the source, which for literals includes the
+ * quotation marks.
+ */
+static const char *
+tok_rawstart(const struct token *tok)
+{
+
+	return(TOK_LITERAL == tok->type ? tok->start - 1 : tok->start);
+}
+
+static const char *
+tok_rawend(const struct token *tok)
+{
+
+	return(tok->start + tok->sz + (TOK_LITERAL == tok->type));
+}
+
 static int
 comment_append(struct token *tok, struct parse *p, 
 	int eofok, char **outp)
 {
-	char	*comment;
-	size_t	 sz;
+	char	*comment, *cp;
+	size_t	 sz, len;
 
 	*outp = NULL;
 	comment = NULL;
@@ -360,24 +752,21 @@ comment_append(struct token *tok, struct parse *p,
 
 	for (;;) {
 		if ( ! tok_next(tok, p, eofok)) {
-			free(comment);
+			comment_free(p, comment);
 			return(0);
 		} else if (TOK_COMMENT != tok->type)
 			break;
 
-		if (NULL == comment) {
-			comment = strndup(tok->start, tok->sz);
-			if (NULL == comment)
-				err(EXIT_FAILURE, "strndup");
-			sz = strlen(comment);
-		} else {
-			comment = realloc(comment, sz + tok->sz + 1);
-			if (NULL == comment)
-				err(EXIT_FAILURE, "realloc");
-			memcpy(comment + sz, tok->start, tok->sz);
-			sz += tok->sz;
-			comment[sz] = '\0';
+		len = strnlen(tok->start, tok->sz);
+		if (NULL == (cp = sqlite_schema_realloc(p, comment,
+		    NULL == comment ? 0 : sz + 1, sz + len + 1, 1))) {
+			comment_free(p, comment);
+			return(0);
 		}
+		comment = cp;
+		memcpy(comment + sz, tok->start, len);
+		sz += len;
+		comment[sz] = '\0';
 	}
 
 	*outp = comment;
@@ -385,407 +774,2681 @@ comment_append(struct token *tok, struct parse *p,
 }
 
 /*
- * Process what comes after "references" within a column declaration.
- * Return zero on failure and non-zero on success.
+ * Tables, columns, indices, and foreign keys are kept in arrays, each
+ * doubled when full, and their strings likewise in one buffer: they're
+ * laid out contiguously in the order parsed, without per-allocation
+ * overhead, and refer to each other by index and offset, so may move as
+ * the arrays grow.
+ * Arrays no larger than ARRAY_KEEPSZ are kept for the next parse when
+ * reset.
  */
-static int
-schema_column_references(struct token *tok, 
-	struct parse *p, struct col *col)
-{
-	struct fkey	*fkey;
+#define	ARRAY_KEEPSZ	 (64 * 1024)
+#define	STRS_MINSZ	 4096
 
-	do if ( ! tok_next(tok, p, 0))
-		return(0);
-	while (TOK_COMMENT == tok->type);
+/*
+ * What the arrays held at some point of the parse, so that everything
+ * added after may be released with schema_release().
+ */
+struct	schemamark {
+	size_t		 ntab;
+	size_t		 ncol;
+	size_t		 nidx;
+	size_t		 nidxcol;
+	size_t		 nfkey;
+	size_t		 strsz;
+};
 
-	fkey = calloc(1, sizeof(struct fkey));
-	if (NULL == fkey)
-		err(EXIT_FAILURE, "calloc");
-	fkey->col = col;
-	fkey->rtab = strndup(tok->start, tok->sz);
-	if (NULL == fkey->rtab)
-		err(EXIT_FAILURE, "strndup");
-	TAILQ_INSERT_TAIL(&p->fkeyq, fkey, entry);
+/*
+ * Resize the buffer "buf" of "onmemb" elements of "size" bytes, which
+ * may be NULL, to "nmemb" elements, charging the difference to the
+ * memory limit.
+ * Exceeding the limit or running out of memory fails the parse as with
+ * limit_fail(), leaving "buf" as it was.
+ * Returns the buffer, which may have moved, or NULL on failure.
+ */
+void *
+sqlite_schema_realloc(struct parse *p, void *buf, size_t onmemb, 
+	size_t nmemb, size_t size)
+{
+	void	*nbuf;
 
-	if ( ! tok_nextexpect(tok, p, "("))
-		return(0);
-	do if ( ! tok_next(tok, p, 0))
-		return(0);
-	while (TOK_COMMENT == tok->type);
+	if (nmemb > onmemb && NULL != p->lim && 0 != p->lim->mem &&
+	    p->mem + (nmemb - onmemb) * size > p->lim->mem) {
+		limit_fail(p, "mem", p->lim->mem);
+		return(NULL);
+	}
+	if (NULL == (nbuf = reallocarray(buf, nmemb, size))) {
+		limit_fail(p, "memory", 0);
+		return(NULL);
+	}
+	p->mem -= onmemb * size;
+	p->mem += nmemb * size;
+	return(nbuf);
+}
 
-	fkey->rcol = strndup(tok->start, tok->sz);
-	if (NULL == fkey->rcol)
-		err(EXIT_FAILURE, "strndup");
+/*
+ * Free the buffer "buf" of "nmemb" elements of "size" bytes from
+ * sqlite_schema_realloc().
+ */
+void
+sqlite_schema_dealloc(struct parse *p, void *buf, size_t nmemb, 
+	size_t size)
+{
 
-	domsg(p, "added reference to %s.%s: %s.%s",
-		col->tab->name, col->name,
-		fkey->rtab, fkey->rcol);
-	return(tok_nextexpect(tok, p, ")"));
+	free(buf);
+	p->mem -= nmemb * size;
 }
 
 /*
- * Process what follows "foreign" as a column constraint, e.g., "foreign
- * key (moop) references foo(bar)".
- * Return zero on failure and non-zero on success.
+ * Make room for element "n" of the array "arr" of "*max" elements of
+ * "sz" bytes, doubling it if full.
+ * Returns the array, which may have moved, with element "n" zeroed; or
+ * NULL if the parse failed, "arr" being unchanged.
  */
-static int
-schema_foreign(struct token *tok, struct parse *p, struct tab *tab)
+static void *
+array_grow(struct parse *p, void *arr, size_t n, size_t *max, size_t sz)
 {
-	struct col	*tcol;
-	struct fkey	*fkey = NULL;
-
-	if ( ! tok_nextexpect(tok, p, "key"))
-		return(0);
-	if ( ! tok_nextexpect(tok, p, "("))
-		return(0);
+	size_t	 nmax;
 
-	/* Get and look up column name. */
+	if (n >= SCHEMA_NONE) {
+		limit_fail(p, "schema", SCHEMA_NONE);
+		return(NULL);
+	}
+	if (n == *max) {
+		nmax = 0 == *max ? 16 : *max * 2;
+		if (NULL == (arr = sqlite_schema_realloc(p, 
+		    arr, *max, nmax, sz)))
+			return(NULL);
+		*max = nmax;
+	}
+	memset((char *)arr + n * sz, 0, sz);
+	return(arr);
+}
 
-	do if ( ! tok_next(tok, p, 0))
-		return(0);
-	while (TOK_COMMENT == tok->type);
+/*
+ * Allocate a zeroed array of "n" elements of "sz" bytes to replace
+ * another with array_set().
+ * Returns NULL if the parse failed.
+ */
+static void *
+array_new(struct parse *p, size_t n, size_t sz)
+{
+	void	*arr;
 
-	TAILQ_FOREACH(tcol, &tab->colq, entry)
-		if ( ! strncmp(tcol->name, tok->start, tok->sz))
-			break;
+	if (NULL != (arr = sqlite_schema_realloc(p, NULL, 0, n + 1, sz)))
+		memset(arr, 0, (n + 1) * sz);
+	return(arr);
+}
 
-	if (NULL != tcol) {
-		fkey = calloc(1, sizeof(struct fkey));
-		if (NULL == fkey)
-			err(EXIT_FAILURE, "calloc");
-		fkey->col = tcol;
-		TAILQ_INSERT_TAIL(&p->fkeyq, fkey, entry);
-	} else
-		dowarnx(p, "cannot find column: %.*s",
-			(int)tok->sz, tok->start);
+/*
+ * Free the array "old" of "*max" elements of "sz" bytes, replacing it
+ * with "arr" from array_new() of "n" elements.
+ * Returns "arr".
+ */
+static void *
+array_set(struct parse *p, void *old, size_t *max, void *arr, size_t n,
+	size_t sz)
+{
 
-	if ( ! tok_nextexpect(tok, p, ")"))
-		return(0);
-	if ( ! tok_nextexpect(tok, p, "references"))
-		return(0);
+	sqlite_schema_dealloc(p, old, *max, sz);
+	*max = n + 1;
+	return(arr);
+}
 
-	/* Table name: keep if we have our column. */
+/*
+ * Shrink the array "arr" of "*max" elements of "sz" bytes to its "n".
+ */
+static void *
+array_fit(struct parse *p, void *arr, size_t n, size_t *max, size_t sz)
+{
+	void	*narr;
+
+	if (0 == n || n == *max)
+		return(arr);
+	if (NULL == (narr = reallocarray(arr, n, sz)))
+		return(arr);
+	p->mem -= (*max - n) * sz;
+	*max = n;
+	return(narr);
+}
 
-	do if ( ! tok_next(tok, p, 0)) 
-		return(0);
-	while (TOK_COMMENT == tok->type);
+/*
+ * Free the array "arr" of "*max" elements of "sz" bytes unless "keep"
+ * and it's small enough to keep for another parse.
+ * Returns the array or NULL.
+ */
+static void *
+array_free(struct parse *p, void *arr, size_t *max, size_t sz, int keep)
+{
 
-	if (NULL != fkey) {
-		fkey->rtab = strndup(tok->start, tok->sz);
-		if (NULL == fkey->rtab)
-			err(EXIT_FAILURE, "strndup");
+	if (keep && *max * sz <= ARRAY_KEEPSZ) {
+		p->mem += *max * sz;
+		return(arr);
 	}
+	free(arr);
+	*max = 0;
+	return(NULL);
+}
 
-	if ( ! tok_nextexpect(tok, p, "("))
-		return(0);
+/*
+ * Make room for a string of "sz" bytes and its terminator.
+ * Offset zero is never used, so it may stand for none.
+ * Returns the offset of the string, which is terminated; or zero if
+ * the parse failed.
+ */
+static uint32_t
+str_alloc(struct parse *p, size_t sz)
+{
+	size_t	 off, nmax;
+	char	*strs;
+
+	if (0 == p->strsz)
+		p->strsz = 1;
+	if (sz >= SCHEMA_NONE - p->strsz)
+		return(limit_fail(p, "schema", SCHEMA_NONE));
+	if (p->strsz + sz + 1 > p->strmax) {
+		nmax = 0 == p->strmax ? STRS_MINSZ : p->strmax * 2;
+		while (nmax < p->strsz + sz + 1)
+			nmax *= 2;
+		if (NULL == (strs = sqlite_schema_realloc(p, 
+		    p->strs, p->strmax, nmax, 1)))
+			return(0);
+		p->strs = strs;
+		p->strmax = nmax;
+		p->strs[0] = '\0';
+	}
+	off = p->strsz;
+	p->strsz += sz + 1;
+	p->strs[off + sz] = '\0';
+	return(off);
+}
 
-	/* Column name: keep if we have our column. */
+/*
+ * Add "sz" bytes of "cp", which mustn't be in the strings themselves.
+ * Returns its offset or zero if the parse failed.
+ */
+static uint32_t
+str_add(struct parse *p, const char *cp, size_t sz)
+{
+	uint32_t	 off;
 
-	do if ( ! tok_next(tok, p, 0))
-		return(0);
-	while (TOK_COMMENT == tok->type);
+	if (0 != (off = str_alloc(p, sz)))
+		memcpy(p->strs + off, cp, sz);
+	return(off);
+}
 
-	if (NULL != fkey) {
-		fkey->rcol = strndup(tok->start, tok->sz);
-		if (NULL == fkey->rcol)
-			err(EXIT_FAILURE, "strndup");
-	}
+/*
+ * Free the comment "cp", if not NULL, from comment_append().
+ */
+static void
+comment_free(struct parse *p, char *cp)
+{
 
-	if (NULL != tcol)
-		domsg(p, "added foreign key to %s.%s: %s.%s",
-			tcol->tab->name, tcol->name,
-			fkey->rtab, fkey->rcol);
-	return(tok_nextexpect(tok, p, ")"));
+	if (NULL != cp)
+		sqlite_schema_dealloc(p, cp, strlen(cp) + 1, 1);
 }
 
 /*
- * Returns <0 on failure, 0 if no more columns, 1 if more columns.
+ * Move the comment "cp", if not NULL, into the strings.
+ * Returns its offset or zero.
  */
-static int
-schema_column(struct token *tok, struct parse *p, struct tab *tab)
+static uint32_t
+str_move(struct parse *p, char *cp)
 {
-	size_t	 	 nest;
-	struct col	*col, *ncol;
-	char		*comment;
+	uint32_t	 off;
 
-	if ( ! comment_append(tok, p, 0, &comment))
-		return(-1);
+	if (NULL == cp)
+		return(0);
+	off = str_add(p, cp, strlen(cp));
+	comment_free(p, cp);
+	return(off);
+}
 
-	/* Check sub-clauses. */
+static void
+schema_mark(const struct parse *p, struct schemamark *m)
+{
 
-	if ( ! tok_strsame(tok, "unique") &&
-	     ! tok_strsame(tok, "foreign")) {
-		col = calloc(1, sizeof(struct col));
-		if (NULL == col)
-			err(EXIT_FAILURE, "calloc");
-		col->name = strndup(tok->start, tok->sz);
-		if (NULL == col->name)
-			err(EXIT_FAILURE, "strndup");
-		col->tab = tab;
-		col->idx = tab->ncol++;
-		col->comment = comment;
-		TAILQ_FOREACH(ncol, &tab->colq, entry)
-			if (strcmp(ncol->name, col->name) > 0)
-				break;
-		if (NULL != ncol)
-			TAILQ_INSERT_BEFORE(ncol, col, entry);
-		else
-			TAILQ_INSERT_TAIL(&tab->colq, col, entry);
-		domsg(p, "added column: %s.%s", 
-			col->tab->name, col->name);
-	} else {
-		free(comment);
-		col = NULL;
-	}
+	m->ntab = p->ntab;
+	m->ncol = p->ncol;
+	m->nidx = p->nidx;
+	m->nidxcol = p->nidxcol;
+	m->nfkey = p->nfkey;
+	m->strsz = p->strsz;
+}
 
-	if (tok_strsame(tok, "foreign"))
-		if ( ! schema_foreign(tok, p, tab))
-			return(0);
+static void
+schema_release(struct parse *p, const struct schemamark *m)
+{
 
-	for (nest = 1; nest > 0; ) {
-		do if ( ! tok_next(tok, p, 0))
-			return(-1);
-		while (TOK_COMMENT == tok->type);
+	p->ntab = m->ntab;
+	p->ncol = m->ncol;
+	p->nidx = m->nidx;
+	p->nidxcol = m->nidxcol;
+	p->nfkey = m->nfkey;
+	p->strsz = m->strsz;
+}
 
-		if (NULL != col && tok_strsame(tok, "references")) {
-			if ( ! schema_column_references(tok, p, col))
-				return(0);
-			continue;
-		}
-		if (tok_strsame(tok, "("))
-			nest++;
-		else if (tok_strsame(tok, ",") && 1 == nest)
-			break;
-		else if (tok_strsame(tok, ")"))
-			nest--;
-	}
+/*
+ * Allocate an index with the given flags.
+ * If "tab" is not NULL, the index is implied by a constraint of that
+ * table; otherwise, it's resolved by name once all tables have been
+ * parsed.
+ * Its columns are added right after with idx_addcol().
+ */
+static struct idx *
+idx_alloc(struct parse *p, const struct tab *tab, unsigned int flags)
+{
+	struct idx	*idx, *idxs;
+
+	if (NULL == (idxs = array_grow(p, p->idxs, 
+	    p->nidx, &p->idxmax, sizeof(struct idx))))
+		return(NULL);
+	p->idxs = idxs;
+	idx = &p->idxs[p->nidx];
+	idx->idx = p->nidx++;
+	idx->flags = flags;
+	idx->tab = NULL == tab ? SCHEMA_NONE : tab->idx;
+	idx->firstcol = p->nidxcol;
+	return(idx);
+}
 
-	if (tok_strsame(tok, ","))
-		return(1);
-	if (tok_strsame(tok, ")"))
-		return(0);
+/*
+ * Allocate a foreign key declared by "col".
+ * Returns NULL if the parse failed.
+ */
+static struct fkey *
+fkey_alloc(struct parse *p, const struct col *col)
+{
+	struct fkey	*fkey;
 
-	dowarnx(p, "syntax error trailing column");
-	return(-1);
+	if (NULL == (fkey = array_grow(p, p->fkeys, 
+	    p->nfkey, &p->fkeymax, sizeof(struct fkey))))
+		return(NULL);
+	p->fkeys = fkey;
+	fkey = &p->fkeys[p->nfkey++];
+	fkey->col = col - p->cols;
+	return(fkey);
 }
 
 /*
- * Parse a table definition.
- * Returns zero on failure, non-zero on success.
+ * Append a column to the index last allocated.
+ * If "name" is zero, the column is the expression "expr".
+ * Return zero if the parse failed.
  */
 static int
-schema_table(struct token *tok, struct parse *p, 
-	char **comment, unsigned int flags)
+idx_addcol(struct parse *p, struct idx *idx, uint32_t name, uint32_t expr)
 {
-	int	 	 c;
-	struct tab	*tab, *ntab;
-
-	/* Start trying to get the table identifier. */
+	struct idxcol	*ic;
+
+	if (NULL == (ic = array_grow(p, p->idxcols, 
+	    p->nidxcol, &p->idxcolmax, sizeof(struct idxcol))))
+		return(0);
+	p->idxcols = ic;
+	ic = &p->idxcols[p->nidxcol++];
+	ic->name = name;
+	ic->expr = expr;
+	ic->col = SCHEMA_NONE;
+	idx->ncols++;
+	return(1);
+}
+
+/*
+ * Parse the indexed columns of an index or table constraint, e.g.,
+ * "(a, b collate nocase desc, lower(c))", after the opening
+ * parenthesis has been read.
+ * A column is either a name, optionally followed by its collation and
+ * sort order, or an expression, which is recorded as-is without a name.
+ * Return zero on failure and non-zero on success.
+ */
+static int
+schema_idxcols(struct token *tok, struct parse *p, struct idx *idx)
+{
+	const char	*name, *start, *end;
+	size_t		 namesz, nest, ntok;
+	int		 expr;
+
+	for (;;) {
+		do if ( ! tok_next(tok, p, 0))
+			return(0);
+		while (TOK_COMMENT == tok->type);
+
+		if (KW_COMMA == tok->kw || KW_RPAREN == tok->kw) {
+			dowarnx(p, "syntax error in indexed columns");
+			return(0);
+		}
+
+		name = tok->start;
+		namesz = tok->sz;
+		start = tok_rawstart(tok);
+		end = tok_rawend(tok);
+		expr = nest = KW_LPAREN == tok->kw;
+
+		for (ntok = 1; ; ntok++) {
+			do if ( ! tok_next(tok, p, 0))
+				return(0);
+			while (TOK_COMMENT == tok->type);
+			if (0 == nest && (KW_COMMA == tok->kw ||
+			    KW_RPAREN == tok->kw))
+				break;
+			if (1 == ntok && KW_COLLATE != tok->kw &&
+			    KW_ASC != tok->kw && KW_DESC != tok->kw)
+				expr = 1;
+			if (KW_LPAREN == tok->kw && ! limit_nest(p, ++nest))
+				return(0);
+			else if (KW_RPAREN == tok->kw)
+				nest--;
+			end = tok_rawend(tok);
+		}
+
+		if (expr)
+			expr = idx_addcol(p, idx, 0, 
+				str_add(p, start, end - start));
+		else
+			expr = idx_addcol(p, idx, 
+				str_add(p, name, namesz), 0);
+		if ( ! expr)
+			return(0);
+		if (KW_RPAREN == tok->kw)
+			return(1);
+	}
+}
+
+/*
+ * Process any "on delete" and "on update" actions after the references
+ * clause of "fkey", or discard them if "fkey" is NULL.
+ * This leaves the token following them.
+ * Return zero on failure and non-zero on success.
+ */
+static int
+schema_fkey_actions(struct token *tok, struct parse *p, struct fkey *fkey)
+{
+	enum kw		 on;
+	enum fkact	 act;
+	int		 c;
+
+	while ((c = tok_nextsame(tok, p, KW_ON, 0)) > 0) {
+		do if ( ! tok_next(tok, p, 0))
+			return(0);
+		while (TOK_COMMENT == tok->type);
+		if (KW_DELETE != tok->kw && KW_UPDATE != tok->kw)
+			goto syntax;
+		on = tok->kw;
+
+		do if ( ! tok_next(tok, p, 0))
+			return(0);
+		while (TOK_COMMENT == tok->type);
+		switch (tok->kw) {
+		case (KW_SET):
+			do if ( ! tok_next(tok, p, 0))
+				return(0);
+			while (TOK_COMMENT == tok->type);
+			if (KW_NULL == tok->kw)
+				act = FKACT_SETNULL;
+			else if (KW_DEFAULT == tok->kw)
+				act = FKACT_SETDEFAULT;
+			else
+				goto syntax;
+			break;
+		case (KW_CASCADE):
+			act = FKACT_CASCADE;
+			break;
+		case (KW_RESTRICT):
+			act = FKACT_RESTRICT;
+			break;
+		case (KW_NO):
+			if ( ! tok_nextexpect(tok, p, KW_ACTION))
+				return(0);
+			act = FKACT_NONE;
+			break;
+		default:
+			goto syntax;
+		}
+
+		if (NULL == fkey)
+			continue;
+		if (KW_DELETE == on)
+			fkey->ondelete = act;
+		else
+			fkey->onupdate = act;
+	}
+	return(0 == c);
+syntax:
+	dowarnx(p, "syntax error in foreign key action");
+	return(0);
+}
+
+/*
+ * Process what comes after "references" within a column declaration.
+ * This leaves the token following the clause.
+ * Return zero on failure and non-zero on success.
+ */
+static int
+schema_column_references(struct token *tok, 
+	struct parse *p, struct col *col)
+{
+	struct fkey	*fkey;
 
 	do if ( ! tok_next(tok, p, 0))
 		return(0);
 	while (TOK_COMMENT == tok->type);
 
-	if (tok_strsame(tok, "if")) {
-		if ( ! tok_nextsame(tok, p, "not", 0))
-			return(0);
-		if ( ! tok_nextsame(tok, p, "exists", 0))
+	if (NULL == (fkey = fkey_alloc(p, col)))
+		return(0);
+	fkey->rtab = str_add(p, tok->start, tok->sz);
+
+	if ( ! tok_nextexpect(tok, p, KW_LPAREN))
+		return(0);
+	do if ( ! tok_next(tok, p, 0))
+		return(0);
+	while (TOK_COMMENT == tok->type);
+
+	fkey->rcol = str_add(p, tok->start, tok->sz);
+
+	if ( ! tok_nextexpect(tok, p, KW_RPAREN))
+		return(0);
+	if ( ! schema_fkey_actions(tok, p, fkey))
+		return(0);
+
+	domsg(p, "added reference to %s.%s: %s.%s",
+		SCHEMA_STR(p, COL_TAB(p, col)->name), 
+		SCHEMA_STR(p, col->name),
+		SCHEMA_STR(p, fkey->rtab), SCHEMA_STR(p, fkey->rcol));
+	if (NULL != p->cb && NULL != p->cb->fkey)
+		p->cb->fkey(p->cb->arg, p, fkey);
+	return(1);
+}
+
+/*
+ * Look up a column of "tab" by the name in "tok" while parsing, when
+ * columns added by "alter table" may follow those of other tables.
+ * Returns NULL if not found.
+ */
+static struct col *
+column_find(struct parse *p, const struct tab *tab, const struct token *tok)
+{
+	struct col	*col;
+	size_t		 i;
+
+	for (i = tab->firstcol; i < p->ncol; i++) {
+		col = &p->cols[i];
+		if (col->tab == tab->idx &&
+		    strlen(SCHEMA_STR(p, col->name)) == tok->sz &&
+		    0 == strncmp(SCHEMA_STR(p, col->name),
+		     tok->start, tok->sz))
+			return(col);
+	}
+	return(NULL);
+}
+
+/*
+ * Process what follows "foreign" as a column constraint, e.g., "foreign
+ * key (moop) references foo(bar)".
+ * This leaves the token following the clause.
+ * Return zero on failure and non-zero on success.
+ */
+static int
+schema_foreign(struct token *tok, struct parse *p, struct tab *tab)
+{
+	struct col	*tcol;
+	struct fkey	*fkey = NULL;
+
+	if ( ! tok_nextexpect(tok, p, KW_KEY))
+		return(0);
+	if ( ! tok_nextexpect(tok, p, KW_LPAREN))
+		return(0);
+
+	/* Get and look up column name. */
+
+	do if ( ! tok_next(tok, p, 0))
+		return(0);
+	while (TOK_COMMENT == tok->type);
+
+	if (NULL != (tcol = column_find(p, tab, tok))) {
+		if (NULL == (fkey = fkey_alloc(p, tcol)))
 			return(0);
+	} else
+		dowarnx(p, "cannot find column: %.*s",
+			(int)tok->sz, tok->start);
+
+	if ( ! tok_nextexpect(tok, p, KW_RPAREN))
+		return(0);
+	if ( ! tok_nextexpect(tok, p, KW_REFERENCES))
+		return(0);
+
+	/* Table name: keep if we have our column. */
+
+	do if ( ! tok_next(tok, p, 0)) 
+		return(0);
+	while (TOK_COMMENT == tok->type);
+
+	if (NULL != fkey)
+		fkey->rtab = str_add(p, tok->start, tok->sz);
+
+	if ( ! tok_nextexpect(tok, p, KW_LPAREN))
+		return(0);
+
+	/* Column name: keep if we have our column. */
+
+	do if ( ! tok_next(tok, p, 0))
+		return(0);
+	while (TOK_COMMENT == tok->type);
+
+	if (NULL != fkey)
+		fkey->rcol = str_add(p, tok->start, tok->sz);
+
+	if ( ! tok_nextexpect(tok, p, KW_RPAREN))
+		return(0);
+	if ( ! schema_fkey_actions(tok, p, fkey))
+		return(0);
+
+	if (NULL != tcol) {
+		domsg(p, "added foreign key to %s.%s: %s.%s",
+			SCHEMA_STR(p, tab->name), 
+			SCHEMA_STR(p, tcol->name),
+			SCHEMA_STR(p, fkey->rtab), 
+			SCHEMA_STR(p, fkey->rcol));
+		if (NULL != p->cb && NULL != p->cb->fkey)
+			p->cb->fkey(p->cb->arg, p, fkey);
+	}
+	return(1);
+}
+
+/*
+ * Whether a keyword begins a column constraint, which also ends the
+ * declared type of the column.
+ */
+static int
+kw_colconstraint(enum kw kw)
+{
+
+	switch (kw) {
+	case (KW_AS):
+	case (KW_CHECK):
+	case (KW_COLLATE):
+	case (KW_CONSTRAINT):
+	case (KW_DEFAULT):
+	case (KW_GENERATED):
+	case (KW_NOT):
+	case (KW_NULL):
+	case (KW_PRIMARY):
+	case (KW_REFERENCES):
+	case (KW_UNIQUE):
+		return(1);
+	default:
+		break;
+	}
+	return(0);
+}
+
+/*
+ * Parse the declared type of a column, e.g., "varchar(255)" or
+ * "unsigned big int", which runs until the first column constraint or
+ * the end of the column.
+ * This leaves the terminating token in "tok".
+ * Return zero on failure and non-zero on success.
+ */
+static int
+schema_column_type(struct token *tok, struct parse *p, struct col *col)
+{
+	const char	*start = NULL, *end = NULL;
+	size_t		 nest;
+
+	for (nest = 0; ; ) {
 		do if ( ! tok_next(tok, p, 0))
 			return(0);
 		while (TOK_COMMENT == tok->type);
-		flags |= TAB_IF_NOT_EXIST;
+
+		if (0 == nest && (KW_COMMA == tok->kw || 
+		    KW_RPAREN == tok->kw || KW_SEMI == tok->kw ||
+		    kw_colconstraint(tok->kw)))
+			break;
+		if (KW_LPAREN == tok->kw && ! limit_nest(p, ++nest))
+			return(0);
+		else if (KW_RPAREN == tok->kw)
+			nest--;
+		if (NULL == start)
+			start = tok_rawstart(tok);
+		end = tok_rawend(tok);
 	}
 
-	/* Allocate table in queue. */
+	if (NULL != start)
+		col->type = str_add(p, start, end - start);
+	return(1);
+}
 
-	tab = calloc(1, sizeof(struct tab));
-	if (NULL == tab)
-		err(EXIT_FAILURE, "calloc");
-	tab->name = strndup(tok->start, tok->sz);
-	if (NULL == tab->name)
-		err(EXIT_FAILURE, "strndup");
-	tab->idx = p->ntab++;
-	tab->comment = *comment;
-	*comment = NULL;
-	tab->flags = flags;
-	TAILQ_INIT(&tab->colq);
+/*
+ * Parse the value following "default", which is either a single token
+ * (literal, number, or name) or a parenthesised expression.
+ * Return zero on failure and non-zero on success.
+ */
+static int
+schema_column_default(struct token *tok, struct parse *p, struct col *col)
+{
+	const char	*start;
+	size_t		 nest;
+
+	do if ( ! tok_next(tok, p, 0))
+		return(0);
+	while (TOK_COMMENT == tok->type);
+
+	start = tok_rawstart(tok);
+	if (KW_LPAREN == tok->kw)
+		for (nest = 1; nest > 0; ) {
+			do if ( ! tok_next(tok, p, 0))
+				return(0);
+			while (TOK_COMMENT == tok->type);
+			if (KW_LPAREN == tok->kw && ! limit_nest(p, ++nest))
+				return(0);
+			else if (KW_RPAREN == tok->kw)
+				nest--;
+		}
+
+	col->def = str_add(p, start, tok_rawend(tok) - start);
+	return(1);
+}
+
+/*
+ * Parse a column or table constraint whose first token is in "tok",
+ * taking ownership of its leading "comment" (or NULL).
+ * Columns added by "alter table" end at the semicolon.
+ * Returns <0 on failure, 0 if no more columns, 1 if more columns.
+ */
+static int
+schema_coldef(struct token *tok, struct parse *p,
+	struct tab *tab, char *comment)
+{
+	size_t	 	 nest;
+	struct col	*col, *cols;
+	struct idx	*idx;
+	enum kw		 prev;
+	int		 have = 0;
+
+	/* Table constraints may be named: skip past the name. */
+
+	if (KW_CONSTRAINT == tok->kw) {
+		do if ( ! tok_next(tok, p, 0))
+			return(-1);
+		while (TOK_COMMENT == tok->type);
+		do if ( ! tok_next(tok, p, 0))
+			return(-1);
+		while (TOK_COMMENT == tok->type);
+	}
+
+	/* Check sub-clauses. */
+
+	if (KW_UNIQUE != tok->kw &&
+	    KW_FOREIGN != tok->kw &&
+	    KW_PRIMARY != tok->kw &&
+	    KW_CHECK != tok->kw) {
+		if (NULL != p->lim && 0 != p->lim->cols &&
+		    tab->ncol >= p->lim->cols) {
+			comment_free(p, comment);
+			limit_fail(p, "columns", p->lim->cols);
+			return(-1);
+		}
+		if (NULL == (cols = array_grow(p, p->cols, 
+		    p->ncol, &p->colmax, sizeof(struct col)))) {
+			comment_free(p, comment);
+			return(-1);
+		}
+		p->cols = cols;
+		col = &p->cols[p->ncol++];
+		col->name = str_add(p, tok->start, tok->sz);
+		col->tab = tab->idx;
+		col->idx = tab->ncol++;
+		col->comment = str_move(p, comment);
+		col->fkey = col->fkdecl = SCHEMA_NONE;
+		domsg(p, "added column: %s.%s", 
+			SCHEMA_STR(p, tab->name), 
+			SCHEMA_STR(p, col->name));
+	} else {
+		comment_free(p, comment);
+		col = NULL;
+	}
+
+	if (KW_FOREIGN == tok->kw) {
+		if ( ! schema_foreign(tok, p, tab))
+			return(0);
+		have = 1;
+	} else if (KW_PRIMARY == tok->kw) {
+		if ( ! tok_nextexpect(tok, p, KW_KEY))
+			return(-1);
+		if ( ! tok_nextexpect(tok, p, KW_LPAREN))
+			return(-1);
+		idx = idx_alloc(p, tab, IDX_AUTO | IDX_PKEY | IDX_UNIQUE);
+		if (NULL == idx || ! schema_idxcols(tok, p, idx))
+			return(-1);
+	} else if (KW_UNIQUE == tok->kw) {
+		if ( ! tok_nextexpect(tok, p, KW_LPAREN))
+			return(-1);
+		idx = idx_alloc(p, tab, IDX_AUTO | IDX_UNIQUE);
+		if (NULL == idx || ! schema_idxcols(tok, p, idx))
+			return(-1);
+	}
+
+	/* 
+	 * Columns begin with their type, after which we already have the
+	 * first token of the constraints (if any).
+	 */
+
+	if (NULL != col && ! schema_column_type(tok, p, col))
+		return(-1);
+
+	if (NULL != col)
+		have = 1;
+	for (nest = 1, prev = KW_NONE; nest > 0; prev = tok->kw) {
+		if ( ! have) {
+			do if ( ! tok_next(tok, p, 0))
+				return(-1);
+			while (TOK_COMMENT == tok->type);
+		}
+		have = 0;
+
+		if (NULL != col && KW_REFERENCES == tok->kw) {
+			if ( ! schema_column_references(tok, p, col))
+				return(0);
+			have = 1;
+			continue;
+		}
+
+		/* Column constraints: some implying an index. */
+
+		if (NULL != col && 1 == nest)
+			switch (tok->kw) {
+			case (KW_PRIMARY):
+				col->flags |= COL_PKEY;
+				idx = idx_alloc(p, tab, IDX_AUTO | 
+					IDX_PKEY | IDX_UNIQUE);
+				if (NULL == idx || 
+				    ! idx_addcol(p, idx, col->name, 0))
+					return(-1);
+				continue;
+			case (KW_UNIQUE):
+				col->flags |= COL_UNIQUE;
+				idx = idx_alloc(p, tab, 
+					IDX_AUTO | IDX_UNIQUE);
+				if (NULL == idx || 
+				    ! idx_addcol(p, idx, col->name, 0))
+					return(-1);
+				continue;
+			case (KW_NULL):
+				if (KW_NOT == prev)
+					col->flags |= COL_NOTNULL;
+				continue;
+			case (KW_AUTOINCREMENT):
+				col->flags |= COL_AUTOINC;
+				continue;
+			case (KW_DEFAULT):
+				if ( ! schema_column_default(tok, p, col))
+					return(-1);
+				continue;
+			default:
+				break;
+			}
 
-	TAILQ_FOREACH(ntab, &p->tabq, entry)
-		if (strcmp(ntab->name, tab->name) > 0)
+		/* Nesting begins within the table's parentheses. */
+
+		if (KW_LPAREN == tok->kw && ! limit_nest(p, nest++))
+			return(-1);
+		else if ((KW_COMMA == tok->kw || KW_SEMI == tok->kw) &&
+		    1 == nest)
 			break;
-	if (NULL != ntab)
-		TAILQ_INSERT_BEFORE(ntab, tab, entry);
-	else
-		TAILQ_INSERT_TAIL(&p->tabq, tab, entry);
+		else if (KW_RPAREN == tok->kw)
+			nest--;
+	}
+
+	if (NULL != col && NULL != p->cb && NULL != p->cb->col)
+		p->cb->col(p->cb->arg, p, col);
+
+	if (KW_COMMA == tok->kw)
+		return(1);
+	if (KW_RPAREN == tok->kw || KW_SEMI == tok->kw)
+		return(0);
+
+	dowarnx(p, "syntax error trailing column");
+	return(-1);
+}
+
+/*
+ * Like schema_coldef(), but reading the leading comment and first
+ * token.
+ */
+static int
+schema_column(struct token *tok, struct parse *p, struct tab *tab)
+{
+	char	*comment;
+
+	if ( ! comment_append(tok, p, 0, &comment))
+		return(-1);
+	return(schema_coldef(tok, p, tab, comment));
+}
+
+/*
+ * Finish a table, whose allocations began at "mark".
+ * When streaming, the table is sorted and its own constraints resolved
+ * for the callback, then discarded: nothing else is added while it's
+ * parsed, so its columns and indices are those since "mark".
+ * Return zero if the parse failed.
+ */
+static int
+table_end(struct parse *p, struct tab *tab, const struct schemamark *mark)
+{
+	uint32_t	*order;
+	size_t		 i;
+	int		 rc;
+
+	if (NULL == p->cb)
+		return(1);
+	if ( ! p->cb->stream) {
+		if (NULL != p->cb->tab_end)
+			p->cb->tab_end(p->cb->arg, p, tab);
+		return(1);
+	}
+
+	tab->firstidx = mark->nidx;
+	tab->nidx = p->nidx - mark->nidx;
+	if (NULL == (order = sqlite_schema_realloc(p, NULL, 0,
+	    tab->ncol + 1, sizeof(uint32_t))))
+		return(0);
+	if ((rc = columns(p, tab, order)))
+		for (i = mark->nfkey; i < p->nfkey; i++)
+			p->fkeys[i].col = 
+				order[p->fkeys[i].col - tab->firstcol];
+	sqlite_schema_dealloc(p, order, tab->ncol + 1, sizeof(uint32_t));
+	if ( ! rc)
+		return(0);
+	table_indices(p, tab);
+
+	if (NULL != p->cb->tab_end)
+		p->cb->tab_end(p->cb->arg, p, tab);
+
+	schema_release(p, mark);
+	return(1);
+}
+
+/*
+ * Parse a table definition.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+schema_table(struct token *tok, struct parse *p, 
+	char **comment, unsigned int flags)
+{
+	int	 	 c;
+	struct tab	*tab, *tabs;
+	struct schemamark mark;
+	uint64_t	 start = sqlite_schema_trace_now();
+
+	/* Start trying to get the table identifier. */
+
+	do if ( ! tok_next(tok, p, 0))
+		return(0);
+	while (TOK_COMMENT == tok->type);
+
+	if (KW_IF == tok->kw) {
+		if ( ! tok_nextsame(tok, p, KW_NOT, 0))
+			return(0);
+		if ( ! tok_nextsame(tok, p, KW_EXISTS, 0))
+			return(0);
+		do if ( ! tok_next(tok, p, 0))
+			return(0);
+		while (TOK_COMMENT == tok->type);
+		flags |= TAB_IF_NOT_EXIST;
+	}
+
+	/* Allocate the table. */
+
+	if (NULL != p->lim && 0 != p->lim->tabs &&
+	    p->ntab >= p->lim->tabs)
+		return(limit_fail(p, "tables", p->lim->tabs));
+
+	schema_mark(p, &mark);
+	if (NULL == (tabs = array_grow(p, p->tabs, 
+	    p->ntab, &p->tabmax, sizeof(struct tab))))
+		return(0);
+	p->tabs = tabs;
+	tab = &p->tabs[p->ntab];
+	tab->idx = p->ntab++;
+	tab->name = str_add(p, tok->start, tok->sz);
+	tab->comment = str_move(p, *comment);
+	*comment = NULL;
+	tab->flags = flags;
+	tab->firstcol = p->ncol;
+
+	domsg(p, "added table: %s", SCHEMA_STR(p, tab->name));
+	if (NULL != p->cb && NULL != p->cb->tab_begin)
+		p->cb->tab_begin(p->cb->arg, p, tab);
+
+	/* Parse through all of our columns. */
+
+	if (0 == (c = tok_nextsame(tok, p, KW_LPAREN, 0))) {
+		dowarnx(p, "syntax error leading columns");
+		return(0);
+	} else if (c < 0)
+		return(0);
+
+	while ((c = schema_column(tok, p, tab)) > 0) 
+		continue;
+	if (c < 0)
+		return(0);
+
+	if (KW_RPAREN != tok->kw) {
+		dowarnx(p, "syntax error trailing columns");
+		return(0);
+	}
+
+	/* 
+	 * See if we're at the end of the table statement, which can
+	 * also have comma-separated "without rowid" and "strict"
+	 * options.
+	 */
+
+	for (;;) {
+		do if ( ! tok_next(tok, p, 0))
+			return(0);
+		while (TOK_COMMENT == tok->type);
+
+		if (KW_WITHOUT == tok->kw) {
+			if (0 == (c = tok_nextsame(tok, p, KW_ROWID, 0))) {
+				dowarnx(p, "syntax error in table options");
+				return(0);
+			} else if (c < 0)
+				return(0);
+			tab->flags |= TAB_WITHOUT_ROWID;
+		} else if (KW_STRICT == tok->kw) {
+			tab->flags |= TAB_STRICT;
+		} else
+			break;
+
+		do if ( ! tok_next(tok, p, 0))
+			return(0);
+		while (TOK_COMMENT == tok->type);
+		if (KW_COMMA != tok->kw)
+			break;
+	}
+
+	if (KW_SEMI == tok->kw) {
+		sqlite_schema_trace("parse", "table", 
+			SCHEMA_STR(p, tab->name), start);
+		return(table_end(p, tab, &mark));
+	}
+
+	dowarnx(p, "syntax error at end of table statement");
+	return(0);
+}
+
+/*
+ * Parse an index definition following "create [unique] index".
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+schema_index(struct token *tok, struct parse *p, 
+	char **comment, unsigned int flags)
+{
+	struct idx	*idx;
+	const char	*start, *end;
+	uint64_t	 t = sqlite_schema_trace_now();
+
+	do if ( ! tok_next(tok, p, 0))
+		return(0);
+	while (TOK_COMMENT == tok->type);
+
+	if (KW_IF == tok->kw) {
+		if ( ! tok_nextexpect(tok, p, KW_NOT))
+			return(0);
+		if ( ! tok_nextexpect(tok, p, KW_EXISTS))
+			return(0);
+		do if ( ! tok_next(tok, p, 0))
+			return(0);
+		while (TOK_COMMENT == tok->type);
+		flags |= IDX_IF_NOT_EXIST;
+	}
+
+	if (NULL == (idx = idx_alloc(p, NULL, flags)))
+		return(0);
+	idx->name = str_add(p, tok->start, tok->sz);
+	idx->comment = str_move(p, *comment);
+	*comment = NULL;
+
+	if ( ! tok_nextexpect(tok, p, KW_ON))
+		return(0);
+	do if ( ! tok_next(tok, p, 0))
+		return(0);
+	while (TOK_COMMENT == tok->type);
+
+	idx->rtab = str_add(p, tok->start, tok->sz);
+
+	if ( ! tok_nextexpect(tok, p, KW_LPAREN))
+		return(0);
+	if ( ! schema_idxcols(tok, p, idx))
+		return(0);
+
+	domsg(p, "added index: %s", SCHEMA_STR(p, idx->name));
+
+	do if ( ! tok_next(tok, p, 0))
+		return(0);
+	while (TOK_COMMENT == tok->type);
+
+	/* 
+	 * Partial indices: keep the clause as-is, but for comments
+	 * trailing it, which would swallow the semicolon if written
+	 * back out on one line.
+	 */
+
+	if (KW_WHERE == tok->kw) {
+		start = end = &p->map[p->i];
+		for (;;) {
+			if ( ! tok_next(tok, p, 0))
+				return(0);
+			if (KW_SEMI == tok->kw)
+				break;
+			if (TOK_COMMENT != tok->type)
+				end = tok_rawend(tok);
+		}
+		while (start < end && isspace((unsigned char)*start))
+			start++;
+		idx->flags |= IDX_PARTIAL;
+		idx->where = str_add(p, start, end - start);
+	}
+
+	if (KW_SEMI == tok->kw) {
+		sqlite_schema_trace("parse", "index", 
+			SCHEMA_STR(p, idx->name), t);
+		return(1);
+	}
+
+	dowarnx(p, "syntax error at end of index statement");
+	return(0);
+}
+
+/* 
+ * Processes a "create xxxx" statement.
+ * Returns zero on failure, <0 on end of file, or >0 at the end of the
+ * creation.
+ * This should be at a semicolon.
+ */
+static int
+schema_create(struct token *tok, struct parse *p, char **comment)
+{
+	unsigned int	 flags = 0;
+
+	do if ( ! tok_next(tok, p, 0))
+		return(-1);
+	while (TOK_COMMENT == tok->type);
+
+	/* Pass over "temp" and "temporary" statements. */
+
+	if (KW_TEMP == tok->kw ||
+	    KW_TEMPORARY == tok->kw) {
+		flags = TAB_TEMP;
+		do if ( ! tok_next(tok, p, 0))
+			return(-1);
+		while (TOK_COMMENT == tok->type);
+	}
+
+	/* Indices may be unique. */
+
+	if (KW_UNIQUE == tok->kw) {
+		if ( ! tok_nextexpect(tok, p, KW_INDEX))
+			return(-1);
+		return(schema_index(tok, p, comment, IDX_UNIQUE) ? 1 : -1);
+	} else if (KW_INDEX == tok->kw)
+		return(schema_index(tok, p, comment, 0) ? 1 : -1);
+
+	/* Try to read the "table", if it exists. */
+
+	if (KW_TABLE != tok->kw) {
+		dowarnx(p, "ignoring non-table creation");
+		return(0);
+	} 
+
+	return(schema_table(tok, p, comment, flags) ? 1 : -1);
+}
+
+/*
+ * Look up a table being parsed by the name in "tok", the latest if it
+ * was declared more than once.
+ * Returns NULL if not found.
+ */
+static struct tab *
+table_find(struct parse *p, const struct token *tok)
+{
+	struct tab	*tab;
+	size_t		 i;
+
+	for (i = p->ntab; i > 0; i--) {
+		tab = &p->tabs[i - 1];
+		if (0 == (TAB_DROPPED & tab->flags) &&
+		    strlen(SCHEMA_STR(p, tab->name)) == tok->sz &&
+		    0 == strncmp(SCHEMA_STR(p, tab->name),
+		     tok->start, tok->sz))
+			return(tab);
+	}
+	return(NULL);
+}
+
+/*
+ * Rename the index columns of "idx" named "from" to "to".
+ */
+static void
+idx_rename(struct parse *p, struct idx *idx, uint32_t from, uint32_t to)
+{
+	struct idxcol	*ic;
+	size_t		 i;
+
+	for (i = 0; i < idx->ncols; i++) {
+		ic = IDXCOL(p, idx, i);
+		if (0 != ic->name && 0 == strcmp
+		    (SCHEMA_STR(p, ic->name), SCHEMA_STR(p, from)))
+			ic->name = to;
+	}
+}
+
+static int
+expr_isname(int c)
+{
+
+	return(isalnum((unsigned char)c) || '_' == c || '$' == c ||
+	    (unsigned char)c >= 0x80);
+}
+
+/*
+ * Write "sz" bytes of "cp" at "*len" in "out", if not NULL.
+ */
+static void
+expr_put(char *out, size_t *len, const char *cp, size_t sz)
+{
+
+	if (NULL != out)
+		memcpy(out + *len, cp, sz);
+	*len += sz;
+}
+
+/*
+ * Write the name "to" quoted by "q" (or bare if NUL, as long as it's
+ * a plain word) at "*len" in "out", if not NULL.
+ */
+static void
+expr_putname(char *out, size_t *len, const char *to, char q)
+{
+	const char	*cp;
+	char		 eq;
+
+	if ('\0' == q) {
+		for (cp = to; expr_isname(*cp); cp++)
+			continue;
+		if ('\0' == *cp && cp > to &&
+		    ! isdigit((unsigned char)*to) &&
+		    KW_NONE == sqlite_schema_keyword(to, cp - to)) {
+			expr_put(out, len, to, cp - to);
+			return;
+		}
+		q = '"';
+	}
+	eq = '[' == q ? ']' : q;
+	expr_put(out, len, &q, 1);
+	for (cp = to; '\0' != *cp; cp++) {
+		if (eq == *cp && ']' != eq)
+			expr_put(out, len, cp, 1);
+		expr_put(out, len, cp, 1);
+	}
+	expr_put(out, len, &eq, 1);
+}
+
+/*
+ * Write the raw SQL "expr" at "out", if not NULL, with each identifier
+ * naming "from" replaced by "to".
+ * If "qual", only qualifiers (identifiers followed by a dot) are
+ * replaced; otherwise, only identifiers neither qualifying another nor
+ * naming a function.
+ * String literals and comments are left as-is.
+ * Returns the length written, setting "nrep" to the replacements.
+ */
+static size_t
+expr_rename_put(char *out, const char *expr, const char *from,
+	const char *to, int qual, size_t *nrep)
+{
+	const char	*cp = expr, *st, *name, *next;
+	size_t		 len = 0, namesz;
+	char		 q;
+
+	*nrep = 0;
+	while ('\0' != *cp) {
+		st = cp;
+		q = '\0';
+		name = NULL;
+		namesz = 0;
+		switch (*cp) {
+		case ('\''):
+			cp = strchr(cp + 1, '\'');
+			cp = NULL == cp ? strchr(st, '\0') : cp + 1;
+			break;
+		case ('"'):
+		case ('`'):
+		case ('['):
+			q = *cp;
+			name = cp + 1;
+			cp = strchr(name, '[' == q ? ']' : q);
+			if (NULL == cp) {
+				cp = strchr(name, '\0');
+				name = NULL;
+				break;
+			}
+			namesz = cp++ - name;
+			break;
+		case ('-'):
+			if ('-' != cp[1]) {
+				cp++;
+				break;
+			}
+			cp = strchr(cp, '\n');
+			cp = NULL == cp ? strchr(st, '\0') : cp + 1;
+			break;
+		case ('/'):
+			if ('*' != cp[1]) {
+				cp++;
+				break;
+			}
+			cp = strstr(cp + 2, "*/");
+			cp = NULL == cp ? strchr(st, '\0') : cp + 2;
+			break;
+		default:
+			if ( ! expr_isname(*cp)) {
+				cp++;
+				break;
+			}
+			while (expr_isname(*cp))
+				cp++;
+			if ( ! isdigit((unsigned char)*st)) {
+				name = st;
+				namesz = cp - st;
+			}
+			break;
+		}
+
+		if (NULL != name && strlen(from) == namesz &&
+		    0 == strncmp(name, from, namesz)) {
+			for (next = cp; isspace((unsigned char)*next); next++)
+				continue;
+			if (qual ? '.' == *next :
+			    '.' != *next && ('(' != *next || '\0' != q)) {
+				expr_putname(out, &len, to, q);
+				(*nrep)++;
+				continue;
+			}
+		}
+		expr_put(out, &len, st, cp - st);
+	}
+	if (NULL != out)
+		out[len] = '\0';
+	return(len);
+}
+
+/*
+ * Rename identifiers in the raw SQL "expr" as by expr_rename_put().
+ * Returns "expr" itself if there was nothing to rename, or zero if the
+ * parse failed.
+ */
+static uint32_t
+expr_rename(struct parse *p, uint32_t expr, uint32_t from,
+	uint32_t to, int qual)
+{
+	uint32_t	 off;
+	size_t		 sz, nrep;
+
+	if (0 == expr)
+		return(0);
+	sz = expr_rename_put(NULL, SCHEMA_STR(p, expr), 
+		SCHEMA_STR(p, from), SCHEMA_STR(p, to), qual, &nrep);
+	if (0 == nrep)
+		return(expr);
+
+	/* The strings may have moved. */
+
+	if (0 != (off = str_alloc(p, sz)))
+		expr_rename_put(p->strs + off, SCHEMA_STR(p, expr), 
+			SCHEMA_STR(p, from), SCHEMA_STR(p, to), qual, &nrep);
+	return(off);
+}
+
+/*
+ * Rename the identifiers "from" to "to" in the expressions of "idx":
+ * qualifiers if "qual", else columns.
+ */
+static void
+idx_rename_expr(struct parse *p, struct idx *idx,
+	uint32_t from, uint32_t to, int qual)
+{
+	struct idxcol	*ic;
+	size_t		 i;
+
+	idx->where = expr_rename(p, idx->where, from, to, qual);
+	for (i = 0; i < idx->ncols; i++) {
+		ic = IDXCOL(p, idx, i);
+		ic->expr = expr_rename(p, ic->expr, from, to, qual);
+	}
+}
+
+/*
+ * Whether "idx" is of the table "tab": implied by one of its
+ * constraints or, not yet resolved, naming it.
+ */
+static int
+idx_of(const struct parse *p, const struct idx *idx, const struct tab *tab)
+{
+
+	if (IDX_DROPPED & idx->flags)
+		return(0);
+	if (SCHEMA_NONE != idx->tab)
+		return(idx->tab == tab->idx);
+	return(0 == strcmp(SCHEMA_STR(p, idx->rtab), 
+	    SCHEMA_STR(p, tab->name)));
+}
+
+/*
+ * Rename "tab" to the name in "tok", along with its indices, the
+ * qualifiers in their expressions, and the foreign keys referencing it.
+ */
+static void
+alter_rename_table(struct parse *p, struct tab *tab, const struct token *tok)
+{
+	struct idx	*idx;
+	struct fkey	*fkey;
+	uint32_t	 from = tab->name, to;
+	size_t		 i;
+
+	if (0 == (to = str_add(p, tok->start, tok->sz)))
+		return;
+	for (i = 0; i < p->nidx; i++) {
+		idx = &p->idxs[i];
+		if ( ! idx_of(p, idx, tab))
+			continue;
+		if (SCHEMA_NONE == idx->tab)
+			idx->rtab = to;
+		idx_rename_expr(p, idx, from, to, 1);
+	}
+	tab->name = to;
+	for (i = 0; i < p->nfkey; i++) {
+		fkey = &p->fkeys[i];
+		if (0 == strcmp(SCHEMA_STR(p, fkey->rtab), 
+		    SCHEMA_STR(p, from)))
+			fkey->rtab = tab->name;
+	}
+	domsg(p, "renamed table: %s to %s", 
+		SCHEMA_STR(p, from), SCHEMA_STR(p, tab->name));
+}
+
+/*
+ * Rename "col" to the name in "tok", along with the index columns,
+ * expressions, and foreign keys naming it.
+ */
+static void
+alter_rename_column(struct parse *p, struct col *col,
+	const struct token *tok)
+{
+	struct tab	*tab = COL_TAB(p, col);
+	struct idx	*idx;
+	struct fkey	*fkey;
+	uint32_t	 from = col->name, to;
+	size_t		 i;
+
+	if (0 == (to = str_add(p, tok->start, tok->sz)))
+		return;
+	col->name = to;
+	for (i = 0; i < p->nidx; i++) {
+		idx = &p->idxs[i];
+		if ( ! idx_of(p, idx, tab))
+			continue;
+		idx_rename(p, idx, from, col->name);
+		idx_rename_expr(p, idx, from, col->name, 0);
+	}
+	for (i = 0; i < p->nfkey; i++) {
+		fkey = &p->fkeys[i];
+		if (0 == strcmp(SCHEMA_STR(p, fkey->rtab), 
+		     SCHEMA_STR(p, tab->name)) &&
+		    0 == strcmp(SCHEMA_STR(p, fkey->rcol), 
+		     SCHEMA_STR(p, from)))
+			fkey->rcol = col->name;
+	}
+	domsg(p, "renamed column: %s.%s to %s",
+		SCHEMA_STR(p, tab->name), SCHEMA_STR(p, from), 
+		SCHEMA_STR(p, col->name));
+}
+
+/*
+ * Whether "idx" uses the column "name" in its columns, expressions, or
+ * "where" clause.
+ */
+static int
+idx_uses(const struct parse *p, const struct idx *idx, const char *name)
+{
+	const struct idxcol *ic;
+	size_t		  i, n;
+
+	if (0 != idx->where)
+		expr_rename_put(NULL, SCHEMA_STR(p, idx->where), 
+			name, name, 0, &n);
+	else
+		n = 0;
+	for (i = 0; 0 == n && i < idx->ncols; i++) {
+		ic = IDXCOL(p, idx, i);
+		if (0 != ic->name)
+			n = 0 == strcmp(SCHEMA_STR(p, ic->name), name);
+		else
+			expr_rename_put(NULL, SCHEMA_STR(p, ic->expr),
+				name, name, 0, &n);
+	}
+	return(n > 0);
+}
+
+/*
+ * Drop "col" unless, as with SQLite, it's part of a key or index or
+ * the only column.
+ * The column stays where it is, but without its table, and those
+ * following it are renumbered.
+ * Returns zero if the column may not be dropped.
+ */
+static int
+alter_drop_column(struct parse *p, struct col *col)
+{
+	struct tab	*tab = COL_TAB(p, col);
+	const char	*name = SCHEMA_STR(p, col->name);
+	size_t		 i;
+	int		 used;
+
+	used = 1 == tab->ncol || ((COL_PKEY | COL_UNIQUE) & col->flags);
+	for (i = 0; i < p->nfkey; i++)
+		used |= &p->cols[p->fkeys[i].col] == col;
+	for (i = 0; i < p->nidx; i++)
+		if (idx_of(p, &p->idxs[i], tab))
+			used |= idx_uses(p, &p->idxs[i], name);
+	if (used) {
+		dowarnx(p, "cannot drop column: %s.%s",
+			SCHEMA_STR(p, tab->name), name);
+		return(0);
+	}
+
+	domsg(p, "dropped column: %s.%s", SCHEMA_STR(p, tab->name), name);
+	for (i = tab->firstcol; i < p->ncol; i++)
+		if (p->cols[i].tab == tab->idx && 
+		    p->cols[i].idx > col->idx)
+			p->cols[i].idx--;
+	col->tab = SCHEMA_NONE;
+	tab->ncol--;
+	return(1);
+}
+
+/*
+ * Process an "alter table" statement: adding a column, renaming the
+ * table or a column, or dropping a column.
+ * Returns like schema_create().
+ */
+static int
+schema_alter(struct token *tok, struct parse *p)
+{
+	struct tab	*tab;
+	struct col	*col;
+	char		*comment;
+	int		 c;
+	uint64_t	 t = sqlite_schema_trace_now();
+
+	if ( ! tok_nextexpect(tok, p, KW_TABLE))
+		return(-1);
+	do if ( ! tok_next(tok, p, 0))
+		return(-1);
+	while (TOK_COMMENT == tok->type);
+
+	if (NULL == (tab = table_find(p, tok))) {
+		dowarnx(p, "ignoring alter of unknown table: %.*s",
+			(int)tok->sz, tok->start);
+		return(0);
+	}
+
+	do if ( ! tok_next(tok, p, 0))
+		return(-1);
+	while (TOK_COMMENT == tok->type);
+
+	switch (tok->kw) {
+	case (KW_ADD):
+		if ( ! comment_append(tok, p, 0, &comment))
+			return(-1);
+		if (KW_COLUMN == tok->kw) {
+			comment_free(p, comment);
+			c = schema_column(tok, p, tab);
+		} else
+			c = schema_coldef(tok, p, tab, comment);
+		if (c < 0)
+			return(-1);
+		if (KW_SEMI != tok->kw) {
+			dowarnx(p, "syntax error trailing column");
+			return(-1);
+		}
+		break;
+	case (KW_RENAME):
+		do if ( ! tok_next(tok, p, 0))
+			return(-1);
+		while (TOK_COMMENT == tok->type);
+		if (KW_TO == tok->kw) {
+			do if ( ! tok_next(tok, p, 0))
+				return(-1);
+			while (TOK_COMMENT == tok->type);
+			alter_rename_table(p, tab, tok);
+		} else {
+			if (KW_COLUMN == tok->kw)
+				do if ( ! tok_next(tok, p, 0))
+					return(-1);
+				while (TOK_COMMENT == tok->type);
+			if (NULL == (col = column_find(p, tab, tok))) {
+				dowarnx(p, "ignoring rename of unknown "
+					"column: %s.%.*s", 
+					SCHEMA_STR(p, tab->name),
+					(int)tok->sz, tok->start);
+				return(0);
+			}
+			if ( ! tok_nextexpect(tok, p, KW_TO))
+				return(-1);
+			do if ( ! tok_next(tok, p, 0))
+				return(-1);
+			while (TOK_COMMENT == tok->type);
+			alter_rename_column(p, col, tok);
+		}
+		if ( ! tok_nextexpect(tok, p, KW_SEMI))
+			return(-1);
+		break;
+	case (KW_DROP):
+		do if ( ! tok_next(tok, p, 0))
+			return(-1);
+		while (TOK_COMMENT == tok->type);
+		if (KW_COLUMN == tok->kw)
+			do if ( ! tok_next(tok, p, 0))
+				return(-1);
+			while (TOK_COMMENT == tok->type);
+		if (NULL == (col = column_find(p, tab, tok))) {
+			dowarnx(p, "ignoring drop of unknown "
+				"column: %s.%.*s", 
+				SCHEMA_STR(p, tab->name),
+				(int)tok->sz, tok->start);
+			return(0);
+		}
+		if ( ! tok_nextexpect(tok, p, KW_SEMI))
+			return(-1);
+		if ( ! alter_drop_column(p, col))
+			return(1);
+		break;
+	default:
+		dowarnx(p, "syntax error in alter table");
+		return(-1);
+	}
+
+	sqlite_schema_trace("parse", "alter", SCHEMA_STR(p, tab->name), t);
+	return(1);
+}
+
+/*
+ * Drop "tab" with its indices and foreign keys, which stay where they
+ * are until resolved.
+ */
+static void
+drop_table(struct parse *p, struct tab *tab)
+{
+	size_t	 i;
+
+	for (i = 0; i < p->nidx; i++)
+		if (idx_of(p, &p->idxs[i], tab))
+			p->idxs[i].flags |= IDX_DROPPED;
+	tab->flags |= TAB_DROPPED;
+	domsg(p, "dropped table: %s", SCHEMA_STR(p, tab->name));
+}
+
+/*
+ * Drop the named index in "tok", the latest if it was declared more
+ * than once.
+ * Returns zero if not found.
+ */
+static int
+drop_index(struct parse *p, const struct token *tok)
+{
+	struct idx	*idx;
+	size_t		 i;
+
+	for (i = p->nidx; i > 0; i--) {
+		idx = &p->idxs[i - 1];
+		if (0 == ((IDX_AUTO | IDX_DROPPED) & idx->flags) &&
+		    strlen(SCHEMA_STR(p, idx->name)) == tok->sz &&
+		    0 == strncmp(SCHEMA_STR(p, idx->name), 
+		     tok->start, tok->sz))
+			break;
+	}
+	if (0 == i)
+		return(0);
+	idx->flags |= IDX_DROPPED;
+	domsg(p, "dropped index: %s", SCHEMA_STR(p, idx->name));
+	return(1);
+}
+
+/*
+ * Process a "drop table" or "drop index" statement.
+ * Other drops (views, triggers) are ignored.
+ * Returns like schema_create().
+ */
+static int
+schema_drop(struct token *tok, struct parse *p)
+{
+	struct tab	*tab = NULL;
+	struct token	 name;
+	enum kw		 kw;
+	int		 exists = 0, found;
+
+	do if ( ! tok_next(tok, p, 0))
+		return(-1);
+	while (TOK_COMMENT == tok->type);
+
+	if (KW_TABLE != tok->kw && KW_INDEX != tok->kw) {
+		domsg(p, "ignoring non-table drop");
+		return(0);
+	}
+	kw = tok->kw;
+
+	do if ( ! tok_next(tok, p, 0))
+		return(-1);
+	while (TOK_COMMENT == tok->type);
+	if (KW_IF == tok->kw) {
+		if ( ! tok_nextexpect(tok, p, KW_EXISTS))
+			return(-1);
+		do if ( ! tok_next(tok, p, 0))
+			return(-1);
+		while (TOK_COMMENT == tok->type);
+		exists = 1;
+	}
+	name = *tok;
+
+	if ( ! tok_nextexpect(tok, p, KW_SEMI))
+		return(-1);
+
+	if (KW_TABLE == kw && NULL != (tab = table_find(p, &name)))
+		drop_table(p, tab);
+	found = KW_TABLE == kw ? NULL != tab : drop_index(p, &name);
+	if ( ! found && ! exists)
+		dowarnx(p, "ignoring drop of unknown %s: %.*s",
+			KW_TABLE == kw ? "table" : "index",
+			(int)name.sz, name.start);
+	return(1);
+}
+
+/*
+ * FNV-1a hash of a name.
+ */
+static uint32_t
+namehash(const char *cp)
+{
+	uint32_t	 h = 2166136261U;
+
+	for ( ; '\0' != *cp; cp++) {
+		h ^= (unsigned char)*cp;
+		h *= 16777619U;
+	}
+	return(h);
+}
+
+/*
+ * A table or column to be sorted by name, then by declaration "idx",
+ * from its position "pos" in the parse.
+ */
+struct	sortkey {
+	const char	*name;
+	uint32_t	 idx;
+	uint32_t	 pos;
+};
+
+static int
+keycmp(const void *a, const void *b)
+{
+	const struct sortkey *ka = a, *kb = b;
+	int		  c;
+
+	if (0 != (c = strcmp(ka->name, kb->name)))
+		return(c);
+	return(ka->idx < kb->idx ? -1 : ka->idx > kb->idx);
+}
+
+/*
+ * Sort the columns of "tab", which are in declaration order, by name,
+ * filling "order" with the new position of each by declaration.
+ * Return zero if the parse failed.
+ */
+static int
+columns(struct parse *p, struct tab *tab, uint32_t *order)
+{
+	struct sortkey	*keys;
+	struct col	*cols;
+	size_t		 i;
+
+	if (NULL == (keys = sqlite_schema_realloc(p, NULL, 0,
+	    tab->ncol + 1, sizeof(struct sortkey))))
+		return(0);
+	if (NULL == (cols = sqlite_schema_realloc(p, NULL, 0,
+	    tab->ncol + 1, sizeof(struct col)))) {
+		sqlite_schema_dealloc(p, keys, 
+			tab->ncol + 1, sizeof(struct sortkey));
+		return(0);
+	}
+	for (i = 0; i < tab->ncol; i++) {
+		cols[i] = p->cols[tab->firstcol + i];
+		keys[i].name = SCHEMA_STR(p, cols[i].name);
+		keys[i].idx = cols[i].idx;
+		keys[i].pos = i;
+	}
+	qsort(keys, tab->ncol, sizeof(struct sortkey), keycmp);
+	for (i = 0; i < tab->ncol; i++) {
+		p->cols[tab->firstcol + i] = cols[keys[i].pos];
+		order[keys[i].idx] = tab->firstcol + i;
+	}
+	sqlite_schema_dealloc(p, cols, tab->ncol + 1, sizeof(struct col));
+	sqlite_schema_dealloc(p, keys, 
+		tab->ncol + 1, sizeof(struct sortkey));
+	return(1);
+}
+
+/*
+ * Look up a column of "tab" by its name once sorted, returning the
+ * first declared of any with that name.
+ * Returns its position or SCHEMA_NONE if not found.
+ */
+static uint32_t
+column_lookup(const struct parse *p, const struct tab *tab, 
+	const char *name)
+{
+	size_t	 lo = tab->firstcol, hi = tab->firstcol + tab->ncol, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strcmp(SCHEMA_STR(p, p->cols[mid].name), name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < tab->firstcol + tab->ncol && 
+	    0 == strcmp(SCHEMA_STR(p, p->cols[lo].name), name))
+		return(lo);
+	return(SCHEMA_NONE);
+}
+
+/*
+ * Remove what was dropped while parsing, then lay out the columns by
+ * table and the indices implied by constraints by table before all
+ * others, each in declaration order, and the index columns by index.
+ * Return zero if out of time or memory.
+ */
+static int
+compact(struct parse *p)
+{
+	struct col	*cols;
+	struct idx	*idxs, *idx;
+	struct idxcol	*idxcols;
+	uint32_t	*map;
+	size_t		 i, j, n, max, mapsz;
+
+	if ( ! limit_time(p))
+		return(0);
+
+	/* Tables, mapping their old declaration order to the new. */
+
+	mapsz = (p->ntab > p->ncol ? p->ntab : p->ncol) + 1;
+	if (NULL == (map = sqlite_schema_realloc(p, NULL, 0, 
+	    mapsz, sizeof(uint32_t))))
+		return(0);
+	for (i = n = 0; i < p->ntab; i++) {
+		if (TAB_DROPPED & p->tabs[i].flags) {
+			map[i] = SCHEMA_NONE;
+			continue;
+		}
+		map[i] = n;
+		p->tabs[n] = p->tabs[i];
+		p->tabs[n].idx = n;
+		p->tabs[n].firstcol = n > 0 ?
+			p->tabs[n - 1].firstcol + p->tabs[n - 1].ncol : 0;
+		n++;
+	}
+	p->ntab = n;
+
+	/* Auto-indices by table, now they may be found by position. */
+
+	for (i = 0; i < p->ntab; i++)
+		p->tabs[i].nidx = 0;
+	for (i = n = 0; i < p->nidx; i++) {
+		idx = &p->idxs[i];
+		if (IDX_DROPPED & idx->flags)
+			continue;
+		if (IDX_AUTO & idx->flags) {
+			idx->tab = map[idx->tab];
+			p->tabs[idx->tab].nidx++;
+		}
+		n++;
+	}
+	for (i = 0; i < p->ntab; i++)
+		p->tabs[i].firstidx = i > 0 ?
+			p->tabs[i - 1].firstidx + p->tabs[i - 1].nidx : 0;
+
+	idxs = array_new(p, n, sizeof(struct idx));
+	idxcols = array_new(p, p->nidxcol, sizeof(struct idxcol));
+	if (NULL == idxs || NULL == idxcols) {
+		if (NULL != idxs)
+			sqlite_schema_dealloc(p, idxs, 
+				n + 1, sizeof(struct idx));
+		if (NULL != idxcols)
+			sqlite_schema_dealloc(p, idxcols, 
+				p->nidxcol + 1, sizeof(struct idxcol));
+		sqlite_schema_dealloc(p, map, mapsz, sizeof(uint32_t));
+		return(0);
+	}
+	max = p->ntab > 0 ?
+		p->tabs[p->ntab - 1].firstidx + p->tabs[p->ntab - 1].nidx : 0;
+	for (i = 0; i < p->ntab; i++)
+		p->tabs[i].nidx = 0;
+	for (i = 0; i < p->nidx; i++) {
+		idx = &p->idxs[i];
+		if (IDX_DROPPED & idx->flags)
+			continue;
+		if (IDX_AUTO & idx->flags)
+			j = p->tabs[idx->tab].firstidx +
+				p->tabs[idx->tab].nidx++;
+		else
+			j = max++;
+		idxs[j] = *idx;
+		idxs[j].idx = j;
+	}
+	for (i = j = 0; i < n; i++) {
+		memcpy(&idxcols[j], &p->idxcols[idxs[i].firstcol],
+			idxs[i].ncols * sizeof(struct idxcol));
+		idxs[i].firstcol = j;
+		j += idxs[i].ncols;
+	}
+	p->idxs = array_set(p, p->idxs, &p->idxmax, idxs, n,
+		sizeof(struct idx));
+	p->nidx = n;
+	p->idxcols = array_set(p, p->idxcols, &p->idxcolmax, idxcols, j,
+		sizeof(struct idxcol));
+	p->nidxcol = j;
+
+	/* 
+	 * Columns by table, mapping their old positions to the new.
+	 * The map of tables is no longer needed once their columns
+	 * know their new table.
+	 */
+
+	n = p->ntab > 0 ?
+		p->tabs[p->ntab - 1].firstcol + p->tabs[p->ntab - 1].ncol : 0;
+	if ( ! limit_time(p) || 
+	    NULL == (cols = array_new(p, n, sizeof(struct col)))) {
+		sqlite_schema_dealloc(p, map, mapsz, sizeof(uint32_t));
+		return(0);
+	}
+	for (i = 0; i < p->ncol; i++)
+		if (SCHEMA_NONE != p->cols[i].tab)
+			p->cols[i].tab = map[p->cols[i].tab];
+	for (i = 0; i < p->ncol; i++) {
+		if (SCHEMA_NONE == p->cols[i].tab) {
+			map[i] = SCHEMA_NONE;
+			continue;
+		}
+		j = p->tabs[p->cols[i].tab].firstcol + p->cols[i].idx;
+		cols[j] = p->cols[i];
+		map[i] = j;
+	}
+	p->cols = array_set(p, p->cols, &p->colmax, cols, n,
+		sizeof(struct col));
+	p->ncol = n;
+
+	/* Foreign keys of what remains. */
+
+	for (i = n = 0; i < p->nfkey; i++) {
+		if (SCHEMA_NONE == map[p->fkeys[i].col])
+			continue;
+		p->fkeys[n] = p->fkeys[i];
+		p->fkeys[n++].col = map[p->fkeys[i].col];
+	}
+	p->nfkey = n;
+	sqlite_schema_dealloc(p, map, mapsz, sizeof(uint32_t));
+
+	p->tabs = array_fit(p, p->tabs, 
+		p->ntab, &p->tabmax, sizeof(struct tab));
+	p->fkeys = array_fit(p, p->fkeys, 
+		p->nfkey, &p->fkeymax, sizeof(struct fkey));
+	p->strs = array_fit(p, p->strs, p->strsz, &p->strmax, 1);
+	return(1);
+}
+
+/*
+ * Sort each table's columns by name, then index tables by name: in
+ * sorted order and in an open-addressed hash table kept at most half
+ * full.
+ * Return zero if out of time or memory.
+ */
+static int
+tables(struct parse *p)
+{
+	struct sortkey	*keys;
+	struct tab	*tab;
+	uint32_t	*order;
+	size_t		 h, i, sz;
+
+	if (NULL == (order = sqlite_schema_realloc(p, NULL, 0,
+	    p->ncol + 1, sizeof(uint32_t))))
+		return(0);
+	for (i = 0; i < p->ntab; i++) {
+		tab = &p->tabs[i];
+		if ( ! limit_time(p) || 
+		    ! columns(p, tab, order + tab->firstcol)) {
+			sqlite_schema_dealloc(p, order, 
+				p->ncol + 1, sizeof(uint32_t));
+			return(0);
+		}
+	}
+	for (i = 0; i < p->nfkey; i++)
+		p->fkeys[i].col = order[p->fkeys[i].col];
+	sqlite_schema_dealloc(p, order, p->ncol + 1, sizeof(uint32_t));
+
+	for (sz = 16; sz < p->ntab * 2; )
+		sz <<= 1;
+	if (NULL == (p->tabhash = sqlite_schema_realloc(p, NULL, 0,
+	    sz, sizeof(uint32_t))))
+		return(0);
+	p->tabhashsz = sz;
+	for (h = 0; h < p->tabhashsz; h++)
+		p->tabhash[h] = SCHEMA_NONE;
+	for (i = 0; i < p->ntab; i++) {
+		h = namehash(SCHEMA_STR(p, p->tabs[i].name)) & 
+			(p->tabhashsz - 1);
+		while (SCHEMA_NONE != p->tabhash[h])
+			h = (h + 1) & (p->tabhashsz - 1);
+		p->tabhash[h] = i;
+	}
+
+	if (NULL == (p->byname = sqlite_schema_realloc(p, NULL, 0,
+	    p->ntab + 1, sizeof(uint32_t))))
+		return(0);
+	if (NULL == (keys = sqlite_schema_realloc(p, NULL, 0,
+	    p->ntab + 1, sizeof(struct sortkey))))
+		return(0);
+	for (i = 0; i < p->ntab; i++) {
+		keys[i].name = SCHEMA_STR(p, p->tabs[i].name);
+		keys[i].idx = keys[i].pos = i;
+	}
+	qsort(keys, p->ntab, sizeof(struct sortkey), keycmp);
+	for (i = 0; i < p->ntab; i++)
+		p->byname[i] = keys[i].pos;
+	sqlite_schema_dealloc(p, keys, 
+		p->ntab + 1, sizeof(struct sortkey));
+	return(1);
+}
+
+/*
+ * Look up a table by its name.
+ * Returns NULL if not found.
+ */
+struct tab *
+sqlite_schema_tab(const struct parse *p, const char *name)
+{
+	size_t	 h;
+
+	if (0 == p->tabhashsz)
+		return(NULL);
+
+	h = namehash(name) & (p->tabhashsz - 1);
+	for ( ; SCHEMA_NONE != p->tabhash[h]; 
+	     h = (h + 1) & (p->tabhashsz - 1))
+		if (0 == strcmp(SCHEMA_STR(p, 
+		    p->tabs[p->tabhash[h]].name), name))
+			return(&p->tabs[p->tabhash[h]]);
+	return(NULL);
+}
+
+/*
+ * Cross-reference foreign key entries.
+ * Skips all non-existent references.
+ * Then index them in reverse, the columns referencing each column being
+ * listed in table and column order.
+ * Return zero if out of time or memory.
+ */
+static int
+foreign_keys(struct parse *p)
+{
+	struct tab	*tab;
+	struct col	*col, *fcol;
+	struct fkey	*fkey;
+	uint32_t	 c;
+	size_t		 i, n;
+
+	for (i = 0; i < p->nfkey; i++) {
+		if ( ! limit_time(p))
+			return(0);
+		fkey = &p->fkeys[i];
+		fcol = &p->cols[fkey->col];
+		if (NULL == (tab = sqlite_schema_tab(p, 
+		    SCHEMA_STR(p, fkey->rtab)))) {
+			dogwarnx(p, "unknown foreign key "
+				"table on %s.%s: %s.%s", 
+				SCHEMA_STR(p, COL_TAB(p, fcol)->name), 
+				SCHEMA_STR(p, fcol->name), 
+				SCHEMA_STR(p, fkey->rtab), 
+				SCHEMA_STR(p, fkey->rcol));
+			continue;
+		}
+		c = column_lookup(p, tab, SCHEMA_STR(p, fkey->rcol));
+		if (SCHEMA_NONE == c) {
+			dogwarnx(p, "unknown foreign key "
+				"column on %s.%s: %s.%s", 
+				SCHEMA_STR(p, COL_TAB(p, fcol)->name), 
+				SCHEMA_STR(p, fcol->name), 
+				SCHEMA_STR(p, fkey->rtab), 
+				SCHEMA_STR(p, fkey->rcol));
+			continue;
+		}
+		if (SCHEMA_NONE != fcol->fkey) {
+			col = COL_FKEY(p, fcol);
+			dogwarnx(p, "foreign key exists: %s.%s", 
+				SCHEMA_STR(p, COL_TAB(p, col)->name), 
+				SCHEMA_STR(p, col->name));
+			continue;
+		}
+		fcol->fkey = c;
+		fcol->fkdecl = i;
+	}
+
+	/* Count, then list, the references to each column. */
+
+	for (i = n = 0; i < p->ncol; i++)
+		if (SCHEMA_NONE != p->cols[i].fkey) {
+			col = COL_FKEY(p, &p->cols[i]);
+			col->nrefs++;
+			COL_TAB(p, col)->nrefs++;
+			n++;
+		}
+	if (NULL == (p->refs = sqlite_schema_realloc(p, NULL, 0,
+	    n + 1, sizeof(uint32_t))))
+		return(0);
+	for (i = n = 0; i < p->ncol; i++) {
+		p->cols[i].firstref = n;
+		n += p->cols[i].nrefs;
+		p->cols[i].nrefs = 0;
+	}
+	TAB_FOREACH(tab, p, i)
+		COL_FOREACH(fcol, p, tab)
+			if (SCHEMA_NONE != fcol->fkey) {
+				col = COL_FKEY(p, fcol);
+				p->refs[col->firstref + col->nrefs++] = 
+					fcol - p->cols;
+			}
+	return(1);
+}
+
+/*
+ * Look up the columns of the indices of "tab", marking those columns
+ * leading an index.
+ */
+static void
+table_indices(struct parse *p, struct tab *tab)
+{
+	struct col	*col;
+	struct idx	*idx;
+	struct idxcol	*ic;
+	uint32_t	 c;
+	size_t		 i;
+
+	IDX_FOREACH(idx, p, tab)
+		for (i = 0; i < idx->ncols; i++) {
+			ic = IDXCOL(p, idx, i);
+			if (0 == ic->name)
+				continue;
+			c = column_lookup(p, tab, SCHEMA_STR(p, ic->name));
+			if (SCHEMA_NONE == c) {
+				dogwarnx(p, "unknown index "
+					"column on %s: %s.%s",
+					0 == idx->name ? "(constraint)" : 
+					SCHEMA_STR(p, idx->name),
+					SCHEMA_STR(p, tab->name), 
+					SCHEMA_STR(p, ic->name));
+				continue;
+			}
+			ic->col = c;
+			col = &p->cols[c];
+			if (0 == i)
+				col->flags |= COL_INDEXED;
+			if (IDX_PKEY & idx->flags)
+				col->flags |= COL_PKEY;
+		}
+}
+
+/*
+ * Attach indices to their tables, after those implied by constraints,
+ * and look up their columns.
+ * Indices on non-existent tables follow all others.
+ * Return zero if out of time or memory.
+ */
+static int
+indices(struct parse *p)
+{
+	struct tab	*tab;
+	struct idx	*idx, *idxs;
+	size_t		 i, j, n;
+
+	for (i = 0; i < p->nidx; i++) {
+		if ( ! limit_time(p))
+			return(0);
+		idx = &p->idxs[i];
+		if (IDX_AUTO & idx->flags)
+			continue;
+		if (NULL == (tab = sqlite_schema_tab(p, 
+		    SCHEMA_STR(p, idx->rtab)))) {
+			dogwarnx(p, "unknown index table on %s: %s",
+				SCHEMA_STR(p, idx->name), 
+				SCHEMA_STR(p, idx->rtab));
+			continue;
+		}
+		idx->tab = tab->idx;
+	}
+
+	/* Group them by table, keeping their order. */
+
+	for (i = 0; i < p->ntab; i++)
+		p->tabs[i].nidx = 0;
+	for (i = 0; i < p->nidx; i++)
+		if (SCHEMA_NONE != p->idxs[i].tab)
+			p->tabs[p->idxs[i].tab].nidx++;
+	for (i = n = 0; i < p->ntab; i++) {
+		p->tabs[i].firstidx = n;
+		n += p->tabs[i].nidx;
+		p->tabs[i].nidx = 0;
+	}
+	if (NULL == (idxs = array_new(p, p->nidx, sizeof(struct idx))))
+		return(0);
+	for (i = 0; i < p->nidx; i++) {
+		idx = &p->idxs[i];
+		if (SCHEMA_NONE == idx->tab)
+			j = n++;
+		else
+			j = p->tabs[idx->tab].firstidx +
+				p->tabs[idx->tab].nidx++;
+		idxs[j] = *idx;
+		idxs[j].idx = j;
+	}
+	p->idxs = array_set(p, p->idxs, &p->idxmax, idxs, p->nidx,
+		sizeof(struct idx));
+
+	TAB_FOREACH(tab, p, i) {
+		if ( ! limit_time(p))
+			return(0);
+		table_indices(p, tab);
+	}
+	return(1);
+}
+
+/*
+ * Read the next token of "p", skipping comments, for scanning other
+ * statements than the schema's.
+ * Unlike the schema parser, the caller sets up "p" with its own buffer,
+ * which must be writable, as comments are cleaned up in place.
+ * Returns zero at the end of the buffer.
+ */
+int
+sqlite_schema_token(struct parse *p, struct sqltok *tok)
+{
+	struct token	 t;
+
+	if (tok_nextsame(&t, p, KW_NONE, 1) < 0)
+		return(0);
+	tok->start = t.start;
+	tok->sz = t.sz;
+	tok->quot = TOK_LITERAL == t.type ? t.start[-1] : '\0';
+	tok->kw = TOK_IDENT == t.type ? t.kw : KW_NONE;
+	return(1);
+}
+
+/*
+ * Free the parse, keeping its smaller arrays for another if "keep".
+ */
+static void
+schema_free(struct parse *p, int keep)
+{
+
+	free(p->refs);
+	free(p->byname);
+	free(p->tabhash);
+	p->refs = p->byname = p->tabhash = NULL;
+	p->tabhashsz = 0;
+
+	p->ntab = p->ncol = p->nidx = p->nidxcol = p->nfkey = 0;
+	p->strsz = 0;
+	p->mem = 0;
+	p->tabs = array_free(p, p->tabs, 
+		&p->tabmax, sizeof(struct tab), keep);
+	p->cols = array_free(p, p->cols, 
+		&p->colmax, sizeof(struct col), keep);
+	p->idxs = array_free(p, p->idxs, 
+		&p->idxmax, sizeof(struct idx), keep);
+	p->idxcols = array_free(p, p->idxcols, 
+		&p->idxcolmax, sizeof(struct idxcol), keep);
+	p->fkeys = array_free(p, p->fkeys, 
+		&p->fkeymax, sizeof(struct fkey), keep);
+	p->strs = array_free(p, p->strs, &p->strmax, 1, keep);
+}
+
+void
+sqlite_schema_free(struct parse *p)
+{
+
+	schema_free(p, 0);
+}
 
-	domsg(p, "added table: %s", tab->name);
+/*
+ * Like sqlite_schema_free(), but keep the smaller arrays for parsing
+ * another schema with "p", as when parsing many in turn.
+ * The parse must still be freed with sqlite_schema_free().
+ */
+void
+sqlite_schema_reset(struct parse *p)
+{
 
-	/* Parse through all of our columns. */
+	schema_free(p, 1);
+}
 
-	if (0 == (c = tok_nextsame(tok, p, "(", 0))) {
-		dowarnx(p, "syntax error leading columns");
+/*
+ * Set a limit from "name=value", e.g., "stmt=65536".
+ * Return zero on failure and non-zero on success.
+ */
+int
+sqlite_schema_limit(struct limits *l, const char *arg)
+{
+	static const char *const names[] = {
+		"bytes", "stmt", "depth", "tables",
+		"columns", "mem", "time", NULL };
+	size_t		*vals[] = {
+		&l->bytes, &l->stmt, &l->depth, &l->tabs,
+		&l->cols, &l->mem, &l->msecs };
+	const char	*cp, *er;
+	size_t		 i, sz;
+	long long	 v;
+
+	if (NULL == (cp = strchr(arg, '='))) {
+		warnx("%s: expected name=value", arg);
 		return(0);
-	} else if (c < 0)
+	}
+	sz = cp - arg;
+	for (i = 0; NULL != names[i]; i++)
+		if (strlen(names[i]) == sz &&
+		    0 == strncmp(names[i], arg, sz))
+			break;
+	if (NULL == names[i]) {
+		warnx("%.*s: unknown limit", (int)sz, arg);
 		return(0);
-
-	while ((c = schema_column(tok, p, tab)) > 0) 
-		continue;
-	if (c < 0)
+	}
+	v = strtonum(cp + 1, 0, LLONG_MAX, &er);
+	if (NULL != er) {
+		warnx("%s: %s", arg, er);
 		return(0);
+	}
+	*vals[i] = (size_t)v;
+	return(1);
+}
 
-	if ( ! tok_strsame(tok, ")")) {
-		dowarnx(p, "syntax error trailing columns");
+/*
+ * Initialise "p" for parsing a schema from one or more files.
+ */
+static void
+parse_init(struct parse *p)
+{
+
+	p->ntab = p->ncol = p->nidx = p->nidxcol = p->nfkey = 0;
+	p->strsz = 0;
+	p->limited = 0;
+	p->deadline = NULL == p->lim || 0 == p->lim->msecs ? 0 :
+		msecs() + p->lim->msecs;
+}
+
+/*
+ * Parse the statements of "map", adding to (or altering) the schema.
+ * Return zero on failure and non-zero on success.
+ */
+static int
+parse_stmts(const char *fname, 
+	const char *map, size_t mapsz, struct parse *p) 
+{
+	int	 	 rc, c;
+	struct token	 tok;
+	char		*comment, buf[32];
+	uint64_t	 start, t;
+	size_t		 line;
+
+	if (NULL != p->lim && 0 != p->lim->bytes &&
+	    mapsz > p->lim->bytes) {
+		warnx("%s: bytes limit of %zu exceeded",
+			fname, p->lim->bytes);
 		return(0);
 	}
 
-	/* 
-	 * See if we're at the end of the table statement, which can
-	 * also have a "without rowid" clause.
+	p->i = p->line = p->col = 0;
+	p->fname = fname;
+	p->stmt = 0;
+	if (NULL == (p->map = sqlite_schema_realloc(p, NULL, 0, mapsz, 1)))
+		return(0);
+	memcpy(p->map, map, mapsz);
+	p->len = mapsz;
+	
+	/*
+	 * Top-level of parse.
+	 * Look for a statement that begins with "create", which will
+	 * indicate that we may have a table, or "alter" or "drop",
+	 * which change those already parsed.
+	 * (It might start with a comment, which we should keep track of
+	 * to pump into any new table.)
+	 * Ignore all other statements by continuing til the semicolon.
 	 */
 
-	do if ( ! tok_next(tok, p, 0))
-		return(0);
-	while (TOK_COMMENT == tok->type);
+	comment = NULL;
+	rc = 1;
+	start = sqlite_schema_trace_now();
 
-	if (tok_strsame(tok, "without")) {
-		if (0 == (c = tok_nextsame(tok, p, "rowid", 0))) {
-			dowarnx(p, "syntax error leading columns");
-			return(0);
-		} else if (c < 0)
-			return(0);
-		do if ( ! tok_next(tok, p, 0))
-			return(0);
-		while (TOK_COMMENT == tok->type);
-	}
+	while (p->i < p->len) {
+		comment_free(p, comment);
+		if ( ! limit_stmt(p))
+			break;
+		if ( ! comment_append(&tok, p, 1, &comment)) {
+			break;
+		} else if (KW_SEMI == tok.kw) {
+			continue;
+		} else if (KW_ALTER == tok.kw || KW_DROP == tok.kw) {
+			c = KW_ALTER == tok.kw ?
+				schema_alter(&tok, p) : schema_drop(&tok, p);
+			if (0 == c)
+				tok_skipstmt(p);
+			else if (c < 0) {
+				rc = 0;
+				break;
+			}
+			continue;
+		} else if (KW_CREATE != tok.kw) {
+			domsg(p, "ignoring top-level statement");
+			t = sqlite_schema_trace_now();
+			line = p->line;
+			tok_skipstmt(p);
+			if (0 != t) {
+				snprintf(buf, sizeof(buf),
+					"line %zu", line + 1);
+				sqlite_schema_trace("parse",
+					"statement", buf, t);
+			}
+			continue;
+		} 
+		
+		if (0 == (c = schema_create(&tok, p, &comment))) {
+			tok_skipstmt(p);
+			continue;
+		} else if (c < 0) {
+			rc = 0;
+			break;
+		}
 
-	if (tok_strsame(tok, ";"))
-		return(1);
+		if (KW_SEMI == tok.kw)
+			continue;
+		dowarnx(p, "bad token at end of statement");
+		rc = 0;
+		break;
+	}
 
-	dowarnx(p, "syntax error at end of table statement");
-	return(0);
+	comment_free(p, comment);
+	sqlite_schema_dealloc(p, p->map, mapsz, 1);
+	p->map = NULL;
+	sqlite_schema_trace("parse", "statements", fname, start);
+	return(p->limited ? 0 : rc);
 }
 
-/* 
- * Processes a "create xxxx" statement.
- * Returns zero on failure, <0 on end of file, or >0 at the end of the
- * creation.
- * This should be at a semicolon.
+/*
+ * Compute foreign keys and indices once all statements are parsed.
+ * Return zero if a limit was exceeded.
  */
 static int
-schema_create(struct token *tok, struct parse *p, char **comment)
+parse_resolve(struct parse *p)
 {
-	unsigned int	 flags = 0;
+	uint64_t	 t;
+	int		 rc;
+
+	t = sqlite_schema_trace_now();
+	rc = tables(p);
+	sqlite_schema_trace("parse", "tables", NULL, t);
+	if (rc) {
+		t = sqlite_schema_trace_now();
+		rc = foreign_keys(p);
+		sqlite_schema_trace("parse", "foreign_keys", NULL, t);
+	}
+	if (rc) {
+		t = sqlite_schema_trace_now();
+		rc = indices(p);
+		sqlite_schema_trace("parse", "indices", NULL, t);
+	}
+	return(rc && ! p->limited);
+}
 
-	do if ( ! tok_next(tok, p, 0))
-		return(-1);
-	while (TOK_COMMENT == tok->type);
+/*
+ * Order migrations by name, but with runs of digits compared by their
+ * value, so "9_add.sql" comes before "10_drop.sql".
+ */
+static int
+migcmp(const void *a, const void *b)
+{
+	const char	*sa = *(const char *const *)a,
+			*sb = *(const char *const *)b,
+			*ca = sa, *cb = sb;
+	size_t		 na, nb;
+	int		 c;
+
+	while ('\0' != *ca && '\0' != *cb) {
+		if ( ! isdigit((unsigned char)*ca) ||
+		    ! isdigit((unsigned char)*cb)) {
+			if (*ca != *cb)
+				break;
+			ca++;
+			cb++;
+			continue;
+		}
+		while ('0' == *ca)
+			ca++;
+		while ('0' == *cb)
+			cb++;
+		for (na = 0; isdigit((unsigned char)ca[na]); na++)
+			continue;
+		for (nb = 0; isdigit((unsigned char)cb[nb]); nb++)
+			continue;
+		if (na != nb)
+			return(na < nb ? -1 : 1);
+		if (0 != (c = strncmp(ca, cb, na)))
+			return(c);
+		ca += na;
+		cb += nb;
+	}
+	if (*ca != *cb)
+		return((unsigned char)*ca - (unsigned char)*cb);
+	return(strcmp(sa, sb));
+}
 
-	/* Pass over "temp" and "temporary" statements. */
+/*
+ * List the "*.sql" files of the directory "dir" in the order in which
+ * they're applied.
+ * Return zero on failure and non-zero on success.
+ */
+static int
+migrations(const char *dir, char ***names, size_t *namesz)
+{
+	DIR		*d;
+	struct dirent	*de;
+	size_t		 sz;
 
-	if (tok_strsame(tok, "temp") ||
-	    tok_strsame(tok, "temporary")) {
-		flags = TAB_TEMP;
-		do if ( ! tok_next(tok, p, 0))
-			return(-1);
-		while (TOK_COMMENT == tok->type);
+	*names = NULL;
+	*namesz = 0;
+	if (NULL == (d = opendir(dir))) {
+		warn("%s", dir);
+		return(0);
+	}
+	while (NULL != (de = readdir(d))) {
+		sz = strlen(de->d_name);
+		if ('.' == de->d_name[0] || sz < 5 ||
+		    strcmp(de->d_name + sz - 4, ".sql"))
+			continue;
+		*names = reallocarray(*names,
+			*namesz + 1, sizeof(char *));
+		if (NULL == *names)
+			err(EXIT_FAILURE, "reallocarray");
+		if (NULL == ((*names)[*namesz] = strdup(de->d_name)))
+			err(EXIT_FAILURE, "strdup");
+		(*namesz)++;
 	}
+	closedir(d);
+	if (0 == *namesz) {
+		warnx("%s: no migrations", dir);
+		return(0);
+	}
+	qsort(*names, *namesz, sizeof(char *), migcmp);
+	return(1);
+}
 
-	/* Try to read the "table", if it exists. */
+/*
+ * Parse the statements of "fname", opened as "fd", into "p".
+ * If "mark" is not NULL, it's set to the last migration in a snapshot
+ * or NULL if there's none.
+ * Empty files are passed over.
+ * Return zero on failure and non-zero on success.
+ */
+static int
+parse_mapped(const char *fname, int fd, struct parse *p, char **mark)
+{
+	struct stat	 st;
+	void		*map;
+	int		 rc;
 
-	if ( ! tok_strsame(tok, "table")) {
-		dowarnx(p, "ignoring non-table creation");
+	if (NULL != mark)
+		*mark = NULL;
+	if (-1 == fstat(fd, &st)) {
+		warn("%s", fname);
 		return(0);
-	} 
+	} else if (0 == st.st_size)
+		return(1);
 
-	return(schema_table(tok, p, comment, flags) ? 1 : -1);
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == map) {
+		warn("%s", fname);
+		return(0);
+	}
+
+	rc = parse_stmts(fname, map, st.st_size, p);
+	if (NULL != mark)
+		*mark = sqlite_schema_snapshot_mark(map, st.st_size);
+	if (-1 == munmap(map, st.st_size)) {
+		warn("%s", fname);
+		rc = 0;
+	}
+	return(rc);
 }
 
 /*
- * Cross-reference foreign key entries.
- * Skips all non-existent references.
+ * Replay the migrations in the directory "dir" in order.
+ * If the parse has a snapshot, start from it and replay only those
+ * migrations following the last it has, then rewrite it.
+ * Return zero on failure and non-zero on success.
  */
-static void
-foreign_keys(struct parse *p)
+static int
+parse_migrations(const char *dir, struct parse *p)
 {
-	struct tab	*tab;
-	struct col	*col;
-	struct fkey	*fkey;
+	char	**names, *path, *mark = NULL;
+	size_t	  i, namesz, first = 0;
+	int	  fd, rc = 1;
 
-	TAILQ_FOREACH(fkey, &p->fkeyq, entry) {
-		if (NULL == fkey->col)
-			continue;
-		TAILQ_FOREACH(tab, &p->tabq, entry)
-			if (0 == strcmp(tab->name, fkey->rtab))
-				break;
-		if (NULL == tab) {
-			dogwarnx(p, "unknown foreign key "
-				"table on %s.%s: %s.%s", 
-				fkey->col->tab->name, 
-				fkey->col->name, 
-				fkey->rtab, fkey->rcol);
-			continue;
+	if (NULL != p->cb && p->cb->stream) {
+		warnx("%s: migrations may not be streamed", dir);
+		return(0);
+	} else if ( ! migrations(dir, &names, &namesz))
+		return(0);
+
+	parse_init(p);
+
+	if (NULL != p->snapshot) {
+		if (-1 != (fd = open(p->snapshot, O_RDONLY, 0))) {
+			rc = parse_mapped(p->snapshot, fd, p, &mark);
+			close(fd);
+			if (rc && NULL == mark) {
+				warnx("%s: not a snapshot", p->snapshot);
+				rc = 0;
+			}
+		} else if (ENOENT != errno) {
+			warn("%s", p->snapshot);
+			rc = 0;
 		}
-		TAILQ_FOREACH(col, &tab->colq, entry)
-			if (0 == strcmp(col->name, fkey->rcol))
+	}
+
+	if (rc && NULL != mark) {
+		for (i = 0; i < namesz; i++)
+			if (0 == strcmp(names[i], mark))
 				break;
-		if (NULL == tab) {
-			dogwarnx(p, "unknown foreign key "
-				"column on %s.%s: %s.%s", 
-				fkey->col->tab->name,
-				fkey->col->name, 
-				fkey->rtab, fkey->rcol);
-			continue;
+		if (i < namesz) {
+			first = i + 1;
+			domsg(p, "snapshot has migrations "
+				"through: %s", mark);
+		} else {
+			warnx("%s: migration not in %s, "
+				"replaying all: %s",
+				p->snapshot, dir, mark);
+			schema_free(p, 1);
+			parse_init(p);
 		}
-		if (NULL != fkey->col->fkey) {
-			dogwarnx(p, "foreign key exists: %s.%s", 
-				fkey->col->fkey->tab->name, 
-				fkey->col->fkey->name);
-			continue;
+	}
+
+	for (i = first; rc && i < namesz; i++) {
+		if (-1 == asprintf(&path, "%s/%s", dir, names[i]))
+			err(EXIT_FAILURE, "asprintf");
+		if (-1 == (fd = open(path, O_RDONLY, 0))) {
+			warn("%s", path);
+			rc = 0;
+		} else {
+			rc = parse_mapped(path, fd, p, NULL);
+			close(fd);
 		}
-		fkey->col->fkey = col;
+		free(path);
 	}
-}
+	p->fname = dir;
 
-void
-sqlite_schema_free(struct parse *p)
-{
-	struct fkey	*fkey;
-	struct col	*col;
-	struct tab	*tab;
+	/* Snapshot what's left of the parse before it's resolved. */
 
-	while (NULL != (fkey = TAILQ_FIRST(&p->fkeyq))) {
-		TAILQ_REMOVE(&p->fkeyq, fkey, entry);
-		free(fkey->rtab);
-		free(fkey->rcol);
-		free(fkey);
-	}
+	if (rc)
+		rc = compact(p);
+	if (rc && NULL != p->snapshot && first < namesz)
+		sqlite_schema_snapshot(p, p->snapshot, names[namesz - 1]);
+	if (rc)
+		rc = parse_resolve(p);
 
-	while (NULL != (tab = TAILQ_FIRST(&p->tabq))) {
-		TAILQ_REMOVE(&p->tabq, tab, entry);
-		while (NULL != (col = TAILQ_FIRST(&tab->colq))) {
-			TAILQ_REMOVE(&tab->colq, col, entry);
-			free(col->name);
-			free(col->comment);
-			free(col);
-		}
-		free(tab->name);
-		free(tab->comment);
-		free(tab);
-	}
+	for (i = 0; i < namesz; i++)
+		free(names[i]);
+	free(names);
+	free(mark);
+	return(rc);
 }
 
 int
 sqlite_schema_parsefile(const char *fname, struct parse *p) 
 {
 	int	 	 fd, rc;
+	struct stat	 st;
 
 	if (-1 == (fd = open(fname, O_RDONLY, 0))) {
 		warn("%s", fname);
 		return(0);
 	}
 
-	rc = sqlite_schema_parsefd(fname, fd, p);
+	if (-1 == fstat(fd, &st)) {
+		warn("%s", fname);
+		rc = 0;
+	} else if (S_ISDIR(st.st_mode))
+		rc = parse_migrations(fname, p);
+	else
+		rc = sqlite_schema_parsefd(fname, fd, p);
+
 	if (-1 == close(fd)) {
 		warn("%s", fname);
 		rc = 0;
@@ -801,6 +3464,9 @@ sqlite_schema_parsefd(const char *fname, int fd, struct parse *p)
 	void		*map;
 	struct stat	 st;
 
+	if (-1 != (rc = sqlite_schema_parsez(fname, fd, p)))
+		return(rc);
+
 	if (-1 == fstat(fd, &st)) {
 		warn("%s", fname);
 		return(0);
@@ -825,12 +3491,23 @@ int
 sqlite_schema_parsestdin(struct parse *p) 
 {
 	char	 sbuf[BUFSIZ];
-	char	*buf;
+	char	*buf, *cp;
 	size_t	 bufsz;
 	ssize_t	 ssz;
-	int	 rc;
+	int	 rc, magic = 0;
+
+	/*
+	 * Standard input may be a pipe, so look for the magic of a
+	 * compressed stream in what's read rather than by reading it
+	 * again, once there's enough for it.
+	 * What's read is charged to the memory limit.
+	 */
+
+	p->fname = "<stdin>";
+	p->line = p->col = 0;
+	p->limited = 0;
 
-	for (rc = 0, buf = NULL, bufsz = 0; ; bufsz += ssz) {
+	for (rc = 0, buf = NULL, bufsz = 0; ; ) {
 		ssz = read(STDIN_FILENO, sbuf, sizeof(sbuf));
 		if (ssz < 0) {
 			warn("<stdin>");
@@ -840,13 +3517,29 @@ sqlite_schema_parsestdin(struct parse *p)
 				("<stdin>", buf, bufsz, p);
 			break;
 		}
-		buf = realloc(buf, bufsz + ssz);
-		if (NULL == buf)
-			err(EXIT_FAILURE, "realloc");
+		if (NULL == (cp = sqlite_schema_realloc(p, 
+		    buf, bufsz, bufsz + ssz, 1)))
+			break;
+		buf = cp;
 		memcpy(buf + bufsz, sbuf, ssz);
+		bufsz += ssz;
+		if ( ! magic && bufsz >= 4) {
+			magic = 1;
+			rc = sqlite_schema_parsezhead
+				("<stdin>", STDIN_FILENO, buf, bufsz, p);
+			if (-1 != rc)
+				break;
+			rc = 0;
+		}
+		if (NULL != p->lim && 0 != p->lim->bytes &&
+		    bufsz > p->lim->bytes) {
+			warnx("<stdin>: bytes limit of %zu exceeded",
+				p->lim->bytes);
+			break;
+		}
 	}
 
-	free(buf);
+	sqlite_schema_dealloc(p, buf, bufsz, 1);
 	return(rc);
 }
 
@@ -854,70 +3547,22 @@ int
 sqlite_schema_parsebuf(const char *fname, 
 	const char *map, size_t mapsz, struct parse *p) 
 {
-	int	 	 rc, c;
-	struct token	 tok;
-	char		*comment;
+	int	 rc;
 
 	if (0 == mapsz) {
 		warnx("%s: empty file", fname);
 		return(0);
 	}
 
-	/* Initialise relevant parts of the parser. */
+	parse_init(p);
+	rc = parse_stmts(fname, map, mapsz, p);
 
-	TAILQ_INIT(&p->tabq);
-	TAILQ_INIT(&p->fkeyq);
-	if (NULL == (p->map = malloc(mapsz))) {
-		warn("malloc");
-		return(0);
-	}
-	memcpy(p->map, map, mapsz);
-	p->i = p->line = p->col = p->ntab = 0;
-	p->len = mapsz;
-	p->fname = fname;
-	
-	/*
-	 * Top-level of parse.
-	 * Look for a statement that begins with "create", which will
-	 * indicate that we may have a table.
-	 * (It might start with a comment, which we should keep track of
-	 * to pump into any new table.)
-	 * Ignore all other statements by continuing til the semicolon.
+	/* 
+	 * On success, compute foreign keys and indices.
+	 * If streaming, there are no tables left to resolve.
 	 */
 
-	comment = NULL;
-	rc = 0;
-
-	while (p->i < p->len) {
-		free(comment);
-		if ( ! comment_append(&tok, p, 1, &comment)) {
-			rc = 1;
-			break;
-		} else if ( ! tok_strsame(&tok, "create")) {
-			domsg(p, "ignoring top-level statement");
-			tok_skipstmt(p);
-			continue;
-		} 
-		
-		if (0 == (c = schema_create(&tok, p, &comment))) {
-			tok_skipstmt(p);
-			continue;
-		} else if (c < 0)
-			break;
-
-		if (tok_strsame(&tok, ";"))
-			continue;
-		dowarnx(p, "bad token at end of statement");
-		break;
-	}
-
-	free(comment);
-
-	/* On success, compute foreign keys. */
-
-	if (1 == rc)
-		foreign_keys(p);
-
-	free(p->map);
+	if (rc && (NULL == p->cb || ! p->cb->stream))
+		rc = compact(p) && parse_resolve(p);
 	return(rc);
 }
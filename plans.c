@@ -0,0 +1,215 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <ctype.h>
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "extern.h"
+
+#define	AUTOINDEX	 "sqlite_autoindex_"
+
+/*
+ * Next whitespace-separated word of "*cp", NUL-terminated in place, or
+ * NULL at the end of the line.
+ */
+static char *
+plans_word(char **cp)
+{
+	char	*word;
+
+	while (isspace((unsigned char)**cp))
+		(*cp)++;
+	if ('\0' == **cp)
+		return(NULL);
+	word = *cp;
+	while ('\0' != **cp && ! isspace((unsigned char)**cp))
+		(*cp)++;
+	if ('\0' != **cp)
+		*(*cp)++ = '\0';
+	return(word);
+}
+
+/*
+ * Whether the index is the primary key of a rowid table aliasing the
+ * rowid, which SQLite doesn't create.
+ */
+static int
+isrowid(const struct parse *p, const struct idx *idx)
+{
+	const struct idxcol *ic;
+
+	if ( ! (IDX_PKEY & idx->flags) || 1 != idx->ncols ||
+	    (TAB_WITHOUT_ROWID & p->tabs[idx->tab].flags) ||
+	    SCHEMA_NONE == (ic = IDXCOL(p, idx, 0))->col)
+		return(0);
+	return(0 == strcasecmp
+		(SCHEMA_STR(p, p->cols[ic->col].type), "integer"));
+}
+
+/*
+ * Look up an index of "tab" by name.
+ * Those from constraints are named by SQLite as "sqlite_autoindex_"
+ * and the table name, then their number in order of declaration.
+ */
+static const struct idx *
+plans_idx(const struct parse *p, const struct tab *tab, const char *name)
+{
+	const struct idx *idx;
+	const char	 *cp;
+	size_t		  n, sz = strlen(AUTOINDEX);
+
+	if (strncmp(name, AUTOINDEX, sz) ||
+	    NULL == (cp = strrchr(name, '_'))) {
+		IDX_FOREACH(idx, p, tab)
+			if (0 != idx->name &&
+			    0 == strcmp(SCHEMA_STR(p, idx->name), name))
+				return(idx);
+		return(NULL);
+	}
+
+	n = strtoul(cp + 1, NULL, 10);
+	IDX_FOREACH(idx, p, tab)
+		if ((IDX_AUTO & idx->flags) && ! isrowid(p, idx) && 0 == --n)
+			return(idx);
+	return(NULL);
+}
+
+/*
+ * Parse the "SCAN" or "SEARCH" (having "scan" set or not) detail at
+ * "cp" of a plan line, e.g., "SEARCH t USING INDEX i (a=?)".
+ * The table may be preceded by "TABLE" in older versions, and be
+ * followed by "AS" and an alias.
+ */
+static void
+plans_detail(const struct parse *p, struct plans *pl,
+	char *cp, int scan)
+{
+	const struct tab *tab;
+	const struct idx *idx = NULL;
+	char		 *word;
+
+	if (NULL == (word = plans_word(&cp)))
+		return;
+	if (0 == strcmp(word, "TABLE") && NULL == (word = plans_word(&cp)))
+		return;
+
+	/* Subqueries, constant rows, etc. aren't in the schema. */
+
+	if (NULL == (tab = sqlite_schema_tab(p, word)))
+		return;
+	if (scan)
+		pl->scans[tab->idx]++;
+	else
+		pl->searches[tab->idx]++;
+
+	while (NULL != (word = plans_word(&cp)))
+		if (0 == strcmp(word, "USING"))
+			break;
+	if (NULL == word || NULL == (word = plans_word(&cp)))
+		return;
+
+	/* Automatic indices are made just for the query. */
+
+	if (0 == strcmp(word, "AUTOMATIC"))
+		return;
+	if (0 == strcmp(word, "PRIMARY")) {
+		IDX_FOREACH(idx, p, tab)
+			if (IDX_PKEY & idx->flags)
+				break;
+		if (idx == &p->idxs[tab->firstidx + tab->nidx])
+			idx = NULL;
+	} else {
+		while (NULL != word && strcmp(word, "INDEX"))
+			word = plans_word(&cp);
+		if (NULL == word || NULL == (word = plans_word(&cp)))
+			return;
+		idx = plans_idx(p, tab, word);
+	}
+	if (NULL != idx)
+		pl->uses[idx->idx]++;
+}
+
+/*
+ * Read the captured output of "explain query plan" in "fname", noting
+ * for each table how many times it's scanned and searched, and for
+ * each index how many times it's used.
+ * Plan lines may be as output by sqlite3(1), tree and all, or as the
+ * "detail" of each row.
+ * Return zero on failure and non-zero on success.
+ */
+int
+sqlite_schema_plans(const struct parse *p, const char *fname,
+	struct plans *pl)
+{
+	FILE		*f;
+	char		*line = NULL, *cp;
+	size_t		 linesz = 0;
+	int		 rc = 1;
+
+	if (NULL == pl->scans) {
+		pl->scans = calloc(p->ntab + 1, sizeof(size_t));
+		pl->searches = calloc(p->ntab + 1, sizeof(size_t));
+		pl->uses = calloc(p->nidx + 1, sizeof(size_t));
+		if (NULL == pl->scans || NULL == pl->searches ||
+		    NULL == pl->uses)
+			err(EXIT_FAILURE, "calloc");
+	}
+
+	if (NULL == (f = fopen(fname, "r"))) {
+		warn("%s", fname);
+		return(0);
+	}
+
+	while (getline(&line, &linesz, f) > 0) {
+		for (cp = line; '\0' != *cp; cp++) {
+			if (cp > line && (isalnum((unsigned char)cp[-1]) ||
+			    '_' == cp[-1]))
+				continue;
+			if (0 == strncmp(cp, "SCAN ", 5)) {
+				plans_detail(p, pl, cp + 5, 1);
+				pl->nlines++;
+				break;
+			} else if (0 == strncmp(cp, "SEARCH ", 7)) {
+				plans_detail(p, pl, cp + 7, 0);
+				pl->nlines++;
+				break;
+			}
+		}
+	}
+
+	if (ferror(f)) {
+		warn("%s", fname);
+		rc = 0;
+	}
+	free(line);
+	fclose(f);
+	return(rc);
+}
+
+void
+sqlite_schema_plans_free(struct plans *pl)
+{
+
+	free(pl->scans);
+	free(pl->searches);
+	free(pl->uses);
+	memset(pl, 0, sizeof(struct plans));
+}
@@ -0,0 +1,110 @@
+#! /bin/sh
+#
+# Run sqlite2html over pathological schemas with and without limits.
+# Each run must exit with the given status and, if failing, report the
+# limit it exceeded.
+# Last, check that tables split into pages each get their own.
+
+BIN=${BIN:-./sqlite2html}
+TMP=`mktemp -d` || exit 1
+trap 'rm -rf "$TMP"' 0
+FAIL=0
+
+# check name status limit [diagnostic]
+check()
+{
+	"$BIN" -x "$3" "$TMP/$1.sql" >/dev/null 2>"$TMP/$1.err"
+	rc=$?
+	if [ $rc -ne $2 ]
+	then
+		echo "$1 ($3): exit status $rc, expected $2" 1>&2
+		FAIL=1
+	elif [ -n "$4" ] && ! grep -q "$4" "$TMP/$1.err"
+	then
+		echo "$1 ($3): missing diagnostic: $4" 1>&2
+		FAIL=1
+	else
+		echo "$1 ($3): ok"
+	fi
+}
+
+# A column default nested 100,000 parentheses deep.
+
+awk 'BEGIN {
+	printf("create table t (a integer default ");
+	for (i = 0; i < 100000; i++)
+		printf("(");
+	printf("1");
+	for (i = 0; i < 100000; i++)
+		printf(")");
+	print(");");
+}' >"$TMP/nest.sql"
+check nest 1 depth=64 "depth limit of 64 exceeded"
+check nest 0 depth=0
+
+# A comment of 512 KB before a table.
+
+awk 'BEGIN {
+	printf("/*");
+	for (i = 0; i < 65536; i++)
+		printf(" comment");
+	print(" */");
+	print("create table t (a integer);");
+}' >"$TMP/comment.sql"
+check comment 1 stmt=65536 "stmt limit of 65536 exceeded"
+check comment 0 stmt=1048576
+check comment 1 mem=262144 "mem limit of 262144 exceeded"
+
+# A table of 100,000 columns.
+
+awk 'BEGIN {
+	printf("create table t (c0 integer");
+	for (i = 1; i < 100000; i++)
+		printf(",\n c%d integer", i);
+	print(");");
+}' >"$TMP/cols.sql"
+check cols 1 columns=1000 "columns limit of 1000 exceeded"
+check cols 0 columns=100000
+
+# 200,000 tables, each with a foreign key to itself.
+
+awk 'BEGIN {
+	for (i = 0; i < 200000; i++)
+		printf("create table t%d (a integer references t%d(a));\n",
+		    i, i);
+}' >"$TMP/time.sql"
+check time 1 time=50 "time limit of 50 exceeded"
+
+# A table of 60,000 columns, each a foreign key to itself, which must
+# resolve well within its budget.
+
+awk 'BEGIN {
+	printf("create table t (c0 integer references t(c0)");
+	for (i = 1; i < 60000; i++)
+		printf(",\n c%d integer references t(c%d)", i, i);
+	print(");");
+}' >"$TMP/fkeys.sql"
+check fkeys 0 time=2000
+
+# Tables whose names have the same identifier, each on its own page.
+
+cat >"$TMP/pages.sql" <<EOF
+create table "a b" (id integer);
+create table a_b (id integer, x text);
+create table "A_B-1" (y integer);
+EOF
+"$BIN" -g 1 -d "$TMP/pages" "$TMP/pages.sql"
+rc=$?
+if [ $rc -ne 0 ]
+then
+	echo "pages: exit status $rc, expected 0" 1>&2
+	FAIL=1
+elif [ `ls "$TMP/pages" | wc -l` -ne 4 ]
+then
+	echo "pages: tables share pages:" `ls "$TMP/pages"` 1>&2
+	FAIL=1
+else
+	echo "pages: ok"
+fi
+
+exit $FAIL
@@ -0,0 +1,326 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+/*
+ * Report foreign key columns that don't lead any index (or primary
+ * key): every update or delete on the parent must scan the child.
+ */
+static void
+report_unindexed(const struct parse *p)
+{
+	const struct tab *tab;
+	const struct col *col, *fcol;
+	size_t		  i;
+
+	TAB_FOREACH(tab, p, i)
+		COL_FOREACH(col, p, tab) {
+			if ( ! COL_FKEY_UNINDEXED(col))
+				continue;
+			fcol = COL_FKEY(p, col);
+			printf("unindexed\t%s\t%s\t%s\t%s\n",
+				SCHEMA_STR(p, tab->name), 
+				SCHEMA_STR(p, col->name),
+				SCHEMA_STR(p, COL_TAB(p, fcol)->name),
+				SCHEMA_STR(p, fcol->name));
+		}
+}
+
+/*
+ * Report the estimated row footprint of each table given the page
+ * size.
+ */
+static void
+report_storage(const struct parse *p, size_t pagesz)
+{
+	const struct tab *tab;
+	struct storage	  st;
+	const char	 *ovf;
+	size_t		  i;
+
+	TAB_FOREACH(tab, p, i) {
+		sqlite_schema_storage(p, tab, pagesz, &st);
+		switch (st.overflow) {
+		case (OVERFLOW_LIKELY):
+			ovf = "likely";
+			break;
+		case (OVERFLOW_POSSIBLE):
+			ovf = "possible";
+			break;
+		default:
+			ovf = "none";
+			break;
+		}
+		printf("storage\t%s\t%zu\t%zu\t%zu\t%zu\t%zu\t%s\n",
+			SCHEMA_STR(p, tab->name), (size_t)tab->ncol, 
+			st.hdr, st.payload, st.cell, st.rows, ovf);
+	}
+}
+
+/*
+ * Answer each "from:to" query with the shortest join path between the
+ * two tables, following foreign keys in either direction.
+ * Each hop is printed as the joined columns.
+ */
+static int
+report_paths(const struct parse *p, char **qs, size_t qsz)
+{
+	struct graph	  g;
+	struct bfs	  b;
+	const struct col *col, *fcol;
+	const struct tab *from, *to;
+	uint32_t	 *path;
+	size_t		  i, j, n;
+	char		 *cp;
+	int		  rc = 1;
+
+	sqlite_schema_graph(p, &g);
+	sqlite_schema_bfs_init(&g, &b);
+	if (NULL == (path = calloc(p->ntab + 1, sizeof(uint32_t))))
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < qsz; i++) {
+		cp = strchr(qs[i], ':');
+		*cp++ = '\0';
+		if (NULL == (from = sqlite_schema_tab(p, qs[i]))) {
+			warnx("%s: unknown table", qs[i]);
+			rc = 0;
+			continue;
+		} else if (NULL == (to = sqlite_schema_tab(p, cp))) {
+			warnx("%s: unknown table", cp);
+			rc = 0;
+			continue;
+		}
+		sqlite_schema_bfs(&g, &b, from->idx, 
+			GRAPH_FWD | GRAPH_REV, 0);
+		if (UINT32_MAX == b.dist[to->idx]) {
+			printf("path\t%s\t%s\tnone\n", 
+				SCHEMA_STR(p, from->name), 
+				SCHEMA_STR(p, to->name));
+			continue;
+		}
+		n = sqlite_schema_bfs_path(p, &b, to->idx, path);
+		printf("path\t%s\t%s\t%zu", SCHEMA_STR(p, from->name), 
+			SCHEMA_STR(p, to->name), n);
+		for (j = 0; j < n; j++) {
+			col = &p->cols[path[j]];
+			fcol = COL_FKEY(p, col);
+			printf("\t%s.%s=%s.%s", 
+				SCHEMA_STR(p, COL_TAB(p, col)->name), 
+				SCHEMA_STR(p, col->name),
+				SCHEMA_STR(p, COL_TAB(p, fcol)->name), 
+				SCHEMA_STR(p, fcol->name));
+		}
+		putchar('\n');
+	}
+
+	free(path);
+	sqlite_schema_bfs_free(&b);
+	sqlite_schema_graph_free(&g);
+	return(rc);
+}
+
+/*
+ * Print the tables with non-zero degree as ranked by "deg" (by table
+ * index), most first and otherwise by name, as "key" objects.
+ * A counting sort over the name-ordered tables keeps this linear.
+ */
+static void
+json_rank(const struct parse *p, const char *name, 
+	const char *key, const size_t *deg, size_t max)
+{
+	const struct tab *tab;
+	uint32_t	 *tabs;
+	size_t		 *off, i;
+
+	tabs = calloc(p->ntab + 1, sizeof(uint32_t));
+	off = calloc(max + 2, sizeof(size_t));
+	if (NULL == tabs || NULL == off)
+		err(EXIT_FAILURE, "calloc");
+
+	TAB_FOREACH(tab, p, i)
+		off[max - deg[tab->idx] + 1]++;
+	for (i = 0; i < max; i++)
+		off[i + 1] += off[i];
+	TAB_FOREACH(tab, p, i)
+		tabs[off[max - deg[tab->idx]]++] = tab->idx;
+
+	printf(",\n\"%s\":[", name);
+	for (i = 0; i < p->ntab && deg[tabs[i]] > 0; i++) {
+		printf("%s\n{\"table\":", i > 0 ? "," : "");
+		sqlite_schema_json_puts(stdout, 
+			SCHEMA_STR(p, p->tabs[tabs[i]].name));
+		printf(",\"%s\":%zu}", key, deg[tabs[i]]);
+	}
+	putchar(']');
+
+	free(tabs);
+	free(off);
+}
+
+/*
+ * Analyse the foreign key graph as JSON: the cycles (tables in each
+ * cyclic component), the load levels (tables that may be loaded
+ * together once all earlier levels are, those in a cycle together),
+ * and the tables ranked by referencing foreign keys (fan-in) and by
+ * their own (fan-out).
+ * All of this is linear in the tables and foreign keys.
+ */
+static void
+report_analysis(const struct parse *p)
+{
+	struct graph	  g;
+	struct scc	  s;
+	uint32_t	 *tabs;
+	size_t		 *off, *deg, i, j, n, max;
+
+	sqlite_schema_graph(p, &g);
+	sqlite_schema_scc(&g, &s);
+
+	tabs = calloc(p->ntab + 1, sizeof(uint32_t));
+	off = calloc(p->ntab + 2, sizeof(size_t));
+	deg = calloc(p->ntab + 1, sizeof(size_t));
+	if (NULL == tabs || NULL == off || NULL == deg)
+		err(EXIT_FAILURE, "calloc");
+
+	sqlite_schema_scc_tabs(p, &s, 0, tabs, off);
+	fputs("{\"cycles\":[", stdout);
+	for (n = i = 0; i < s.ncomp; i++) {
+		if ( ! s.cyclic[i])
+			continue;
+		printf("%s\n[", n++ > 0 ? "," : "");
+		for (j = off[i]; j < off[i + 1]; j++) {
+			if (j > off[i])
+				putchar(',');
+			sqlite_schema_json_puts(stdout, 
+				SCHEMA_STR(p, p->tabs[tabs[j]].name));
+		}
+		putchar(']');
+	}
+	puts("],");
+
+	sqlite_schema_scc_tabs(p, &s, 1, tabs, off);
+	fputs("\"levels\":[", stdout);
+	for (i = 0; i < s.nlevel; i++) {
+		printf("%s\n[", i > 0 ? "," : "");
+		for (j = off[i]; j < off[i + 1]; j++) {
+			if (j > off[i])
+				putchar(',');
+			sqlite_schema_json_puts(stdout, 
+				SCHEMA_STR(p, p->tabs[tabs[j]].name));
+		}
+		putchar(']');
+	}
+	putchar(']');
+
+	for (max = i = 0; i < p->ntab; i++)
+		if ((deg[i] = g.rev[i + 1] - g.rev[i]) > max)
+			max = deg[i];
+	json_rank(p, "fanin", "refs", deg, max);
+	for (max = i = 0; i < p->ntab; i++)
+		if ((deg[i] = g.fwd[i + 1] - g.fwd[i]) > max)
+			max = deg[i];
+	json_rank(p, "fanout", "fkeys", deg, max);
+	puts("}");
+
+	free(tabs);
+	free(off);
+	free(deg);
+	sqlite_schema_scc_free(&s);
+	sqlite_schema_graph_free(&g);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int	 	 rc, c, analyse = 0;
+	struct parse	 p;
+	size_t		 pagesz = 4096, qsz = 0;
+	const char	*er;
+	char		**qs = NULL;
+	struct limits	 lim;
+
+	memset(&p, 0, sizeof(struct parse));
+	memset(&lim, 0, sizeof(struct limits));
+	p.lim = &lim;
+
+	while (-1 != (c = getopt(argc, argv, "aK:q:s:vx:"))) 
+		switch (c) {
+		case ('a'):
+			analyse = 1;
+			break;
+		case ('K'):
+			p.snapshot = optarg;
+			break;
+		case ('q'):
+			if (NULL == strchr(optarg, ':'))
+				errx(EXIT_FAILURE, "-q %s: expected "
+					"from:to", optarg);
+			qs = reallocarray(qs, qsz + 1, sizeof(char *));
+			if (NULL == qs)
+				err(EXIT_FAILURE, "reallocarray");
+			qs[qsz++] = optarg;
+			break;
+		case ('s'):
+			pagesz = strtonum(optarg, 512, 65536, &er);
+			if (NULL != er || (pagesz & (pagesz - 1)))
+				errx(EXIT_FAILURE, "-s %s: bad page size", optarg);
+			break;
+		case ('v'):
+			p.verbose = 1;
+			break;
+		case ('x'):
+			if ( ! sqlite_schema_limit(&lim, optarg))
+				return(EXIT_FAILURE);
+			break;
+		default:
+			goto usage;
+		}
+
+	argc -= optind;
+	argv += optind;
+
+	if (0 == argc)
+		rc = sqlite_schema_parsestdin(&p);
+	else 
+		rc = sqlite_schema_parsefile(argv[0], &p);
+
+	if (rc > 0 && analyse) {
+		report_analysis(&p);
+	} else if (rc > 0 && qsz > 0) {
+		rc = report_paths(&p, qs, qsz);
+	} else if (rc > 0) {
+		report_unindexed(&p);
+		report_storage(&p, pagesz);
+	}
+
+	free(qs);
+	sqlite_schema_free(&p);
+	return(rc ? EXIT_SUCCESS : EXIT_FAILURE);
+
+usage:
+	fprintf(stderr, "usage: %s [-av] [-K snapshot] [-q from:to] "
+		"[-s pagesize] [-x limit=value] file\n", getprogname());
+	return(EXIT_FAILURE);
+}
@@ -0,0 +1,111 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Search the index written by sqlite2html -i at "url" as the user types
+ * into the "input" element, filling the "output" list with links to at
+ * most "max" (default 50) matching tables and columns.
+ * Each word typed must prefix a term of the table or column.
+ */
+function sqliteSearch(url, input, output, max)
+{
+	var xhr = new XMLHttpRequest();
+
+	if (typeof max === 'undefined')
+		max = 50;
+
+	xhr.onload = function() {
+		var idx;
+
+		if (xhr.status !== 200)
+			return;
+		idx = JSON.parse(xhr.responseText);
+		input.oninput = function() {
+			sqliteSearchShow(idx, input.value, output, max);
+		};
+		sqliteSearchShow(idx, input.value, output, max);
+	};
+	xhr.open('GET', url);
+	xhr.send();
+}
+
+/*
+ * Return the sorted documents with terms prefixed by "word".
+ * The first term is found by binary search.
+ */
+function sqliteSearchWord(idx, word)
+{
+	var lo = 0, hi = idx.terms.length, mid, docs = {}, i, j, res = [];
+
+	while (lo < hi) {
+		mid = (lo + hi) >>> 1;
+		if (idx.terms[mid] < word)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (i = lo; i < idx.terms.length; i++) {
+		if (idx.terms[i].lastIndexOf(word, 0) !== 0)
+			break;
+		for (j = 0; j < idx.postings[i].length; j++)
+			docs[idx.postings[i][j]] = 1;
+	}
+	for (i in docs)
+		res.push(+i);
+	return res.sort(function(a, b) { return a - b; });
+}
+
+function sqliteSearchShow(idx, query, output, max)
+{
+	var words, docs, next, res, i, j, k, doc, li, a, name, id;
+
+	while (output.firstChild)
+		output.removeChild(output.firstChild);
+
+	words = query.toLowerCase().split(/[^a-z0-9]+/).filter
+		(function(w) { return w.length > 0; });
+	if (words.length === 0)
+		return;
+
+	/* Intersect the documents of each word. */
+
+	docs = sqliteSearchWord(idx, words[0]);
+	for (i = 1; i < words.length && docs.length > 0; i++) {
+		next = sqliteSearchWord(idx, words[i]);
+		res = [];
+		for (j = k = 0; j < docs.length && k < next.length; )
+			if (docs[j] < next[k])
+				j++;
+			else if (docs[j] > next[k])
+				k++;
+			else
+				res.push(docs[j++]), k++;
+		docs = res;
+	}
+
+	for (i = 0; i < docs.length && i < max; i++) {
+		doc = idx.docs[docs[i]];
+		name = doc.slice(1).join('.');
+		id = name.replace(/[^A-Za-z0-9_.-]/g, '_');
+		a = document.createElement('a');
+		a.href = idx.pages[doc[0]] + '#' + idx.prefix + '-' + id;
+		a.appendChild(document.createTextNode(name));
+		li = document.createElement('li');
+		li.appendChild(a);
+		output.appendChild(li);
+	}
+}
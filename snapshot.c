@@ -0,0 +1,364 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <ctype.h>
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "extern.h"
+
+/*
+ * A snapshot is the schema as one "create" statement for each table
+ * and index, which parses back into the same schema, followed by a
+ * line naming the last migration it has.
+ */
+#define	MARK	 "-- snapshot: "
+
+/*
+ * Write a name, quoted so that it's never taken as a keyword.
+ */
+static void
+snapshot_name(FILE *f, const char *name)
+{
+	int	 q = NULL == strchr(name, '"') ? '"' : '\'';
+
+	fprintf(f, "%c%s%c", q, name, q);
+}
+
+/*
+ * Write "cp" as line comments that are read back as the same comment.
+ * Newlines are only kept by lines of white-space, so a line with text
+ * before a newline is followed by an empty one.
+ */
+static void
+snapshot_comment(FILE *f, const char *cp)
+{
+	const char	*nl;
+	size_t		 i, sz;
+	int		 ws;
+
+	if (NULL == cp)
+		return;
+
+	for (;;) {
+		nl = strchr(cp, '\n');
+		sz = NULL == nl ? strlen(cp) : (size_t)(nl - cp);
+		for (ws = 1, i = 0; ws && i < sz; i++)
+			ws = isspace((unsigned char)cp[i]);
+		if (NULL == nl) {
+			if ( ! ws)
+				fprintf(f, "--%s\n", cp);
+			return;
+		}
+		fprintf(f, "--%.*s\n", (int)sz, cp);
+		if ( ! ws)
+			fputs("--\n", f);
+		cp = nl + 1;
+	}
+}
+
+static void
+snapshot_idxcols(FILE *f, const struct parse *p, const struct idx *idx)
+{
+	const struct idxcol *ic;
+	size_t		  i;
+
+	fputs(" (", f);
+	for (i = 0; i < idx->ncols; i++) {
+		if (i > 0)
+			fputs(", ", f);
+		ic = IDXCOL(p, idx, i);
+		if (0 != ic->name)
+			snapshot_name(f, SCHEMA_STR(p, ic->name));
+		else
+			fputs(SCHEMA_STR(p, ic->expr), f);
+	}
+	fputc(')', f);
+}
+
+/*
+ * Write the table constraint implying "idx".
+ */
+static void
+snapshot_constraint(FILE *f, const struct parse *p, const struct idx *idx)
+{
+
+	fputs((IDX_PKEY & idx->flags) ? "\tprimary key" : "\tunique", f);
+	snapshot_idxcols(f, p, idx);
+}
+
+/*
+ * Write the separator before the next column or table constraint.
+ */
+static void
+snapshot_sep(FILE *f, int *first)
+{
+
+	if ( ! *first)
+		fputs(",\n", f);
+	*first = 0;
+}
+
+/*
+ * If "idx" is the column constraint of the column "col" or one
+ * following it before "end", return that column.
+ */
+static const struct col *
+snapshot_colidx(const struct parse *p, const struct idx *idx,
+	const struct col *col, const struct col *end)
+{
+	unsigned int	 flag;
+
+	if (1 != idx->ncols || 0 == IDXCOL(p, idx, 0)->name)
+		return(NULL);
+	flag = (IDX_PKEY & idx->flags) ? COL_PKEY : COL_UNIQUE;
+	for ( ; col < end; col++)
+		if (0 == strcmp(SCHEMA_STR(p, col->name), 
+		    SCHEMA_STR(p, IDXCOL(p, idx, 0)->name)))
+			return((flag & col->flags) ? col : NULL);
+	return(NULL);
+}
+
+/*
+ * Write a column, before "end", with the constraints implying the
+ * indices before "idxend" starting with "*idxp" (if not NULL),
+ * advancing it past them.
+ * As SQLite wants, "autoincrement" directly follows "primary key".
+ */
+static void
+snapshot_col(FILE *f, const struct parse *p, const struct col *col,
+	const struct col *end, const struct idx **idxp, 
+	const struct idx *idxend)
+{
+	const struct idx *idx;
+	int		  autoinc = COL_AUTOINC & col->flags;
+
+	snapshot_comment(f, SCHEMA_OPT(p, col->comment));
+	fputc('\t', f);
+	snapshot_name(f, SCHEMA_STR(p, col->name));
+	if (0 != col->type)
+		fprintf(f, " %s", SCHEMA_STR(p, col->type));
+	if (NULL != idxp) {
+		for (idx = *idxp; idx < idxend; idx++) {
+			if (col != snapshot_colidx(p, idx, col, end))
+				break;
+			if ( ! (IDX_PKEY & idx->flags)) {
+				fputs(" unique", f);
+				continue;
+			}
+			fputs(" primary key", f);
+			if (autoinc)
+				fputs(" autoincrement", f);
+			autoinc = 0;
+		}
+		*idxp = idx;
+	}
+	if (COL_NOTNULL & col->flags)
+		fputs(" not null", f);
+	if (autoinc)
+		fputs(" autoincrement", f);
+	if (0 != col->def)
+		fprintf(f, " default %s", SCHEMA_STR(p, col->def));
+}
+
+/*
+ * Whether any index from "idx" onward, before "idxend", is the column
+ * constraint of "col" or one following it before "end".
+ */
+static int
+snapshot_colidx_after(const struct parse *p, const struct idx *idx,
+	const struct idx *idxend, const struct col *col, 
+	const struct col *end)
+{
+
+	for ( ; idx < idxend; idx++)
+		if (NULL != snapshot_colidx(p, idx, col, end))
+			return(1);
+	return(0);
+}
+
+/*
+ * Write a table with its "nfks" foreign keys.
+ * Columns are written in order, each with the constraints implying
+ * automatic indices on it alone, then the remaining constraints.
+ * So that the table's indices are in the same order, constraints are
+ * only placed between columns if followed by those of a column.
+ */
+static void
+snapshot_tab(FILE *f, const struct parse *p, const struct tab *tab,
+	const uint32_t *fks, size_t nfks)
+{
+	const struct col  *col, *icol, *end;
+	const struct idx  *idx, *idxend;
+	const struct fkey *fkey;
+	size_t		   i;
+	int		   first = 1;
+
+	snapshot_comment(f, SCHEMA_OPT(p, tab->comment));
+	fprintf(f, "create %stable %s",
+		(TAB_TEMP & tab->flags) ? "temp " : "",
+		(TAB_IF_NOT_EXIST & tab->flags) ? "if not exists " : "");
+	snapshot_name(f, SCHEMA_STR(p, tab->name));
+	fputs(" (\n", f);
+
+	col = &p->cols[tab->firstcol];
+	end = col + tab->ncol;
+	idx = &p->idxs[tab->firstidx];
+	idxend = idx + tab->nidx;
+	while (idx < idxend && 
+	    snapshot_colidx_after(p, idx, idxend, col, end)) {
+		if (NULL != (icol = snapshot_colidx(p, idx, col, end))) {
+			for ( ; col != icol; col++) {
+				snapshot_sep(f, &first);
+				snapshot_col(f, p, col, end, NULL, NULL);
+			}
+			snapshot_sep(f, &first);
+			snapshot_col(f, p, col, end, &idx, idxend);
+			col++;
+			continue;
+		}
+		snapshot_sep(f, &first);
+		snapshot_constraint(f, p, idx);
+		idx++;
+	}
+	for ( ; col < end; col++) {
+		snapshot_sep(f, &first);
+		snapshot_col(f, p, col, end, NULL, NULL);
+	}
+	for ( ; idx < idxend; idx++) {
+		snapshot_sep(f, &first);
+		snapshot_constraint(f, p, idx);
+	}
+
+	for (i = 0; i < nfks; i++) {
+		fkey = &p->fkeys[fks[i]];
+		snapshot_sep(f, &first);
+		fputs("\tforeign key (", f);
+		snapshot_name(f, SCHEMA_STR(p, p->cols[fkey->col].name));
+		fputs(") references ", f);
+		snapshot_name(f, SCHEMA_STR(p, fkey->rtab));
+		fputs(" (", f);
+		snapshot_name(f, SCHEMA_STR(p, fkey->rcol));
+		fputc(')', f);
+		if (FKACT_NONE != fkey->ondelete)
+			fprintf(f, " on delete %s",
+				fkacts[fkey->ondelete]);
+		if (FKACT_NONE != fkey->onupdate)
+			fprintf(f, " on update %s",
+				fkacts[fkey->onupdate]);
+	}
+
+	fputs("\n)", f);
+	if (TAB_WITHOUT_ROWID & tab->flags)
+		fputs(" without rowid", f);
+	if ((TAB_WITHOUT_ROWID & tab->flags) && (TAB_STRICT & tab->flags))
+		fputc(',', f);
+	if (TAB_STRICT & tab->flags)
+		fputs(" strict", f);
+	fputs(";\n\n", f);
+}
+
+static void
+snapshot_idx(FILE *f, const struct parse *p, const struct idx *idx)
+{
+
+	snapshot_comment(f, SCHEMA_OPT(p, idx->comment));
+	fprintf(f, "create %sindex %s",
+		(IDX_UNIQUE & idx->flags) ? "unique " : "",
+		(IDX_IF_NOT_EXIST & idx->flags) ? "if not exists " : "");
+	snapshot_name(f, SCHEMA_STR(p, idx->name));
+	fputs(" on ", f);
+	snapshot_name(f, SCHEMA_STR(p, idx->rtab));
+	snapshot_idxcols(f, p, idx);
+	if (IDX_PARTIAL & idx->flags)
+		fprintf(f, " where %s", SCHEMA_STR(p, idx->where));
+	fputs(";\n\n", f);
+}
+
+/*
+ * Atomically write the schema of "p", having the migrations through
+ * "last", as a snapshot to "fname".
+ * The schema must not yet have been resolved, only compacted, as the
+ * order of the tables and their columns is that of their declaration.
+ */
+void
+sqlite_schema_snapshot(const struct parse *p,
+	const char *fname, const char *last)
+{
+	struct ofile	   o;
+	FILE		  *f;
+	uint32_t	  *fks;
+	size_t		  *ends, i, t;
+	uint64_t	   start = sqlite_schema_trace_now();
+
+	/*
+	 * Bucket foreign keys by the declaration order of their table.
+	 * Once filled, "ends" has where the keys of each table end.
+	 */
+
+	if (NULL == (ends = calloc(p->ntab + 1, sizeof(size_t))))
+		err(EXIT_FAILURE, "calloc");
+	for (i = 0; i < p->nfkey; i++)
+		ends[p->cols[p->fkeys[i].col].tab + 1]++;
+	for (t = 1; t <= p->ntab; t++)
+		ends[t] += ends[t - 1];
+	if (NULL == (fks = reallocarray(NULL,
+	    p->nfkey + 1, sizeof(uint32_t))))
+		err(EXIT_FAILURE, "reallocarray");
+	for (i = 0; i < p->nfkey; i++)
+		fks[ends[p->cols[p->fkeys[i].col].tab]++] = i;
+
+	f = sqlite_schema_fopen(&o, fname);
+	for (i = 0; i < p->ntab; i++) {
+		t = 0 == i ? 0 : ends[i - 1];
+		snapshot_tab(f, p, &p->tabs[i], fks + t, ends[i] - t);
+	}
+	for (i = 0; i < p->nidx; i++)
+		if ( ! (IDX_AUTO & p->idxs[i].flags))
+			snapshot_idx(f, p, &p->idxs[i]);
+	fprintf(f, MARK "%s\n", last);
+	sqlite_schema_fclose(&o);
+
+	free(fks);
+	free(ends);
+	sqlite_schema_trace("io", "snapshot", fname, start);
+}
+
+/*
+ * The last migration named by the snapshot in "buf", or NULL if it's
+ * not a snapshot.
+ */
+char *
+sqlite_schema_snapshot_mark(const char *buf, size_t sz)
+{
+	size_t	 end, i, msz = strlen(MARK);
+	char	*cp;
+
+	for (end = sz; end > 0; end--)
+		if ( ! isspace((unsigned char)buf[end - 1]))
+			break;
+	for (i = end; i > 0; i--)
+		if ('\n' == buf[i - 1])
+			break;
+	if (end - i <= msz || strncmp(buf + i, MARK, msz))
+		return(NULL);
+	if (NULL == (cp = strndup(buf + i + msz, end - i - msz)))
+		err(EXIT_FAILURE, "strndup");
+	return(cp);
+}
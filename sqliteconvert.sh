@@ -1,31 +1,42 @@
 #! /bin/sh
 
 TEMPLATE="@SHAREDIR@/schema.xml"
-ARGS=`getopt if: $*`
+USAGE="usage: $0 [-i] [-c cache] [-d dir] [-f template] [-j jobs] [-k hops] [-o image] schema.sql"
+
 INPUT=
 IMAGE=
+CACHE=
+HOODS=
+HOPS=1
+JOBS=1
+OUTPUT=
 
-if [ $? -ne 0 ]
-then
-	echo "usage: $0 [-i] [-f template] schema.sql" 1>&2
-	exit 1
-fi
+# Options are read with getopts, not getopt(1), so that their
+# arguments may contain blanks.
 
-set -- $ARGS
-
-while [ $# -ne 0 ]
+while getopts c:d:f:ij:k:o: OPT
 do
-	case "$1" in
-	-i)
-		IMAGE=1
-		shift ;;
-	-f)
-		TEMPLATE="$2"
-		shift ; shift ;;
-	--)
-		shift ; break ;;
+	case "$OPT" in
+	c)
+		CACHE="$OPTARG" ;;
+	d)
+		HOODS="$OPTARG" ;;
+	i)
+		IMAGE=1 ;;
+	f)
+		TEMPLATE="$OPTARG" ;;
+	j)
+		JOBS="$OPTARG" ;;
+	k)
+		HOPS="$OPTARG" ;;
+	o)
+		OUTPUT="$OPTARG" ;;
+	*)
+		echo "$USAGE" 1>&2
+		exit 1 ;;
 	esac
 done
+shift $((OPTIND - 1))
 
 if [ $# -ne 1 ]
 then
@@ -36,14 +47,80 @@ INPUT="$1"
 
 DOTFLAGS='-h BGCOLOR="red" -t CELLBORDER="0" -t CELLSPACING="0"'
 
-set -e
+# Each graph is laid out once for both the image and its map.
+# Outputs are cached by a hash of the formats and the graph source,
+# which contains all of the options given to sqlite2dot.
+
+FORMATS="-Tpng -Tcmapx"
 
-if [ -z "$IMAGE" ]
+if command -v sha256 >/dev/null 2>&1
 then
-	sed -n '1,/@SCHEMA@/p' "$TEMPLATE"
-	sqlite2html "$INPUT"
-	sqlite2dot $DOTFLAGS "$INPUT" | dot -Tcmapx
-	sed -n '/@SCHEMA@/,$p' "$TEMPLATE"
+	HASH=sha256
+elif command -v sha256sum >/dev/null 2>&1
+then
+	HASH=sha256sum
 else
-	sqlite2dot $DOTFLAGS "$INPUT" | dot -Tpng 
+	HASH=cksum
+fi
+
+# Render "$1" (a dot file) into "$2.png" and "$2.map".
+# Jobs are pairs of NUL-terminated paths, so paths may have any blanks.
+
+RENDER='
+	if [ -z "$CACHE" ]
+	then
+		exec dot -Tpng -o "$2.png" -Tcmapx -o "$2.map" "$1"
+	fi
+	KEY=`( echo "$FORMATS" ; cat "$1" ) | $HASH | tr -cd "0-9a-f"`
+	if [ ! -f "$CACHE/$KEY.png" -o ! -f "$CACHE/$KEY.map" ]
+	then
+		dot -Tpng -o "$CACHE/$KEY.$$.png" \
+		    -Tcmapx -o "$CACHE/$KEY.$$.map" "$1" || exit 1
+		mv -f "$CACHE/$KEY.$$.png" "$CACHE/$KEY.png"
+		mv -f "$CACHE/$KEY.$$.map" "$CACHE/$KEY.map"
+	fi
+	cp "$CACHE/$KEY.png" "$2.png" && cp "$CACHE/$KEY.map" "$2.map"
+'
+
+set -e
+
+TMP=`mktemp -d`
+trap 'rm -rf "$TMP"' EXIT
+
+if [ -n "$CACHE" ]
+then
+	mkdir -p "$CACHE"
+fi
+
+sqlite2dot $DOTFLAGS "$INPUT" >"$TMP/schema.dot"
+printf '%s\0' "$TMP/schema.dot" "$TMP/schema" >"$TMP/jobs"
+
+if [ -n "$HOODS" ]
+then
+	mkdir -p "$HOODS"
+	sqlite2dot $DOTFLAGS -k "$HOPS" -d "$TMP/hoods" "$INPUT"
+	for f in "$TMP"/hoods/*.dot
+	do
+		[ -f "$f" ] || continue
+		printf '%s\0' "$f" "$HOODS/`basename "$f" .dot`" >>"$TMP/jobs"
+	done
+fi
+
+export CACHE FORMATS HASH
+xargs -0 -n 2 -P "$JOBS" sh -c "$RENDER" sh <"$TMP/jobs"
+
+if [ -n "$IMAGE" ]
+then
+	cat "$TMP/schema.png"
+	exit 0
 fi
+
+if [ -n "$OUTPUT" ]
+then
+	cp "$TMP/schema.png" "$OUTPUT"
+fi
+
+sed -n '1,/@SCHEMA@/p' "$TEMPLATE"
+sqlite2html "$INPUT"
+cat "$TMP/schema.map"
+sed -n '/@SCHEMA@/,$p' "$TEMPLATE"
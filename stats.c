@@ -0,0 +1,358 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <ctype.h>
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "extern.h"
+
+/*
+ * Columns we know of in a statistics file's header.
+ */
+enum	statcol {
+	SCOL_TBL, /* sqlite_stat1 */
+	SCOL_IDX,
+	SCOL_STAT,
+	SCOL_NAME, /* dbstat */
+	SCOL_PAGENO,
+	SCOL_PAGETYPE,
+	SCOL_NCELL,
+	SCOL_PGSIZE,
+	SCOL_ROWS, /* summaries */
+	SCOL_PAGES,
+	SCOL_BYTES,
+	SCOL__MAX
+};
+
+static	const char *const statcols[SCOL__MAX] = {
+	"tbl", /* SCOL_TBL */
+	"idx", /* SCOL_IDX */
+	"stat", /* SCOL_STAT */
+	"name", /* SCOL_NAME */
+	"pageno", /* SCOL_PAGENO */
+	"pagetype", /* SCOL_PAGETYPE */
+	"ncell", /* SCOL_NCELL */
+	"pgsize", /* SCOL_PGSIZE */
+	"rows", /* SCOL_ROWS */
+	"pages", /* SCOL_PAGES */
+	"bytes", /* SCOL_BYTES */
+};
+
+/*
+ * Case-insensitive FNV-1a hash of a name, as SQLite names are.
+ */
+static uint32_t
+statshash(const char *cp)
+{
+	uint32_t	 h = 2166136261U;
+
+	for ( ; '\0' != *cp; cp++) {
+		h ^= (unsigned char)tolower((unsigned char)*cp);
+		h *= 16777619U;
+	}
+	return(h);
+}
+
+/*
+ * Look up the slot of "name" in the open-addressed table: either its
+ * entry or the empty slot where it belongs.
+ */
+static struct statent *
+stats_slot(const struct stats *s, const char *name)
+{
+	size_t	 h;
+
+	h = statshash(name) & (s->entsz - 1);
+	for ( ; NULL != s->ents[h].name; h = (h + 1) & (s->entsz - 1))
+		if (0 == strcasecmp(s->ents[h].name, name))
+			break;
+	return(&s->ents[h]);
+}
+
+/*
+ * Get the entry of "name", adding it if it doesn't exist.
+ * The table is doubled when half full.
+ */
+static struct statent *
+stats_add(struct stats *s, const char *name)
+{
+	struct statent	*ent, *old;
+	size_t		 i, oldsz;
+
+	if (2 * (s->nents + 1) > s->entsz) {
+		old = s->ents;
+		oldsz = s->entsz;
+		s->entsz = 0 == oldsz ? 64 : oldsz * 2;
+		s->ents = calloc(s->entsz, sizeof(struct statent));
+		if (NULL == s->ents)
+			err(EXIT_FAILURE, "calloc");
+		for (i = 0; i < oldsz; i++)
+			if (NULL != old[i].name)
+				*stats_slot(s, old[i].name) = old[i];
+		free(old);
+	}
+
+	ent = stats_slot(s, name);
+	if (NULL == ent->name) {
+		if (NULL == (ent->name = strdup(name)))
+			err(EXIT_FAILURE, "strdup");
+		s->nents++;
+	}
+	return(ent);
+}
+
+/*
+ * Split a line of comma-separated values in place into at most "max"
+ * fields, unquoting doubled-quote fields as sqlite3(1) writes them.
+ * Returns the number of fields.
+ */
+static size_t
+stats_split(char *cp, char **fields, size_t max)
+{
+	size_t	 n = 0;
+	char	*out;
+
+	cp[strcspn(cp, "\r\n")] = '\0';
+	for (;;) {
+		if ('"' == *cp) {
+			out = ++cp;
+			if (n < max)
+				fields[n] = out;
+			while ('\0' != *cp) {
+				if ('"' == *cp && '"' == cp[1]) {
+					*out++ = '"';
+					cp += 2;
+				} else if ('"' == *cp) {
+					cp++;
+					break;
+				} else
+					*out++ = *cp++;
+			}
+			cp += strcspn(cp, ",");
+			*out = '\0';
+		} else {
+			if (n < max)
+				fields[n] = cp;
+			cp += strcspn(cp, ",");
+		}
+		n++;
+		if ('\0' == *cp)
+			break;
+		*cp++ = '\0';
+	}
+	return(n < max ? n : max);
+}
+
+/*
+ * Parse a non-negative integer, allowing the fractional part some
+ * exporters append to it.
+ * Returns zero if it isn't one.
+ */
+static int
+stats_num(const char *cp, uint64_t *v)
+{
+	char	*ep;
+
+	while (isspace((unsigned char)*cp))
+		cp++;
+	if ( ! isdigit((unsigned char)*cp))
+		return(0);
+	*v = strtoull(cp, &ep, 10);
+	return('\0' == *ep || '.' == *ep || isspace((unsigned char)*ep));
+}
+
+/*
+ * Read the comma-separated statistics of "fname", as written by
+ * sqlite3(1) in "-csv -header" mode, into "s", merging with those
+ * already read.
+ * The header names the columns: "tbl", "idx", and "stat" of
+ * sqlite_stat1; any of "name", "pageno", "pagetype", "ncell", and
+ * "pgsize" of dbstat, either a row per page or aggregated; or "name"
+ * with any of "rows", "pages", and "bytes".
+ * Return zero on failure and non-zero on success.
+ */
+int
+sqlite_schema_stats(struct stats *s, const char *fname)
+{
+	FILE		*f;
+	char		*line = NULL, *fields[64], *name;
+	size_t		 linesz = 0, nline = 0, i, n, nfields;
+	ssize_t		 len;
+	int		 cols[SCOL__MAX], j, rc = 0;
+	uint64_t	 v, pages;
+	struct statent	*ent;
+
+	if (NULL == (f = fopen(fname, "r"))) {
+		warn("%s", fname);
+		return(0);
+	}
+
+	for (j = 0; j < SCOL__MAX; j++)
+		cols[j] = -1;
+
+	if ((len = getline(&line, &linesz, f)) <= 0) {
+		warnx("%s: missing header", fname);
+		goto out;
+	}
+	nline++;
+	nfields = stats_split(line, fields, 64);
+	for (i = 0; i < nfields; i++)
+		for (j = 0; j < SCOL__MAX; j++)
+			if (0 == strcasecmp(fields[i], statcols[j]))
+				cols[j] = i;
+	if (-1 == cols[SCOL_TBL] && -1 == cols[SCOL_NAME]) {
+		warnx("%s:1: header has no \"tbl\" or \"name\"", fname);
+		goto out;
+	}
+
+	while ((len = getline(&line, &linesz, f)) > 0) {
+		nline++;
+		n = stats_split(line, fields, 64);
+		for ( ; n < nfields; n++)
+			fields[n] = "";
+
+		/* Rows name the index if any, else the table. */
+
+		name = "";
+		if (-1 != cols[SCOL_IDX])
+			name = fields[cols[SCOL_IDX]];
+		if ('\0' == *name && -1 != cols[SCOL_TBL])
+			name = fields[cols[SCOL_TBL]];
+		if ('\0' == *name && -1 != cols[SCOL_NAME])
+			name = fields[cols[SCOL_NAME]];
+		if ('\0' == *name) {
+			warnx("%s:%zu: no name", fname, nline);
+			continue;
+		}
+		ent = stats_add(s, name);
+
+		if (-1 != cols[SCOL_ROWS] &&
+		    stats_num(fields[cols[SCOL_ROWS]], &v)) {
+			ent->rows = v;
+			ent->flags |= STAT_ROWS;
+		}
+		if (-1 != cols[SCOL_PAGES] &&
+		    stats_num(fields[cols[SCOL_PAGES]], &v)) {
+			ent->pages += v;
+			ent->flags |= STAT_PAGES;
+		}
+		if (-1 != cols[SCOL_BYTES] &&
+		    stats_num(fields[cols[SCOL_BYTES]], &v)) {
+			ent->bytes += v;
+			ent->flags |= STAT_BYTES;
+		}
+
+		/*
+		 * A dbstat row is a page, unless aggregated, when the
+		 * page type is empty and "pageno" is the page count.
+		 * Cells of leaf pages are rows (or index entries).
+		 */
+
+		if (-1 != cols[SCOL_PGSIZE] &&
+		    stats_num(fields[cols[SCOL_PGSIZE]], &v)) {
+			pages = 1;
+			if (-1 != cols[SCOL_PAGETYPE] &&
+			    '\0' == fields[cols[SCOL_PAGETYPE]][0] &&
+			    -1 != cols[SCOL_PAGENO])
+				stats_num(fields[cols[SCOL_PAGENO]], &pages);
+			ent->bytes += v;
+			ent->pages += pages;
+			ent->flags |= STAT_PAGES | STAT_BYTES;
+			if (-1 != cols[SCOL_PAGETYPE] && 
+			    -1 != cols[SCOL_NCELL] &&
+			    0 == strcmp(fields[cols[SCOL_PAGETYPE]], "leaf") &&
+			    stats_num(fields[cols[SCOL_NCELL]], &v)) {
+				ent->cells += v;
+				ent->flags |= STAT_CELLS;
+			}
+		}
+
+		/* 
+		 * The first number of sqlite_stat1 is the row count.
+		 * Tables with indices have rows only for those, so take
+		 * the most of them (partial indices have fewer) unless
+		 * the table has its own.
+		 */
+
+		if (-1 == cols[SCOL_STAT] ||
+		    ! stats_num(fields[cols[SCOL_STAT]], &v))
+			continue;
+		ent->rows = v;
+		ent->flags |= STAT_ROWS;
+		ent->flags &= ~STAT_ROWSIDX;
+		if (-1 == cols[SCOL_TBL] || 
+		    name == fields[cols[SCOL_TBL]] ||
+		    '\0' == fields[cols[SCOL_TBL]][0])
+			continue;
+		ent = stats_add(s, fields[cols[SCOL_TBL]]);
+		if ( ! (STAT_ROWS & ent->flags) ||
+		    ((STAT_ROWSIDX & ent->flags) && v > ent->rows)) {
+			ent->rows = v;
+			ent->flags |= STAT_ROWS | STAT_ROWSIDX;
+		}
+	}
+
+	if (ferror(f)) {
+		warn("%s", fname);
+		goto out;
+	}
+
+	/* Fall back to leaf cells for the row count. */
+
+	for (i = 0; i < s->entsz; i++)
+		if (NULL != s->ents[i].name &&
+		    ! (STAT_ROWS & s->ents[i].flags) &&
+		    (STAT_CELLS & s->ents[i].flags)) {
+			s->ents[i].rows = s->ents[i].cells;
+			s->ents[i].flags |= STAT_ROWS | STAT_ROWSIDX;
+		}
+	rc = 1;
+out:
+	free(line);
+	fclose(f);
+	return(rc);
+}
+
+/*
+ * Look up the statistics of a table or index by name.
+ * Returns NULL if there are none.
+ */
+const struct statent *
+sqlite_schema_stats_get(const struct stats *s, const char *name)
+{
+	const struct statent *ent;
+
+	if (0 == s->nents || NULL == name)
+		return(NULL);
+	ent = stats_slot(s, name);
+	return(NULL == ent->name ? NULL : ent);
+}
+
+void
+sqlite_schema_stats_free(struct stats *s)
+{
+	size_t	 i;
+
+	for (i = 0; i < s->entsz; i++)
+		free(s->ents[i].name);
+	free(s->ents);
+	memset(s, 0, sizeof(struct stats));
+}
@@ -0,0 +1,213 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "extern.h"
+
+/*
+ * Assumed sizes of values whose length isn't declared.
+ * These are guesses, but they're the same guesses for all tables, so
+ * tables may at least be compared.
+ */
+#define	EST_INTEGER	 4
+#define	EST_REAL	 8
+#define	EST_NUMERIC	 4
+#define	EST_TEXT	 24
+#define	EST_BLOB	 64
+#define	EST_ROWID	 4
+
+const char *const affinities[AFF__MAX] = {
+	"integer", /* AFF_INTEGER */
+	"text", /* AFF_TEXT */
+	"blob", /* AFF_BLOB */
+	"real", /* AFF_REAL */
+	"numeric", /* AFF_NUMERIC */
+};
+
+/*
+ * Case-insensitive strstr(3).
+ */
+static int
+typehas(const char *type, const char *str)
+{
+	size_t	 sz = strlen(str);
+
+	for ( ; '\0' != *type; type++)
+		if (0 == strncasecmp(type, str, sz))
+			return(1);
+	return(0);
+}
+
+/*
+ * Compute the affinity of a declared type as in section 3.1 of the
+ * SQLite "Datatypes" document.
+ */
+enum affinity
+sqlite_schema_affinity(const char *type)
+{
+
+	if (NULL == type)
+		return(AFF_BLOB);
+	if (typehas(type, "int"))
+		return(AFF_INTEGER);
+	if (typehas(type, "char") || 
+	    typehas(type, "clob") || 
+	    typehas(type, "text"))
+		return(AFF_TEXT);
+	if (typehas(type, "blob"))
+		return(AFF_BLOB);
+	if (typehas(type, "real") || 
+	    typehas(type, "floa") || 
+	    typehas(type, "doub"))
+		return(AFF_REAL);
+	return(AFF_NUMERIC);
+}
+
+/*
+ * Size of a variable-length integer.
+ */
+static size_t
+varintsz(size_t v)
+{
+	size_t	 sz;
+
+	for (sz = 1; sz < 9 && v > 0x7f; sz++)
+		v >>= 7;
+	return(sz);
+}
+
+/*
+ * Declared length, e.g., 255 in "varchar(255)", or zero.
+ */
+static size_t
+typelen(const char *type)
+{
+	const char	*cp;
+
+	if (NULL == type || NULL == (cp = strchr(type, '(')))
+		return(0);
+	for (cp++; isspace((unsigned char)*cp); cp++)
+		continue;
+	return(isdigit((unsigned char)*cp) ? 
+		(size_t)strtoul(cp, NULL, 10) : 0);
+}
+
+/*
+ * Whether the column is an alias for the rowid, which is stored in
+ * the cell and not in the record.
+ */
+static int
+isrowid(const struct parse *p, const struct col *col)
+{
+
+	return(0 == (TAB_WITHOUT_ROWID & COL_TAB(p, col)->flags) &&
+	       (COL_PKEY & col->flags) && 
+	       0 == strcasecmp(SCHEMA_STR(p, col->type), "integer"));
+}
+
+/*
+ * Estimate the on-disk footprint of a row in the table as described in
+ * the SQLite "Database File Format" document, sections 1.6 (b-tree
+ * pages) and 2.1 (record format).
+ * Values are estimated by their declared type (see the EST_xxx
+ * defines); with no declared length, TEXT and BLOB values are flagged
+ * as possibly overflowing.
+ */
+void
+sqlite_schema_storage(const struct parse *p, const struct tab *tab, 
+	size_t pagesz, struct storage *st)
+{
+	const struct col *col;
+	size_t		  hdr, body, len, local, m, k;
+
+	memset(st, 0, sizeof(struct storage));
+	hdr = body = 0;
+
+	COL_FOREACH(col, p, tab) {
+		if (isrowid(p, col)) {
+			hdr++;
+			continue;
+		}
+		len = typelen(SCHEMA_OPT(p, col->type));
+		switch (sqlite_schema_affinity(SCHEMA_OPT(p, col->type))) {
+		case (AFF_INTEGER):
+			hdr++;
+			body += EST_INTEGER;
+			break;
+		case (AFF_REAL):
+			hdr++;
+			body += EST_REAL;
+			break;
+		case (AFF_NUMERIC):
+			hdr++;
+			body += EST_NUMERIC;
+			break;
+		case (AFF_TEXT):
+			if (0 == len) {
+				len = EST_TEXT;
+				st->unbounded++;
+			}
+			hdr += varintsz(len * 2 + 13);
+			body += len;
+			break;
+		default:
+			if (0 == len) {
+				len = EST_BLOB;
+				st->unbounded++;
+			}
+			hdr += varintsz(len * 2 + 12);
+			body += len;
+			break;
+		}
+	}
+
+	/* The header size includes its own varint. */
+
+	st->hdr = hdr + varintsz(hdr + 1);
+	st->payload = st->hdr + body;
+
+	/*
+	 * Rowid tables are table b-trees; "without rowid" tables are
+	 * index b-trees, with a smaller maximum local payload.
+	 */
+
+	if (TAB_WITHOUT_ROWID & tab->flags)
+		st->maxlocal = (pagesz - 12) * 64 / 255 - 23;
+	else
+		st->maxlocal = pagesz - 35;
+
+	local = st->payload;
+	if (st->payload > st->maxlocal) {
+		m = (pagesz - 12) * 32 / 255 - 23;
+		k = m + (st->payload - m) % (pagesz - 4);
+		local = (k <= st->maxlocal ? k : m) + 4;
+		st->overflow = OVERFLOW_LIKELY;
+	} else if (st->unbounded)
+		st->overflow = OVERFLOW_POSSIBLE;
+
+	st->cell = varintsz(st->payload) + local;
+	if (0 == (TAB_WITHOUT_ROWID & tab->flags))
+		st->cell += EST_ROWID;
+
+	/* Leaf pages have an 8-byte header and 2-byte cell pointers. */
+
+	st->rows = (pagesz - 8) / (st->cell + 2);
+}
@@ -0,0 +1,253 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2016 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHORS DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <err.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * Events are written as the trace-event JSON read by chrome://tracing
+ * and Perfetto: an array of objects, each span a "complete" event with
+ * its start and duration in microseconds.
+ * Each thread formats its events into its own buffer, which is only
+ * written to the file (under the lock) when full, when the thread
+ * exits, or when the trace is closed.
+ */
+#define	TBUFSZ	 (64 * 1024)
+
+struct	tbuf {
+	char		*buf;
+	size_t		 len;
+	size_t		 tid;
+};
+
+static	FILE		*tracef; /* or NULL if not tracing */
+static	uint64_t	 epoch;
+static	size_t		 ntids;
+static	pthread_mutex_t	 mtx = PTHREAD_MUTEX_INITIALIZER;
+static	pthread_key_t	 key;
+
+static uint64_t
+usecs(void)
+{
+	struct timespec	 ts;
+
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &ts))
+		err(EXIT_FAILURE, "clock_gettime");
+	return((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+static void
+tbuf_flush(struct tbuf *b)
+{
+
+	if (0 == b->len)
+		return;
+	pthread_mutex_lock(&mtx);
+	fwrite(b->buf, 1, b->len, tracef);
+	pthread_mutex_unlock(&mtx);
+	b->len = 0;
+}
+
+/*
+ * Called as each thread exits.
+ */
+static void
+tbuf_free(void *arg)
+{
+	struct tbuf	*b = arg;
+
+	tbuf_flush(b);
+	free(b->buf);
+	free(b);
+}
+
+/*
+ * The buffer of the calling thread, which is numbered on first use.
+ */
+static struct tbuf *
+tbuf_get(void)
+{
+	struct tbuf	*b;
+
+	if (NULL != (b = pthread_getspecific(key)))
+		return(b);
+	if (NULL == (b = calloc(1, sizeof(struct tbuf))) ||
+	    NULL == (b->buf = malloc(TBUFSZ)))
+		err(EXIT_FAILURE, "malloc");
+	pthread_mutex_lock(&mtx);
+	b->tid = ++ntids;
+	pthread_mutex_unlock(&mtx);
+	pthread_setspecific(key, b);
+	return(b);
+}
+
+/*
+ * Append the string "cp" to the buffer, escaped for JSON, or nothing if
+ * it would overflow.
+ * Returns zero on overflow.
+ */
+static int
+tbuf_esc(struct tbuf *b, const char *cp)
+{
+
+	for ( ; '\0' != *cp; cp++) {
+		if (b->len + 16 >= TBUFSZ)
+			return(0);
+		if ('"' == *cp || '\\' == *cp) {
+			b->buf[b->len++] = '\\';
+			b->buf[b->len++] = *cp;
+		} else if ((unsigned char)*cp < 0x20)
+			b->len += snprintf(b->buf + b->len, 7,
+				"\\u%.4x", (unsigned char)*cp);
+		else
+			b->buf[b->len++] = *cp;
+	}
+	return(1);
+}
+
+/*
+ * Append an event to the buffer, flushing it first if it may not fit.
+ * Events with arguments too long for the buffer are dropped.
+ */
+static void
+tbuf_event(const char *ph, const char *cat, const char *name,
+	const char *arg, uint64_t start, uint64_t end)
+{
+	struct tbuf	*b = tbuf_get();
+	size_t		 len;
+
+	if (b->len + 512 + (NULL == arg ? 0 : strlen(arg)) > TBUFSZ)
+		tbuf_flush(b);
+
+	len = b->len;
+	b->len += snprintf(b->buf + b->len, TBUFSZ - b->len,
+		"{\"ph\":\"%s\",\"cat\":\"%s\",\"name\":\"%s\","
+		"\"pid\":1,\"tid\":%zu,\"ts\":%" PRIu64,
+		ph, cat, name, b->tid, start - epoch);
+	if ('X' == *ph)
+		b->len += snprintf(b->buf + b->len, TBUFSZ - b->len,
+			",\"dur\":%" PRIu64, end - start);
+	if (NULL != arg) {
+		b->len += snprintf(b->buf + b->len, TBUFSZ - b->len,
+			",\"args\":{\"name\":\"");
+		if ( ! tbuf_esc(b, arg)) {
+			b->len = len;
+			return;
+		}
+		b->buf[b->len++] = '"';
+		b->buf[b->len++] = '}';
+	}
+	b->buf[b->len++] = '}';
+	b->buf[b->len++] = ',';
+	b->buf[b->len++] = '\n';
+}
+
+/*
+ * Begin tracing to "fname".
+ * Returns zero on failure.
+ */
+int
+sqlite_schema_trace_open(const char *fname)
+{
+	int	 c;
+
+	if (NULL == (tracef = fopen(fname, "w"))) {
+		warn("%s", fname);
+		return(0);
+	}
+	if (0 != (c = pthread_key_create(&key, tbuf_free)))
+		errx(EXIT_FAILURE, "pthread_key_create: %s", strerror(c));
+	epoch = usecs();
+	fputs("[\n", tracef);
+	sqlite_schema_trace_thread("main");
+	return(1);
+}
+
+/*
+ * Flush the calling thread's events and finish the trace.
+ * All other threads must have exited.
+ * Returns zero on failure.
+ */
+int
+sqlite_schema_trace_close(void)
+{
+	struct tbuf	*b;
+	int		 rc;
+
+	if (NULL == tracef)
+		return(1);
+	if (NULL != (b = pthread_getspecific(key))) {
+		pthread_setspecific(key, NULL);
+		tbuf_free(b);
+	}
+
+	/* The final event is without the trailing comma. */
+
+	fprintf(tracef, "{\"ph\":\"M\",\"name\":\"process_name\","
+		"\"pid\":1,\"args\":{\"name\":\"%s\"}}\n]\n",
+		getprogname());
+	rc = ! ferror(tracef);
+	if (EOF == fclose(tracef))
+		rc = 0;
+	if ( ! rc)
+		warnx("trace: write error");
+	tracef = NULL;
+	pthread_key_delete(key);
+	return(rc);
+}
+
+/*
+ * Name the calling thread in the trace.
+ */
+void
+sqlite_schema_trace_thread(const char *name)
+{
+
+	if (NULL != tracef)
+		tbuf_event("M", "__metadata", "thread_name", name, epoch, 0);
+}
+
+/*
+ * The start of a span, or zero if not tracing.
+ */
+uint64_t
+sqlite_schema_trace_now(void)
+{
+
+	return(NULL == tracef ? 0 : usecs());
+}
+
+/*
+ * Record a span of "cat" named "name" from "start" to now.
+ * If "arg" is not NULL, it's shown as the span's argument.
+ * Does nothing if not tracing.
+ */
+void
+sqlite_schema_trace(const char *cat, const char *name,
+	const char *arg, uint64_t start)
+{
+
+	if (NULL != tracef)
+		tbuf_event("X", cat, name, arg, start, usecs());
+}